@@ -0,0 +1,2073 @@
+// benchmark.cpp : Micro-benchmarks for myBufferCache.
+//
+// Usage: BufferCacheBench [scenario] [cache_size]
+//        BufferCacheBench sweep <workload> [options]
+//   sweep  - throughput, hit ratio and p50/p99/p999 getblk+brelse latency
+//            for every combination of cache size and thread count.
+//            Workloads: uniform, zipf[:theta], scan, trace:<file>
+//            (see load_trace for the formats). Options:
+//              --sizes 256,1024,...  cache sizes in blocks
+//              --threads 1,2,4,...   thread counts
+//              --ops N               accesses per thread (synthetic)
+//              --blocks N            working set in blocks (synthetic)
+//              --writes R            fraction of writes (synthetic)
+//              --policy lru|clock|2q|arc   --shards N
+//              --read-us N --write-us N    device latency
+//              --warmup              replay once untimed before measuring
+//              --csv                 machine-readable output
+//   lru    - getblk/brelse hit latency as the cache grows (default)
+//   shards - multi-threaded hit throughput vs thread count, 1 shard vs many
+//   device <path> [direct] - hit ratio vs latency on a file or block device
+//   readahead - sequential vs random scans with read-ahead off and on
+//   flusher - getblk tail latency under writes, background flusher off and on
+//   policies - trace-driven hit ratios of LRU, CLOCK, 2Q and ARC
+//   waits - buffer lock and free-buffer waits for a range of cache sizes
+//   stats  - the cache's own counters and latency histograms for a mixed
+//            multi-threaded load
+//   layout - hit latency over a 64 MB cache for block sizes 512 B - 64 KB,
+//            with and without huge pages
+//   batch  - extents of consecutive blocks loaded with a getblk/brelse loop
+//            and with getblk_many/brelse_many, cold and cached
+//   io [path] [direct] - concurrent misses on one shard, and batches of
+//            scattered misses loaded synchronously and through the I/O
+//            engine, on a slow in-memory device or on the given file
+//   sync   - bsync and bsync_range time as more of the cache is dirty;
+//            then a check that bsync waits for a dirty block held
+//            exclusively and for one being written back by an eviction.
+//            Exits non-zero if either is missing after the sync.
+//   async  - one thread reading from a slow device with blocking getblk
+//            and with getblk_async from more and more tasks on an Executor
+//   journal [dir] - bwrite throughput to a file in dir (default: the
+//            current directory) without a journal, with an fsync per
+//            write and with the journal's group commit; then a crash
+//            test that kills a writer process and checks recovery.
+//            Exits non-zero if a block is lost or torn, or if a cache
+//            rejecting its options has opened the journal.
+//   tier   - zipf reads over a working set several times the cache on a
+//            slow device, without and with compressed tiers of growing
+//            size, plus the codec's own speed and ratio
+//   warm   - hit ratio over time after a restart, cold and with the warm
+//            set saved by the previous run loaded in the background
+//   resize - hit ratio per 100 ms while the cache is grown and shrunk
+//            under a zipf load, then a memory budget that drops and
+//            recovers, followed by the memory-pressure thread
+//   index  - block index lookups, hits and misses, against the
+//            std::unordered_map it replaced, for growing entry counts; then
+//            a cache fronting four devices checking that every block is
+//            read from and written to its own. Exits non-zero on a mix-up.
+//   stress - concurrent readers and writers checking for torn or stale
+//            blocks; exits non-zero on failure. Worth running in a
+//            -fsanitize=thread build after touching the lock-free paths.
+
+#include "lz_codec.h"
+#include "my_buffer_cache.h"
+#include "workload.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the compiler from dropping reads whose result is otherwise unused
+volatile unsigned g_sink = 0;
+
+// Measures the cost of a cache hit (getblk + brelse) for growing cache sizes.
+// With an O(1) LRU the per-operation latency should stay flat.
+void bench_lru_hit_latency(size_t max_cache_size) {
+    const size_t OPS = 2000000;
+
+    std::cout << "getblk/brelse hit latency\n";
+    std::cout << std::setw(12) << "cache_size" << std::setw(14) << "ns/op" << "\n";
+
+    for (size_t cache_size = 1024; cache_size <= max_cache_size; cache_size *= 4) {
+        myBufferCache cache(cache_size);
+
+        // Fill the cache so the LRU list holds every buffer
+        for (size_t i = 0; i < cache_size; ++i) {
+            cache.brelse(cache.getblk(static_cast<int>(i)));
+        }
+
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> pick(0, static_cast<int>(cache_size) - 1);
+        std::vector<int> blocks(OPS);
+        for (auto& b : blocks) {
+            b = pick(rng);
+        }
+
+        auto start = Clock::now();
+        for (int block : blocks) {
+            cache.brelse(cache.getblk(block));
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start);
+
+        std::cout << std::setw(12) << cache_size
+            << std::setw(14) << std::fixed << std::setprecision(1)
+            << elapsed.count() / OPS << "\n";
+    }
+}
+
+// Runs getblk/brelse hits from several threads, in the style of main.cpp's
+// worker_thread, and reports aggregate throughput.
+double run_hit_throughput(myBufferCache& cache, int num_blocks, int num_threads, size_t ops_per_thread) {
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&cache, num_blocks, ops_per_thread, t]() {
+            std::mt19937 rng(t + 1);
+            std::uniform_int_distribution<int> pick(0, num_blocks - 1);
+            for (size_t i = 0; i < ops_per_thread; ++i) {
+                cache.brelse(cache.getblk(pick(rng)));
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+
+    return static_cast<double>(ops_per_thread) * num_threads / elapsed.count();
+}
+
+// Compares a single-lock cache with a sharded one as the thread count grows.
+void bench_shard_scaling(size_t cache_size) {
+    const size_t OPS_PER_THREAD = 200000;
+    const int MAX_THREADS = 32;
+    const size_t NUM_SHARDS = 64;
+
+    std::cout << "getblk/brelse hit throughput (Mops/s), cache_size=" << cache_size << "\n";
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "1 shard"
+        << std::setw(10) << NUM_SHARDS << " shards\n";
+
+    myBufferCache single(cache_size, 1);
+    myBufferCache sharded(cache_size, NUM_SHARDS);
+    // Half the cache, so uneven hashing never pushes a shard into eviction
+    int num_blocks = static_cast<int>(cache_size / 2);
+    for (int i = 0; i < num_blocks; ++i) {
+        single.brelse(single.getblk(i));
+        sharded.brelse(sharded.getblk(i));
+    }
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double single_ops = run_hit_throughput(single, num_blocks, threads, OPS_PER_THREAD);
+        double sharded_ops = run_hit_throughput(sharded, num_blocks, threads, OPS_PER_THREAD);
+
+        std::cout << std::setw(8) << threads
+            << std::setw(12) << std::fixed << std::setprecision(2) << single_ops / 1e6
+            << std::setw(17) << sharded_ops / 1e6 << "\n";
+    }
+}
+
+// Random reads over a file-backed device: hit ratio and mean getblk latency
+// for cache sizes between 1/16 of the working set and the whole of it.
+void bench_device(const std::string& path, bool direct_io) {
+    const int WORKING_SET = 65536;  // 256 MB of 4 KB blocks
+    const size_t OPS = 200000;
+
+    auto device = std::make_shared<FileBlockDevice>(path, myBufferCache::BLOCK_SIZE, direct_io);
+
+    std::cout << "random reads on " << path << (direct_io ? " (O_DIRECT)" : "") << "\n";
+    std::cout << std::setw(12) << "cache_size" << std::setw(12) << "hit ratio"
+        << std::setw(14) << "us/getblk" << "\n";
+
+    for (int cache_size = WORKING_SET / 16; cache_size <= WORKING_SET; cache_size *= 2) {
+        myBufferCache::Options options;
+        options.device = device;
+        myBufferCache cache(cache_size, options);
+
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> pick(0, WORKING_SET - 1);
+
+        // Warm up so the measurement sees steady-state hit ratio
+        for (size_t i = 0; i < OPS; ++i) {
+            cache.brelse(cache.getblk(pick(rng)));
+        }
+        size_t hits_before = cache.hits();
+
+        auto start = Clock::now();
+        for (size_t i = 0; i < OPS; ++i) {
+            cache.brelse(cache.getblk(pick(rng)));
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start);
+
+        std::cout << std::setw(12) << cache_size
+            << std::setw(12) << std::fixed << std::setprecision(3)
+            << static_cast<double>(cache.hits() - hits_before) / OPS
+            << std::setw(14) << std::setprecision(2) << elapsed.count() / OPS << "\n";
+    }
+}
+
+// In-memory device that takes a fixed time per I/O, like a fast SSD
+class SlowBlockDevice : public MemoryBlockDevice {
+public:
+    explicit SlowBlockDevice(std::chrono::microseconds read_latency,
+        std::chrono::microseconds write_latency = std::chrono::microseconds(0))
+        : MemoryBlockDevice(myBufferCache::BLOCK_SIZE),
+        m_read_latency(read_latency), m_write_latency(write_latency) {}
+
+    void read_block(uint64_t block_number, char* data) override {
+        std::this_thread::sleep_for(m_read_latency);
+        MemoryBlockDevice::read_block(block_number, data);
+    }
+
+    // A run of blocks costs one request, as with a vectored read
+    void read_blocks(uint64_t first_block, size_t count, char* const* data) override {
+        std::this_thread::sleep_for(m_read_latency);
+        MemoryBlockDevice::read_blocks(first_block, count, data);
+    }
+
+    void write_block(uint64_t block_number, const char* data) override {
+        if (m_write_latency.count() > 0) {
+            std::this_thread::sleep_for(m_write_latency);
+        }
+        m_write_requests++;
+        MemoryBlockDevice::write_block(block_number, data);
+    }
+
+    void write_blocks(uint64_t first_block, size_t count, const char* const* data) override {
+        if (m_write_latency.count() > 0) {
+            std::this_thread::sleep_for(m_write_latency);
+        }
+        m_write_requests++;
+        MemoryBlockDevice::write_blocks(first_block, count, data);
+    }
+
+    size_t write_requests() const { return m_write_requests; }
+
+private:
+    std::chrono::microseconds m_read_latency;
+    std::chrono::microseconds m_write_latency;
+    std::atomic<size_t> m_write_requests{ 0 };
+};
+
+// Value at quantile q (0..1) of an unsorted sample; reorders the sample
+double percentile(std::vector<double>& samples, double q) {
+    if (samples.empty()) return 0;
+    size_t index = std::min(samples.size() - 1, static_cast<size_t>(q * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+// Sequential and random scans with read-ahead off and on
+void bench_readahead() {
+    const int NUM_BLOCKS = 4096;
+    const size_t CACHE_SIZE = 1024;
+    const auto READ_LATENCY = std::chrono::microseconds(100);
+    const auto WORK_PER_BLOCK = std::chrono::microseconds(50);
+
+    std::cout << "scan of " << NUM_BLOCKS << " blocks, " << READ_LATENCY.count()
+        << "us device reads, " << WORK_PER_BLOCK.count() << "us work per block\n";
+    std::cout << std::setw(12) << "pattern" << std::setw(11) << "readahead"
+        << std::setw(10) << "ms" << std::setw(8) << "hits" << std::setw(8) << "misses"
+        << std::setw(10) << "ra issued" << std::setw(9) << "ra hits" << std::setw(11) << "ra wasted" << "\n";
+
+    for (bool sequential : { true, false }) {
+        std::vector<int> blocks(NUM_BLOCKS);
+        for (int i = 0; i < NUM_BLOCKS; ++i) {
+            blocks[i] = i;
+        }
+        if (!sequential) {
+            std::shuffle(blocks.begin(), blocks.end(), std::mt19937(3));
+        }
+
+        for (bool readahead : { false, true }) {
+            myBufferCache::Options options;
+            options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+            options.readahead = readahead;
+            myBufferCache cache(CACHE_SIZE, options);
+
+            auto start = Clock::now();
+            for (int block : blocks) {
+                auto* buf = cache.getblk(block);
+                std::this_thread::sleep_for(WORK_PER_BLOCK);
+                cache.brelse(buf);
+            }
+            auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start);
+
+            std::cout << std::setw(12) << (sequential ? "sequential" : "random")
+                << std::setw(11) << (readahead ? "on" : "off")
+                << std::setw(10) << std::fixed << std::setprecision(1) << elapsed.count()
+                << std::setw(8) << cache.hits() << std::setw(8) << cache.misses()
+                << std::setw(10) << cache.readahead_issued() << std::setw(9) << cache.readahead_hits()
+                << std::setw(11) << cache.readahead_wasted() << "\n";
+        }
+    }
+}
+
+// Write-heavy random load: getblk latency with and without the flusher
+void bench_flusher() {
+    const size_t CACHE_SIZE = 1024;
+    const int WORKING_SET = 4096;
+    const size_t OPS = 20000;
+    const auto READ_LATENCY = std::chrono::microseconds(50);
+    const auto WRITE_LATENCY = std::chrono::microseconds(200);
+
+    std::cout << "random getblk/brelse, 50% writes, working set " << WORKING_SET
+        << " blocks, cache " << CACHE_SIZE << "\n";
+    std::cout << std::setw(9) << "flusher" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+        << std::setw(10) << "p999 us" << std::setw(14) << "evict wbacks" << std::setw(14) << "flusher wr"
+        << std::setw(11) << "throttled" << "\n";
+
+    for (bool flusher : { false, true }) {
+        myBufferCache::Options options;
+        options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY, WRITE_LATENCY);
+        options.background_flush = flusher;
+        options.flush_interval = std::chrono::milliseconds(5);
+        options.flush_age = std::chrono::milliseconds(20);
+        myBufferCache cache(CACHE_SIZE, options);
+
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<int> pick(0, WORKING_SET - 1);
+        std::vector<double> latencies;
+        latencies.reserve(OPS);
+
+        for (size_t i = 0; i < OPS; ++i) {
+            int block = pick(rng);
+            auto start = Clock::now();
+            auto* buf = cache.getblk(block);
+            latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            cache.brelse(buf, i % 2 == 0);
+        }
+
+        std::cout << std::setw(9) << (flusher ? "on" : "off") << std::fixed << std::setprecision(1)
+            << std::setw(10) << percentile(latencies, 0.50)
+            << std::setw(10) << percentile(latencies, 0.99)
+            << std::setw(10) << percentile(latencies, 0.999)
+            << std::setw(14) << cache.eviction_writebacks()
+            << std::setw(14) << cache.flusher_writes()
+            << std::setw(11) << cache.throttled_writes() << "\n";
+    }
+}
+
+// Replays a trace against a fresh cache and returns its hit ratio
+double replay_hit_ratio(const std::vector<Access>& trace, size_t cache_size, myBufferCache::Policy policy) {
+    myBufferCache::Options options;
+    options.policy = policy;
+    myBufferCache cache(cache_size, options);
+
+    for (const Access& access : trace) {
+        cache.brelse(cache.getblk(access.block_number), access.write);
+    }
+    return static_cast<double>(cache.hits()) / trace.size();
+}
+
+// Hit ratios of every replacement policy on zipfian, scan and mixed traces
+void bench_policies() {
+    const size_t CACHE_SIZE = 1024;
+    const size_t LENGTH = 400000;
+
+    struct Workload {
+        const char* name;
+        std::vector<Access> trace;
+    };
+    std::vector<Workload> workloads = {
+        { "zipf 0.9 / 16K", make_zipf_trace(16384, 0.9, LENGTH) },
+        { "loop 1.5x cache", make_scan_trace(static_cast<int>(CACHE_SIZE * 3 / 2), LENGTH) },
+        { "zipf + scans", make_mixed_trace(1024, 0.9, 4096, 20000, LENGTH) },
+    };
+    const myBufferCache::Policy policies[] = {
+        myBufferCache::Policy::LRU, myBufferCache::Policy::CLOCK,
+        myBufferCache::Policy::TwoQ, myBufferCache::Policy::ARC,
+    };
+    const char* names[] = { "LRU", "CLOCK", "2Q", "ARC" };
+
+    std::cout << "hit ratio, cache_size=" << CACHE_SIZE << ", " << LENGTH << " accesses\n";
+    std::cout << std::setw(18) << "workload";
+    for (const char* name : names) {
+        std::cout << std::setw(9) << name;
+    }
+    std::cout << "\n";
+
+    for (const auto& workload : workloads) {
+        std::cout << std::setw(18) << workload.name << std::fixed << std::setprecision(3);
+        for (auto policy : policies) {
+            std::cout << std::setw(9) << replay_hit_ratio(workload.trace, CACHE_SIZE, policy);
+        }
+        std::cout << "\n";
+    }
+}
+
+// Threads that each hold a couple of buffers while working, with a small
+// cache: how often and how long getblk waits, to help size the cache
+void bench_waits() {
+    const int NUM_THREADS = 8;
+    const int HELD_PER_THREAD = 2;
+    const int WORKING_SET = 256;
+    const int OPS_PER_THREAD = 2000;
+    const auto WORK = std::chrono::microseconds(20);
+
+    std::cout << NUM_THREADS << " threads holding " << HELD_PER_THREAD
+        << " buffers each, 20% exclusive, working set " << WORKING_SET << "\n";
+    std::cout << std::setw(12) << "cache_size" << std::setw(12) << "hit ratio" << std::setw(12) << "lock waits"
+        << std::setw(12) << "free waits" << std::setw(16) << "us wait/getblk" << "\n";
+
+    // Never smaller than the number of buffers pinned at once, or all threads
+    // could end up waiting for each other
+    for (size_t cache_size = NUM_THREADS * HELD_PER_THREAD; cache_size <= WORKING_SET; cache_size *= 2) {
+        myBufferCache cache(cache_size);
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&cache, t, WORK]() {
+                std::mt19937 rng(t + 1);
+                ZipfGenerator zipf(WORKING_SET, 0.8, t + 1);
+                std::bernoulli_distribution exclusive(0.2);
+
+                for (int i = 0; i < OPS_PER_THREAD; ++i) {
+                    // Lock distinct blocks in ascending order to avoid deadlock
+                    int blocks[HELD_PER_THREAD];
+                    for (int j = 0; j < HELD_PER_THREAD; ++j) {
+                        do {
+                            blocks[j] = zipf.next();
+                        } while (std::find(blocks, blocks + j, blocks[j]) != blocks + j);
+                    }
+                    std::sort(blocks, blocks + HELD_PER_THREAD);
+
+                    myBufferCache::Buffer* held[HELD_PER_THREAD];
+                    for (int j = 0; j < HELD_PER_THREAD; ++j) {
+                        held[j] = cache.getblk(blocks[j], exclusive(rng)
+                            ? myBufferCache::LockMode::Exclusive : myBufferCache::LockMode::Shared);
+                    }
+                    std::this_thread::sleep_for(WORK);
+                    for (auto* buf : held) {
+                        cache.brelse(buf);
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        double getblks = static_cast<double>(cache.hits() + cache.misses());
+        std::cout << std::setw(12) << cache_size
+            << std::setw(12) << std::fixed << std::setprecision(3) << cache.hits() / getblks
+            << std::setw(12) << cache.buffer_lock_waits() << std::setw(12) << cache.free_buffer_waits()
+            << std::setw(16) << std::setprecision(2)
+            << std::chrono::duration<double, std::micro>(cache.wait_time()).count() / getblks << "\n";
+    }
+}
+
+void print_latency(const char* name, const LatencyHistogram::Snapshot& latency) {
+    std::cout << std::setw(12) << name << std::setw(10) << latency.count()
+        << std::fixed << std::setprecision(2)
+        << std::setw(10) << latency.mean_ns() / 1000
+        << std::setw(10) << latency.percentile(0.50) / 1000
+        << std::setw(10) << latency.percentile(0.99) / 1000
+        << std::setw(10) << latency.percentile(0.999) / 1000 << "\n";
+}
+
+// Zipf reads and writes from several threads on a slow device with the
+// flusher running, reported through myBufferCache::stats()
+void bench_stats() {
+    const int NUM_THREADS = 4;
+    const size_t CACHE_SIZE = 1024;
+    const int WORKING_SET = 16384;
+    const int OPS_PER_THREAD = 20000;
+
+    myBufferCache::Options options;
+    options.device = std::make_shared<SlowBlockDevice>(std::chrono::microseconds(20), std::chrono::microseconds(50));
+    options.num_shards = 4;
+    options.background_flush = true;
+    myBufferCache cache(CACHE_SIZE, options);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&cache, t]() {
+            ZipfGenerator zipf(WORKING_SET, 0.9, t + 1);
+            for (int i = 0; i < OPS_PER_THREAD; ++i) {
+                bool write = i % 5 == 0;
+                cache.brelse(cache.getblk(zipf.next()), write);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    auto stats = cache.stats();
+    std::cout << NUM_THREADS << " threads, zipf 0.9 over " << WORKING_SET << " blocks, 20% writes, cache "
+        << CACHE_SIZE << "\n";
+    std::cout << "  hit ratio " << std::fixed << std::setprecision(3) << stats.hit_ratio()
+        << ", evictions " << stats.evictions << " (" << stats.dirty_evictions << " dirty)"
+        << ", reads " << stats.disk_reads << ", writes " << stats.disk_writes
+        << " (" << stats.flusher_writes << " by the flusher)"
+        << ", lock waits " << stats.lock_waits << ", free waits " << stats.free_waits << "\n";
+    std::cout << std::setw(12) << "latency" << std::setw(10) << "samples" << std::setw(10) << "mean us"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "p999 us" << "\n";
+    print_latency("hit", stats.hit_latency);
+    print_latency("miss", stats.miss_latency);
+    print_latency("writeback", stats.writeback_latency);
+    print_latency("eviction", stats.eviction_latency);
+}
+
+// Random hits spread over a whole 64 MB cache, reading one word of each
+// block, so TLB reach matters. The buffer headers are a separate compact
+// array, so only the payload access scales with the block size.
+void bench_layout() {
+    const size_t CACHE_BYTES = 64 * 1024 * 1024;
+    const size_t OPS = 2000000;
+
+    std::cout << "random hits over " << CACHE_BYTES / (1024 * 1024) << " MB, "
+        << sizeof(myBufferCache::Buffer) << " bytes of metadata per buffer\n";
+    std::cout << std::setw(12) << "block_size" << std::setw(10) << "buffers"
+        << std::setw(14) << "4K pages" << std::setw(14) << "huge pages" << "\n";
+
+    for (size_t block_size = myBufferCache::MIN_BLOCK_SIZE; block_size <= myBufferCache::MAX_BLOCK_SIZE; block_size *= 2) {
+        size_t cache_size = CACHE_BYTES / block_size;
+        std::cout << std::setw(12) << block_size << std::setw(10) << cache_size;
+
+        for (bool huge : { false, true }) {
+            myBufferCache::Options options;
+            options.block_size = block_size;
+            options.huge_pages = huge;
+            myBufferCache cache(cache_size, options);
+            for (size_t i = 0; i < cache_size; ++i) {
+                cache.brelse(cache.getblk(static_cast<int>(i)));
+            }
+
+            std::mt19937 rng(42);
+            std::uniform_int_distribution<int> pick(0, static_cast<int>(cache_size) - 1);
+            std::vector<int> blocks(OPS);
+            for (auto& b : blocks) {
+                b = pick(rng);
+            }
+
+            unsigned sum = 0;
+            auto start = Clock::now();
+            for (int block : blocks) {
+                auto* buf = cache.getblk(block, myBufferCache::LockMode::Shared);
+                sum += static_cast<unsigned char>(buf->data[block_size / 2]);
+                cache.brelse(buf);
+            }
+            auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start);
+
+            std::cout << std::setw(11) << std::fixed << std::setprecision(1) << elapsed.count() / OPS
+                << (huge && !cache.huge_pages() ? " ns*" : " ns");
+            g_sink = sum;
+        }
+        std::cout << "\n";
+    }
+    std::cout << "* no explicit huge pages available; transparent huge pages requested instead\n";
+}
+
+// Reads extents of consecutive blocks from a device that takes a fixed time
+// per request, first cold and then cached, one block at a time and as one
+// batch. Cold batches pay for one device read per extent instead of one per
+// block; cached ones should cost about the same, since hits take no lock
+// either way.
+void bench_batch() {
+    const auto READ_LATENCY = std::chrono::microseconds(50);
+    const int EXTENTS = 64;
+    const int HOT_PASSES = 200;
+
+    std::cout << std::setw(8) << "extent" << std::setw(14) << "loop cold"
+        << std::setw(14) << "batch cold" << std::setw(9) << "speedup"
+        << std::setw(14) << "loop hot" << std::setw(14) << "batch hot" << std::setw(9) << "speedup" << "\n";
+
+    for (int extent : { 4, 16, 64 }) {
+        double cold_ms[2] = {};
+        double hot_ns[2] = {};
+
+        for (int batched = 0; batched < 2; ++batched) {
+            myBufferCache::Options options;
+            options.num_shards = 8;
+            options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+            // Room to spare, since blocks do not hash evenly over the shards
+            myBufferCache cache(2 * static_cast<size_t>(EXTENTS) * extent, options);
+
+            std::vector<uint64_t> blocks(extent);
+            std::vector<myBufferCache::Buffer*> buffers(extent);
+            auto read_extent = [&](int e) {
+                for (int i = 0; i < extent; ++i) {
+                    blocks[i] = e * extent + i;
+                }
+                if (batched) {
+                    cache.getblk_many(blocks, buffers, myBufferCache::LockMode::Shared);
+                    cache.brelse_many(buffers);
+                    return;
+                }
+                for (uint64_t block : blocks) {
+                    cache.brelse(cache.getblk(block, myBufferCache::LockMode::Shared));
+                }
+            };
+
+            auto start = Clock::now();
+            for (int e = 0; e < EXTENTS; ++e) {
+                read_extent(e);
+            }
+            cold_ms[batched] = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            start = Clock::now();
+            for (int pass = 0; pass < HOT_PASSES; ++pass) {
+                for (int e = 0; e < EXTENTS; ++e) {
+                    read_extent(e);
+                }
+            }
+            hot_ns[batched] = std::chrono::duration<double, std::nano>(Clock::now() - start).count()
+                / (static_cast<double>(HOT_PASSES) * EXTENTS * extent);
+        }
+
+        std::cout << std::setw(8) << extent << std::fixed << std::setprecision(1)
+            << std::setw(11) << cold_ms[0] << " ms" << std::setw(11) << cold_ms[1] << " ms"
+            << std::setw(8) << cold_ms[0] / cold_ms[1] << "x"
+            << std::setw(11) << hot_ns[0] << " ns" << std::setw(11) << hot_ns[1] << " ns"
+            << std::setw(8) << hot_ns[0] / hot_ns[1] << "x\n";
+    }
+    std::cout << "cold: total for " << EXTENTS << " extents at " << READ_LATENCY.count()
+        << " us per device request; hot: per block\n";
+}
+
+// Device I/O without the shard lock. Threads missing on a single shard only
+// scale because reads are done with the lock released. Batches of scattered
+// blocks only get faster with an I/O engine, which keeps all their reads in
+// flight at once instead of doing them one after the other.
+void bench_io(const std::string& path, bool direct_io) {
+    const auto READ_LATENCY = std::chrono::microseconds(100);
+
+    std::cout << "misses on one shard, " << READ_LATENCY.count() << " us device reads\n";
+    std::cout << std::setw(10) << "threads" << std::setw(14) << "misses/s" << "\n";
+    for (int num_threads : { 1, 2, 4, 8 }) {
+        const int MISSES_PER_THREAD = 500;
+        myBufferCache::Options options;
+        options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+        myBufferCache cache(4096, options);
+
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&cache, t]() {
+                for (int i = 0; i < MISSES_PER_THREAD; ++i) {
+                    cache.brelse(cache.getblk(t * MISSES_PER_THREAD + i, myBufferCache::LockMode::Shared));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << std::setw(10) << num_threads << std::setw(14) << std::fixed << std::setprecision(0)
+            << num_threads * MISSES_PER_THREAD / seconds << "\n";
+    }
+
+    const int WORKING_SET = 16384;
+    const size_t BATCH = 32;
+    const int BATCHES = 200;
+    std::shared_ptr<BlockDevice> device;
+    if (path.empty()) {
+        device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+        std::cout << "\nbatches of " << BATCH << " scattered misses, " << READ_LATENCY.count() << " us device reads\n";
+    }
+    else {
+        device = std::make_shared<FileBlockDevice>(path, myBufferCache::BLOCK_SIZE, direct_io);
+        std::vector<char> block(myBufferCache::BLOCK_SIZE, 1);
+        for (int b = 0; b < WORKING_SET; ++b) {
+            device->write_block(b, block.data());
+        }
+        device->sync();
+        std::cout << "\nbatches of " << BATCH << " scattered misses on " << path
+            << (direct_io ? " (O_DIRECT)" : "") << "\n";
+    }
+
+    std::cout << std::setw(14) << "engine" << std::setw(14) << "us/batch" << "\n";
+    for (bool async_io : { false, true }) {
+        myBufferCache::Options options;
+        options.device = device;
+        options.async_io = async_io;
+        myBufferCache cache(WORKING_SET, options);
+
+        std::mt19937 rng(11);
+        std::vector<uint64_t> blocks(WORKING_SET);
+        for (int b = 0; b < WORKING_SET; ++b) {
+            blocks[b] = b;
+        }
+        std::shuffle(blocks.begin(), blocks.end(), rng);
+
+        std::vector<myBufferCache::Buffer*> buffers(BATCH);
+        auto start = Clock::now();
+        for (int i = 0; i < BATCHES; ++i) {
+            std::span<const uint64_t> batch(blocks.data() + i * BATCH, BATCH);
+            cache.getblk_many(batch, buffers, myBufferCache::LockMode::Shared);
+            cache.brelse_many(buffers);
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start);
+        std::cout << std::setw(14) << cache.io_engine_name() << std::setw(14) << std::setprecision(1)
+            << elapsed.count() / BATCHES << "\n";
+    }
+}
+
+// Checks a block of the stress test: every word the same, stamped with the
+// block, and no older than the version last seen. Bumps the version of a
+// block held for writing.
+bool check_stress_block(myBufferCache::Buffer* buf, int block, bool is_write, size_t num_words, uint32_t& seen) {
+    uint64_t words[2];
+    memcpy(words, buf->data, sizeof(words));
+    uint32_t version = static_cast<uint32_t>(words[0]);
+    bool ok = buf->block_number == static_cast<uint64_t>(block) &&
+        (words[0] == 0 || words[0] >> 32 == static_cast<uint64_t>(block) + 1) &&
+        version >= seen;
+    for (size_t w = 1; ok && w < num_words; ++w) {
+        memcpy(&words[1], buf->data + w * sizeof(uint64_t), sizeof(uint64_t));
+        ok = words[1] == words[0];
+    }
+    seen = version;
+
+    if (is_write) {
+        uint64_t stamp = (static_cast<uint64_t>(block) + 1) << 32 | (version + 1);
+        for (size_t w = 0; w < num_words; ++w) {
+            memcpy(buf->data + w * sizeof(uint64_t), &stamp, sizeof(stamp));
+        }
+        seen = version + 1;
+    }
+    return ok;
+}
+
+const int STRESS_ASYNC_TASKS = 64;
+
+// The stress mix through getblk_async; some writes also go out with
+// bwrite_async before the release
+Task stress_async_task(myBufferCache& cache, std::atomic<size_t>& errors, int working_set, int ops,
+    int seed, size_t num_words) {
+    ZipfGenerator zipf(working_set, 0.9, seed);
+    std::mt19937 rng(seed);
+    std::bernoulli_distribution write(0.1);
+    std::vector<uint32_t> seen(working_set, 0);
+
+    for (int i = 0; i < ops; ++i) {
+        int block = zipf.next();
+        bool is_write = write(rng);
+        auto* buf = co_await cache.getblk_async(block, is_write
+            ? myBufferCache::LockMode::Exclusive : myBufferCache::LockMode::Shared);
+        if (!check_stress_block(buf, block, is_write, num_words, seen[block])) {
+            errors++;
+        }
+        if (is_write && i % 4 == 0) {
+            co_await cache.bwrite_async(buf);
+        }
+        cache.brelse(buf, is_write);
+    }
+}
+
+// Reads blocks [first, first + count) one after the other through getblk_async
+Task read_blocks_async(myBufferCache& cache, int first, int count) {
+    for (int block = first; block < first + count; ++block) {
+        cache.brelse(co_await cache.getblk_async(block, myBufferCache::LockMode::Shared));
+    }
+}
+
+// One thread reading blocks from a slow device: blocking getblk against
+// getblk_async from a growing number of tasks on a single executor. The
+// tasks keep that many misses outstanding through the I/O engine, so
+// throughput grows with them until the engine's queue depth is reached.
+// Hits complete without suspending and should cost about what getblk does.
+void bench_async() {
+    const auto READ_LATENCY = std::chrono::microseconds(100);
+    const int MISSES = 8192;
+    const size_t QUEUE_DEPTH = 256;
+    const int HOT_PASSES = 100;
+
+    auto make_cache = [&]() {
+        myBufferCache::Options options;
+        options.num_shards = 8;
+        options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+        options.async_io = true;
+        options.io_queue_depth = QUEUE_DEPTH;
+        return std::make_unique<myBufferCache>(2 * static_cast<size_t>(MISSES), options);
+    };
+
+    std::cout << "one thread, " << MISSES << " misses, " << READ_LATENCY.count()
+        << " us device reads, queue depth " << QUEUE_DEPTH << "\n";
+    std::cout << std::setw(24) << "" << std::setw(14) << "misses/s" << std::setw(14) << "hit ns" << "\n";
+
+    {
+        auto cache = make_cache();
+        auto start = Clock::now();
+        for (int block = 0; block < MISSES; ++block) {
+            cache->brelse(cache->getblk(block, myBufferCache::LockMode::Shared));
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        for (int pass = 0; pass < HOT_PASSES; ++pass) {
+            for (int block = 0; block < MISSES; ++block) {
+                cache->brelse(cache->getblk(block, myBufferCache::LockMode::Shared));
+            }
+        }
+        double hit_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count()
+            / (static_cast<double>(HOT_PASSES) * MISSES);
+        std::cout << std::setw(24) << "getblk" << std::setw(14) << std::fixed << std::setprecision(0)
+            << MISSES / seconds << std::setw(14) << std::setprecision(1) << hit_ns << "\n";
+    }
+
+    for (int num_tasks : { 1, 16, 256, 4096 }) {
+        auto cache = make_cache();
+        int per_task = MISSES / num_tasks;
+        auto run = [&]() {
+            Executor executor;
+            for (int t = 0; t < num_tasks; ++t) {
+                executor.spawn(read_blocks_async(*cache, t * per_task, per_task));
+            }
+            auto start = Clock::now();
+            executor.run();
+            return Clock::now() - start;
+        };
+
+        double seconds = std::chrono::duration<double>(run()).count();
+        std::chrono::nanoseconds hot{ 0 };
+        for (int pass = 0; pass < HOT_PASSES; ++pass) {
+            hot += run();
+        }
+        double hit_ns = static_cast<double>(hot.count()) / (static_cast<double>(HOT_PASSES) * MISSES);
+
+        std::ostringstream label;
+        label << "getblk_async x" << num_tasks;
+        std::cout << std::setw(24) << label.str() << std::setw(14) << std::setprecision(0)
+            << MISSES / seconds << std::setw(14) << std::setprecision(1) << hit_ns << "\n";
+    }
+}
+
+// Slow device keeping a copy of the given blocks as they were at each sync
+class SyncSnapshotDevice : public SlowBlockDevice {
+public:
+    SyncSnapshotDevice(std::chrono::microseconds write_latency, std::vector<uint64_t> watched)
+        : SlowBlockDevice(std::chrono::microseconds(0), write_latency), m_watched(std::move(watched)),
+        m_synced(m_watched.size(), std::vector<char>(myBufferCache::BLOCK_SIZE)) {}
+
+    void sync() override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_watched.size(); ++i) {
+            MemoryBlockDevice::read_block(m_watched[i], m_synced[i].data());
+        }
+    }
+
+    // Contents of the i-th watched block at the last sync
+    std::vector<char> synced(size_t i) const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_synced[i];
+    }
+
+private:
+    std::vector<uint64_t> m_watched;
+    std::vector<std::vector<char>> m_synced;
+    mutable std::mutex m_mutex;
+};
+
+// bsync while one dirty block is held exclusively by another thread and
+// another is frozen mid-eviction, its write-back in progress. Both must be
+// on the device when bsync syncs it.
+bool bsync_waits_check() {
+    const auto WRITE_LATENCY = std::chrono::milliseconds(100);
+    const uint64_t HELD = 1, EVICTED = 0;
+    auto device = std::make_shared<SyncSnapshotDevice>(WRITE_LATENCY, std::vector<uint64_t>{ HELD, EVICTED });
+    myBufferCache::Options options;
+    options.num_shards = 1;
+    options.device = device;
+    myBufferCache cache(4, options);
+
+    // Both blocks are dirty. EVICTED is the least recently used; HELD is
+    // changed again by its holder while bsync runs.
+    for (uint64_t b : { EVICTED, HELD }) {
+        auto* buf = cache.getblk(b);
+        memset(buf->data, b == EVICTED ? 'E' : 'h', cache.block_size());
+        cache.brelse(buf, true);
+    }
+    for (uint64_t b = 2; b < 4; ++b) {
+        cache.brelse(cache.getblk(b, myBufferCache::LockMode::Shared));
+    }
+
+    std::atomic<bool> holding{ false };
+    std::thread holder([&]() {
+        auto* held = cache.getblk(HELD);
+        holding = true;
+        memset(held->data, 'H', cache.block_size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        cache.brelse(held, true);
+    });
+    while (!holding) {
+        std::this_thread::yield();
+    }
+    // The cache is full; the miss evicts EVICTED, writing it back first
+    std::thread evictor([&]() {
+        cache.brelse(cache.getblk(10, myBufferCache::LockMode::Shared));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    cache.bsync();
+    bool held_ok = device->synced(0) == std::vector<char>(cache.block_size(), 'H');
+    bool evicted_ok = device->synced(1) == std::vector<char>(cache.block_size(), 'E');
+    holder.join();
+    evictor.join();
+
+    std::cout << "\nbsync with a dirty block held exclusively: " << (held_ok ? "synced" : "MISSING")
+        << "; with a dirty block mid-eviction: " << (evicted_ok ? "synced" : "MISSING") << "\n";
+    return held_ok && evicted_ok;
+}
+
+// bsync of a fully cached device with more and more of it dirty, as
+// extents of 8 consecutive blocks at random places. Only dirty buffers are
+// visited and adjacent ones go out as one write, so the time follows the
+// number of extents rather than the cache size. bsync_range over a
+// sixteenth of the blocks then only pays for the dirty blocks in it.
+bool bench_sync() {
+    const int NUM_BLOCKS = 65536;
+    const int EXTENT = 8;
+    const auto WRITE_LATENCY = std::chrono::microseconds(20);
+
+    std::cout << "bsync of " << NUM_BLOCKS << " cached blocks, extents of " << EXTENT << " dirty blocks, "
+        << WRITE_LATENCY.count() << " us per write request\n";
+    std::cout << std::setw(10) << "dirty" << std::setw(12) << "requests" << std::setw(14) << "bsync ms"
+        << std::setw(16) << "range ms" << "\n";
+
+    for (int dirty : { 64, 1024, 8192, 65536 }) {
+        auto device = std::make_shared<SlowBlockDevice>(std::chrono::microseconds(0), WRITE_LATENCY);
+        myBufferCache::Options options;
+        options.num_shards = 8;
+        options.device = device;
+        myBufferCache cache(2 * static_cast<size_t>(NUM_BLOCKS), options);
+        for (int b = 0; b < NUM_BLOCKS; ++b) {
+            cache.brelse(cache.getblk(b, myBufferCache::LockMode::Shared));
+        }
+
+        std::mt19937 rng(5);
+        std::uniform_int_distribution<int> extent(0, NUM_BLOCKS / EXTENT - 1);
+        auto make_dirty = [&]() {
+            for (int e = 0; e < dirty / EXTENT; ++e) {
+                int first = extent(rng) * EXTENT;
+                for (int b = first; b < first + EXTENT; ++b) {
+                    cache.brelse(cache.getblk(b), true);
+                }
+            }
+        };
+
+        make_dirty();
+        size_t dirty_blocks = cache.dirty_count();  // Extents may overlap
+        size_t requests_before = device->write_requests();
+        auto start = Clock::now();
+        cache.bsync();
+        double sync_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        size_t requests = device->write_requests() - requests_before;
+
+        make_dirty();
+        start = Clock::now();
+        cache.bsync_range(0, NUM_BLOCKS / 16 - 1);
+        double range_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::cout << std::setw(10) << dirty_blocks << std::setw(12) << requests
+            << std::setw(14) << std::fixed << std::setprecision(2) << sync_ms
+            << std::setw(16) << range_ms << "\n";
+    }
+
+    return bsync_waits_check();
+}
+
+// Every word of a block of the journal test holds (block + 1) << 32 | version
+void stamp_block(myBufferCache::Buffer* buf, int block, uint32_t version, size_t num_words) {
+    uint64_t word = (static_cast<uint64_t>(block) + 1) << 32 | version;
+    for (size_t w = 0; w < num_words; ++w) {
+        memcpy(buf->data + w * sizeof(word), &word, sizeof(word));
+    }
+}
+
+// Version of a block stamped by stamp_block, 0 if it was never written,
+// or -1 if it is torn or belongs to another block
+long long stamped_version(const char* data, int block, size_t num_words) {
+    uint64_t first;
+    memcpy(&first, data, sizeof(first));
+    for (size_t w = 1; w < num_words; ++w) {
+        uint64_t word;
+        memcpy(&word, data + w * sizeof(word), sizeof(word));
+        if (word != first) return -1;
+    }
+    if (first == 0) return 0;
+    if (first >> 32 != static_cast<uint64_t>(block) + 1) return -1;
+    return static_cast<uint32_t>(first);
+}
+
+// Opens the cache of the journal test on path, journaled to path + ".log"
+std::unique_ptr<myBufferCache> open_journaled(const std::string& path, size_t cache_size, bool journal) {
+    myBufferCache::Options options;
+    options.num_shards = 4;
+    options.device = std::make_shared<FileBlockDevice>(path, myBufferCache::BLOCK_SIZE);
+    options.background_flush = true;
+    if (journal) {
+        options.journal_path = path + ".log";
+        options.journal_checkpoint_blocks = 1024;
+    }
+    return std::make_unique<myBufferCache>(cache_size, options);
+}
+
+void remove_journaled(const std::string& path) {
+    std::remove(path.c_str());
+    std::remove((path + ".log.0").c_str());
+    std::remove((path + ".log.1").c_str());
+}
+
+#ifndef _WIN32
+// One round of the crash test: a child process bwrites new versions of the
+// blocks from several threads and reports each one over a pipe once bwrite
+// has returned, until it is killed at a random moment. A torn transaction
+// is then appended to both logs. Reopening the cache replays the journal;
+// every block must hold the version last reported for it, or the next one
+// if that bwrite was in progress, never a torn image. versions holds the
+// versions recovered by the previous round and is updated.
+bool journal_crash_round(const std::string& path, int num_blocks, std::vector<long long>& versions,
+    std::chrono::milliseconds run_time) {
+    const int NUM_THREADS = 4;
+    const size_t CACHE_SIZE = 256;  // Well under num_blocks, so blocks are evicted and reread
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw std::system_error(errno, std::generic_category(), "pipe");
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        throw std::system_error(errno, std::generic_category(), "fork");
+    }
+    if (child == 0) {
+        close(fds[0]);
+        auto cache = open_journaled(path, CACHE_SIZE, true);
+        const size_t WORDS = cache->block_size() / sizeof(uint64_t);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&cache, t, num_blocks, WORDS, fd = fds[1]]() {
+                // Thread t owns the blocks b with b % NUM_THREADS == t
+                std::mt19937 rng(getpid() + t);
+                std::uniform_int_distribution<int> pick(0, num_blocks / NUM_THREADS - 1);
+                while (true) {
+                    int block = pick(rng) * NUM_THREADS + t;
+                    auto* buf = cache->getblk(block);
+                    long long version = stamped_version(buf->data, block, WORDS);
+                    if (version < 0) _exit(2);
+                    stamp_block(buf, block, static_cast<uint32_t>(version + 1), WORDS);
+                    cache->bwrite(buf);
+                    int32_t ack[2] = { block, static_cast<int32_t>(version + 1) };
+                    if (write(fd, ack, sizeof(ack)) != sizeof(ack)) _exit(3);  // Atomic, under PIPE_BUF
+                    cache->brelse(buf);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    std::vector<long long> acked(versions);
+    size_t acks = 0;
+    std::thread reader([&acked, &acks, fd = fds[0]]() {
+        std::vector<char> pending;
+        char chunk[4096];
+        ssize_t n;
+        while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+            pending.insert(pending.end(), chunk, chunk + n);
+            size_t whole = pending.size() / 8 * 8;
+            for (size_t i = 0; i < whole; i += 8) {
+                int32_t ack[2];
+                memcpy(ack, pending.data() + i, sizeof(ack));
+                acked[ack[0]] = ack[1];
+                acks++;
+            }
+            pending.erase(pending.begin(), pending.begin() + whole);
+        }
+    });
+
+    std::this_thread::sleep_for(run_time);
+    kill(child, SIGKILL);
+    int status;
+    waitpid(child, &status, 0);
+    reader.join();  // EOF once the child is gone
+    close(fds[0]);
+    bool killed = WIFSIGNALED(status);
+
+    // Part of a transaction that was being written when power went out
+    std::mt19937 rng(static_cast<unsigned>(run_time.count()));
+    std::vector<char> garbage(myBufferCache::BLOCK_SIZE * 3 / 2);
+    for (char& c : garbage) {
+        c = static_cast<char>(rng());
+    }
+    for (const char* log : { ".log.0", ".log.1" }) {
+        std::ofstream(path + log, std::ios::binary | std::ios::app).write(garbage.data(), garbage.size());
+    }
+
+    auto cache = open_journaled(path, CACHE_SIZE, true);
+    size_t recovered = cache->recovered_blocks();
+    const size_t WORDS = cache->block_size() / sizeof(uint64_t);
+    size_t bad = 0;
+    for (int b = 0; b < num_blocks; ++b) {
+        auto* buf = cache->getblk(b, myBufferCache::LockMode::Shared);
+        long long version = stamped_version(buf->data, b, WORDS);
+        cache->brelse(buf);
+        if (version < acked[b] || version > acked[b] + 1) {
+            bad++;
+        }
+        versions[b] = version;
+    }
+
+    std::cout << std::setw(10) << run_time.count() << std::setw(12) << acks << std::setw(12) << recovered
+        << std::setw(10) << bad << (killed ? "" : "  (child exited on its own)") << "\n";
+    return killed && bad == 0;
+}
+#endif
+
+// bwrite throughput from several threads, each writing its own blocks to a
+// file: plain bwrite, bwrite followed by an fsync, and journaled bwrite
+// whose commits share log syncs. Then the crash test, on POSIX only.
+bool bench_journal(const std::string& dir) {
+    const int NUM_BLOCKS = 4096;
+    const int WRITES_PER_THREAD = 200;
+    const std::string path = dir + "/journal_bench.img";
+
+    std::cout << "bwrite of " << myBufferCache::BLOCK_SIZE << " B blocks to " << path << "\n";
+    std::cout << std::setw(10) << "threads" << std::setw(14) << "plain/s" << std::setw(14) << "fsync/s"
+        << std::setw(14) << "journal/s" << std::setw(16) << "writes/commit" << "\n";
+    for (int num_threads : { 1, 4, 16 }) {
+        std::cout << std::setw(10) << num_threads;
+        for (int mode = 0; mode < 3; ++mode) {
+            remove_journaled(path);
+            auto cache = open_journaled(path, NUM_BLOCKS, mode == 2);
+            BlockDevice& device = cache->device();
+            const size_t WORDS = cache->block_size() / sizeof(uint64_t);
+
+            auto start = Clock::now();
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&cache, &device, t, num_threads, mode, WORDS]() {
+                    for (int i = 0; i < WRITES_PER_THREAD; ++i) {
+                        int block = (i * num_threads + t) % NUM_BLOCKS;
+                        auto* buf = cache->getblk(block);
+                        stamp_block(buf, block, i + 1, WORDS);
+                        cache->bwrite(buf);
+                        if (mode == 1) {
+                            device.sync();
+                        }
+                        cache->brelse(buf);
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            std::cout << std::setw(14) << std::fixed << std::setprecision(0)
+                << num_threads * WRITES_PER_THREAD / seconds;
+            if (mode == 2) {
+                auto stats = cache->stats();
+                std::cout << std::setw(16) << std::setprecision(1)
+                    << static_cast<double>(stats.journal_records) / stats.journal_commits;
+            }
+        }
+        std::cout << "\n";
+    }
+
+    // Options are all checked before the journal is opened and replayed
+    remove_journaled(path);
+    bool rejected = false;
+    try {
+        myBufferCache::Options options;
+        options.device = std::make_shared<FileBlockDevice>(path, myBufferCache::BLOCK_SIZE);
+        options.journal_path = path + ".log";
+        options.readahead_min_window = 0;
+        myBufferCache cache(NUM_BLOCKS, options);
+    }
+    catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    bool untouched = rejected && !std::filesystem::exists(path + ".log.0") && !std::filesystem::exists(path + ".log.1");
+    std::cout << "\ninvalid options: " << (untouched ? "rejected before the journal was opened" : "JOURNAL TOUCHED") << "\n";
+
+#ifdef _WIN32
+    remove_journaled(path);
+    std::cout << "\ncrash test needs fork, skipped\n";
+    return untouched;
+#else
+    std::cout << "\ncrash test: child killed after run ms, torn transaction appended, journal replayed\n";
+    std::cout << std::setw(10) << "run ms" << std::setw(12) << "acked" << std::setw(12) << "replayed"
+        << std::setw(10) << "bad" << "\n";
+    remove_journaled(path);
+    std::vector<long long> versions(NUM_BLOCKS, 0);
+    bool ok = untouched;
+    for (int run_ms : { 50, 200, 500, 1000 }) {
+        ok = journal_crash_round(path, NUM_BLOCKS, versions, std::chrono::milliseconds(run_ms)) && ok;
+    }
+    remove_journaled(path);
+    return ok;
+#endif
+}
+
+// Text-like records, "key=word value=NN", from a small vocabulary: they
+// compress about 3x, as the blocks we store do
+void fill_text_block(char* data, size_t size, int block) {
+    static const char* const WORDS[] = {
+        "account", "balance", "created", "deleted", "expires", "flags", "group", "handle",
+        "inode", "journal", "kind", "length", "mode", "owner", "parent", "quota"
+    };
+    std::mt19937 rng(static_cast<unsigned>(block) + 1);
+    size_t pos = 0;
+    while (pos < size) {
+        char record[48];
+        int n = snprintf(record, sizeof(record), "key=%s value=%u\n", WORDS[rng() % 16], static_cast<unsigned>(rng() % 100));
+        size_t len = std::min(static_cast<size_t>(n), size - pos);
+        memcpy(data + pos, record, len);
+        pos += len;
+    }
+}
+
+// Zipf reads over a working set eight times the cache, from a device
+// taking 50 us per read, with compressed tiers of growing size. Misses the
+// tier serves should take microseconds, not a device read. One thread, so
+// the latencies are not those of threads waiting for a core.
+void bench_tier() {
+    const int NUM_THREADS = 1;
+    const size_t CACHE_SIZE = 2048;
+    const int WORKING_SET = 16384;
+    const int OPS_PER_THREAD = 50000;
+    const auto READ_LATENCY = std::chrono::microseconds(50);
+    const size_t BLOCK = myBufferCache::BLOCK_SIZE;
+
+    std::vector<char> block(BLOCK);
+    std::vector<char> packed(BLOCK);
+    std::vector<char> unpacked(BLOCK);
+    const int CODEC_ROUNDS = 20000;
+    fill_text_block(block.data(), BLOCK, 0);
+    size_t packed_size = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < CODEC_ROUNDS; ++i) {
+        packed_size = lz_compress(block.data(), BLOCK, packed.data(), BLOCK);
+    }
+    double compress_s = std::chrono::duration<double>(Clock::now() - start).count();
+    start = Clock::now();
+    bool intact = true;
+    for (int i = 0; i < CODEC_ROUNDS; ++i) {
+        intact = lz_decompress(packed.data(), packed_size, unpacked.data(), BLOCK) && intact;
+    }
+    double decompress_s = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!intact || unpacked != block) {
+        std::cout << "codec round trip failed\n";
+    }
+    std::cout << "codec on " << BLOCK << " B text blocks: ratio " << std::fixed << std::setprecision(2)
+        << static_cast<double>(BLOCK) / packed_size << ", compress " << std::setprecision(0)
+        << CODEC_ROUNDS * BLOCK / compress_s / 1e6 << " MB/s, decompress "
+        << CODEC_ROUNDS * BLOCK / decompress_s / 1e6 << " MB/s\n\n";
+
+    std::cout << NUM_THREADS << " thread, zipf 0.8 over " << WORKING_SET << " blocks, cache " << CACHE_SIZE
+        << ", " << READ_LATENCY.count() << " us device reads\n";
+    std::cout << std::setw(10) << "tier MB" << std::setw(10) << "hit" << std::setw(10) << "tier hit"
+        << std::setw(8) << "ratio" << std::setw(10) << "reads" << std::setw(12) << "ops/s"
+        << std::setw(14) << "miss p50 us" << std::setw(14) << "tier p50 us" << "\n";
+    for (size_t tier_mb : { 0, 4, 8, 16 }) {
+        auto device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+        for (int b = 0; b < WORKING_SET; ++b) {
+            fill_text_block(block.data(), BLOCK, b);
+            device->MemoryBlockDevice::write_block(b, block.data());
+        }
+        myBufferCache::Options options;
+        options.device = device;
+        options.num_shards = 4;
+        options.compressed_tier_bytes = tier_mb << 20;
+        myBufferCache cache(CACHE_SIZE, options);
+
+        start = Clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back([&cache, t]() {
+                ZipfGenerator zipf(WORKING_SET, 0.8, t + 1);
+                for (int i = 0; i < OPS_PER_THREAD; ++i) {
+                    auto* buf = cache.getblk(zipf.next(), myBufferCache::LockMode::Shared);
+                    g_sink = static_cast<unsigned char>(buf->data[0]);
+                    cache.brelse(buf);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        auto stats = cache.stats();
+        std::cout << std::setw(10) << tier_mb << std::fixed << std::setprecision(3)
+            << std::setw(10) << stats.hit_ratio() << std::setw(10) << stats.tier_hit_ratio()
+            << std::setw(8) << std::setprecision(2) << stats.tier_compression_ratio
+            << std::setw(10) << stats.disk_reads << std::setw(12) << std::setprecision(0)
+            << NUM_THREADS * OPS_PER_THREAD / seconds << std::setprecision(1)
+            << std::setw(14) << stats.miss_latency.percentile(0.5) / 1000
+            << std::setw(14) << stats.tier_latency.percentile(0.5) / 1000 << "\n";
+    }
+}
+
+// Zipf reads from a device taking 100 us per read, into a cache restarted
+// cold and restarted with Options::warm_path, the warm set having been
+// saved by a cache that ran the same workload before. Prints the hit ratio
+// of each 100 ms window, how long each restart takes to reach 90% of its
+// final hit ratio and when the warm loader finished.
+void bench_warm() {
+    const size_t CACHE_SIZE = 4096;
+    const int WORKING_SET = 32768;
+    const int PRIME_OPS = 200000;
+    const auto READ_LATENCY = std::chrono::microseconds(100);
+    const auto WINDOW = std::chrono::milliseconds(100);
+    const int NUM_WINDOWS = 20;
+    const std::string path = (std::filesystem::temp_directory_path() / "warm_bench.set").string();
+
+    auto device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+    auto open_cache = [&](bool warm) {
+        myBufferCache::Options options;
+        options.device = device;
+        options.num_shards = 4;
+        options.async_io = true;
+        if (warm) {
+            options.warm_path = path;
+        }
+        return std::make_unique<myBufferCache>(CACHE_SIZE, options);
+    };
+
+    // The run before the restart, saving its warm set on the way out
+    std::remove(path.c_str());
+    {
+        auto cache = open_cache(true);
+        ZipfGenerator zipf(WORKING_SET, 0.9, 1);
+        for (int i = 0; i < PRIME_OPS; ++i) {
+            cache->brelse(cache->getblk(zipf.next(), myBufferCache::LockMode::Shared));
+        }
+    }
+
+    std::vector<double> ratios[2];
+    double warm_ms[2] = { 0, 0 };
+    double loaded_ms = 0;
+    size_t loaded = 0;
+    for (int warm = 0; warm < 2; ++warm) {
+        auto start = Clock::now();
+        auto cache = open_cache(warm == 1);
+        ZipfGenerator zipf(WORKING_SET, 0.9, 2);
+        bool loading = warm == 1;
+        for (int w = 0; w < NUM_WINDOWS; ++w) {
+            size_t hits = cache->hits();
+            size_t misses = cache->misses();
+            auto end = Clock::now() + WINDOW;
+            while (Clock::now() < end) {
+                auto* buf = cache->getblk(zipf.next(), myBufferCache::LockMode::Shared);
+                g_sink = static_cast<unsigned char>(buf->data[0]);
+                cache->brelse(buf);
+                if (loading && !cache->warming()) {
+                    loading = false;
+                    loaded_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                }
+            }
+            hits = cache->hits() - hits;
+            misses = cache->misses() - misses;
+            ratios[warm].push_back(hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0);
+        }
+        if (warm == 1) {
+            loaded = cache->stats().warm_loaded;
+        }
+
+        // 90% of the mean over the last quarter, taken as the steady state
+        double steady = 0;
+        for (int w = NUM_WINDOWS * 3 / 4; w < NUM_WINDOWS; ++w) {
+            steady += ratios[warm][w];
+        }
+        steady /= NUM_WINDOWS - NUM_WINDOWS * 3 / 4;
+        int reached = 0;
+        while (reached < NUM_WINDOWS - 1 && ratios[warm][reached] < 0.9 * steady) {
+            ++reached;
+        }
+        warm_ms[warm] = static_cast<double>((reached + 1) * WINDOW.count());
+    }
+    std::remove(path.c_str());
+
+    std::cout << "zipf 0.9 over " << WORKING_SET << " blocks, cache " << CACHE_SIZE << ", "
+        << READ_LATENCY.count() << " us device reads, hit ratio per " << WINDOW.count() << " ms\n";
+    std::cout << std::setw(10) << "ms" << std::setw(10) << "cold" << std::setw(10) << "warm" << "\n";
+    for (int w = 0; w < NUM_WINDOWS; ++w) {
+        std::cout << std::setw(10) << (w + 1) * WINDOW.count() << std::fixed << std::setprecision(3)
+            << std::setw(10) << ratios[0][w] << std::setw(10) << ratios[1][w] << "\n";
+    }
+    std::cout << std::setprecision(0) << "time to 90% of steady hit ratio: cold " << warm_ms[0]
+        << " ms, warm " << warm_ms[1] << " ms\n";
+    std::cout << "warm loader: " << loaded << " blocks, done after ";
+    if (loaded_ms > 0) {
+        std::cout << loaded_ms << " ms\n";
+    }
+    else {
+        std::cout << "more than " << NUM_WINDOWS * WINDOW.count() << " ms\n";
+    }
+}
+
+// Two threads of zipf reads from a device taking 20 us per read while the
+// cache is grown from 4096 blocks to 16384, shrunk to 2048 and grown to
+// 8192, with how long each resize took. Shrinking keeps the hottest
+// blocks, so the hit ratio should drop straight to that of the smaller
+// size rather than start over. Then the same load on a cache whose
+// Options::memory_budget halves and recovers, sampled every 50 ms.
+void bench_resize() {
+    const int NUM_THREADS = 2;
+    const int WORKING_SET = 32768;
+    const auto WINDOW = std::chrono::milliseconds(100);
+    const auto READ_LATENCY = std::chrono::microseconds(20);
+
+    auto run_load = [](myBufferCache& cache, std::atomic<bool>& stop, int seed) {
+        ZipfGenerator zipf(WORKING_SET, 0.9, seed);
+        while (!stop) {
+            auto* buf = cache.getblk(zipf.next(), myBufferCache::LockMode::Shared);
+            g_sink = static_cast<unsigned char>(buf->data[0]);
+            cache.brelse(buf);
+        }
+    };
+    auto window_ratio = [](myBufferCache& cache, size_t& hits, size_t& misses) {
+        size_t h = cache.hits() - hits;
+        size_t m = cache.misses() - misses;
+        hits += h;
+        misses += m;
+        return h + m ? static_cast<double>(h) / (h + m) : 0.0;
+    };
+
+    {
+        myBufferCache::Options options;
+        options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+        options.num_shards = 8;
+        options.max_cache_size = 16384;
+        myBufferCache cache(4096, options);
+
+        std::atomic<bool> stop{ false };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < NUM_THREADS; ++t) {
+            threads.emplace_back(run_load, std::ref(cache), std::ref(stop), t + 1);
+        }
+
+        std::cout << NUM_THREADS << " threads, zipf 0.9 over " << WORKING_SET << " blocks, "
+            << READ_LATENCY.count() << " us device reads\n";
+        std::cout << std::setw(8) << "ms" << std::setw(10) << "blocks" << std::setw(10) << "hit"
+            << std::setw(14) << "resize ms" << "\n";
+        const std::pair<int, size_t> RESIZES[] = { { 10, 16384 }, { 30, 2048 }, { 50, 8192 } };
+        size_t hits = 0;
+        size_t misses = 0;
+        for (int w = 0; w < 70; ++w) {
+            double resize_ms = -1;
+            for (const auto& [window, size] : RESIZES) {
+                if (w == window) {
+                    auto start = Clock::now();
+                    cache.resize(size);
+                    resize_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                }
+            }
+            std::this_thread::sleep_for(WINDOW);
+            double ratio = window_ratio(cache, hits, misses);
+            if (w % 5 == 4 || resize_ms >= 0) {
+                std::cout << std::setw(8) << (w + 1) * WINDOW.count() << std::setw(10) << cache.capacity()
+                    << std::fixed << std::setprecision(3) << std::setw(10) << ratio;
+                if (resize_ms >= 0) {
+                    std::cout << std::setprecision(1) << std::setw(14) << resize_ms;
+                }
+                std::cout << "\n";
+            }
+        }
+        stop = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // The budget stands in for a pressure signal: 64 MB, 16 MB, 64 MB
+    std::atomic<size_t> budget{ 64u << 20 };
+    myBufferCache::Options options;
+    options.device = std::make_shared<SlowBlockDevice>(READ_LATENCY);
+    options.num_shards = 8;
+    options.max_cache_size = 16384;
+    options.memory_budget = [&budget](size_t) { return budget.load(); };
+    options.memory_poll_interval = std::chrono::milliseconds(50);
+    myBufferCache cache(4096, options);
+
+    std::atomic<bool> stop{ false };
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back(run_load, std::ref(cache), std::ref(stop), t + 1);
+    }
+    std::cout << "\nmemory budget, polled every " << options.memory_poll_interval.count() << " ms\n";
+    std::cout << std::setw(8) << "ms" << std::setw(12) << "budget MB" << std::setw(10) << "blocks"
+        << std::setw(10) << "hit" << "\n";
+    size_t hits = 0;
+    size_t misses = 0;
+    for (int w = 0; w < 30; ++w) {
+        if (w == 10) budget = 16u << 20;
+        if (w == 20) budget = 64u << 20;
+        std::this_thread::sleep_for(WINDOW);
+        double ratio = window_ratio(cache, hits, misses);
+        if (w % 2 == 1) {
+            std::cout << std::setw(8) << (w + 1) * WINDOW.count() << std::setw(12) << (budget >> 20)
+                << std::setw(10) << cache.capacity() << std::fixed << std::setprecision(3)
+                << std::setw(10) << ratio << "\n";
+        }
+    }
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// Every 8-byte word of a block holds (block + 1) << 32 | version. Writers
+// bump the version under an exclusive lock; readers check under a shared
+// lock that the block is not torn, belongs to the block they asked for and
+// never goes back in time; some reads fetch several blocks at once with
+// getblk_many. The cache is small enough that most accesses race with
+// evictions, write-backs and the flusher. The event trace is enabled and
+// read back while it is being written, and one thread runs the same mix
+// as coroutines through getblk_async. With async_io, read-ahead and
+// write-backs also go through an I/O engine; with tier, evicted blocks
+// come back through the compressed tier. Another thread keeps resizing the
+// cache.
+bool stress_policy(myBufferCache::Policy policy, bool async_io, bool tier) {
+    const int NUM_THREADS = 8;
+    const int WORKING_SET = 512;
+    const size_t CACHE_SIZE = 96;
+    const int OPS_PER_THREAD = 50000;
+    myBufferCache::Options options;
+    options.num_shards = 4;
+    options.max_cache_size = 2 * CACHE_SIZE;
+    options.policy = policy;
+    options.background_flush = true;
+    options.flush_interval = std::chrono::milliseconds(1);
+    options.trace = true;
+    options.async_io = async_io;
+    options.readahead = async_io;
+    if (tier) {
+        options.compressed_tier_bytes = 64 * myBufferCache::BLOCK_SIZE;
+    }
+    myBufferCache cache(CACHE_SIZE, options);
+    const size_t WORDS = cache.block_size() / sizeof(uint64_t);
+
+    std::atomic<size_t> errors{ 0 };
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&cache, &errors, t, WORDS]() {
+            ZipfGenerator zipf(WORKING_SET, 0.9, t + 1);
+            std::mt19937 rng(t + 1);
+            std::bernoulli_distribution write(0.1);
+            std::vector<uint32_t> seen(WORKING_SET, 0);
+
+            std::vector<uint64_t> extent(4);
+            std::vector<myBufferCache::Buffer*> extent_buffers(4);
+
+            for (int i = 0; i < OPS_PER_THREAD; ++i) {
+                int block = zipf.next();
+
+                // Every so often read a few consecutive blocks as one batch
+                if (i % 16 == 0) {
+                    for (size_t b = 0; b < extent.size(); ++b) {
+                        extent[b] = static_cast<uint64_t>((block + static_cast<int>(b)) % WORKING_SET);
+                    }
+                    cache.getblk_many(extent, extent_buffers, myBufferCache::LockMode::Shared);
+                    for (size_t b = 0; b < extent.size(); ++b) {
+                        uint64_t word;
+                        memcpy(&word, extent_buffers[b]->data, sizeof(word));
+                        if (extent_buffers[b]->block_number != extent[b] ||
+                            (word != 0 && word >> 32 != extent[b] + 1)) {
+                            errors++;
+                        }
+                    }
+                    cache.brelse_many(extent_buffers);
+                }
+
+                bool is_write = write(rng);
+                auto* buf = cache.getblk(block, is_write
+                    ? myBufferCache::LockMode::Exclusive : myBufferCache::LockMode::Shared);
+                if (!check_stress_block(buf, block, is_write, WORDS, seen[block])) {
+                    errors++;
+                }
+                cache.brelse(buf, is_write);
+            }
+        });
+    }
+
+    // One more thread runs the same mix as coroutines on an executor
+    std::thread async_thread([&cache, &errors, WORDS]() {
+        Executor executor;
+        for (int t = 0; t < STRESS_ASYNC_TASKS; ++t) {
+            executor.spawn(stress_async_task(cache, errors, WORKING_SET, OPS_PER_THREAD / STRESS_ASYNC_TASKS,
+                NUM_THREADS + t + 1, WORDS));
+        }
+        executor.run();
+    });
+    threads.push_back(std::move(async_thread));
+    // Read the event trace while it is being written
+    std::atomic<bool> done{ false };
+    // Read-ahead may run past the end of the working set
+    const uint64_t max_block = WORKING_SET + options.readahead_max_window;
+    std::thread trace_reader([&cache, &errors, &done, max_block]() {
+        while (!done) {
+            for (const auto& event : cache.trace()->snapshot()) {
+                if (event.type > TraceEventType::Write || event.block_number >= max_block) {
+                    errors++;
+                }
+            }
+        }
+    });
+
+    // Shrink and grow the cache under the readers and writers
+    std::thread resizer([&cache, &errors, &done]() {
+        const size_t SIZES[] = { 160, 64, 192, CACHE_SIZE };
+        for (size_t i = 0; !done; ++i) {
+            try {
+                cache.resize(SIZES[i % 4]);
+            }
+            catch (const std::exception&) {
+                errors++;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    done = true;
+    trace_reader.join();
+    resizer.join();
+
+    std::cout << std::setw(8) << cache.policy_name() << std::setw(14) << cache.io_engine_name()
+        << std::setw(6) << (tier ? "on" : "off") << std::setw(12) << std::fixed << std::setprecision(3)
+        << static_cast<double>(cache.hits()) / (cache.hits() + cache.misses())
+        << std::setw(12) << cache.disk_writes() << std::setw(10) << errors.load() << "\n";
+    return errors == 0;
+}
+
+// Lookup cost of the flat BlockIndex against a node-based hash map holding
+// the same keys, spread over four devices, in random order. Then one cache
+// in front of four devices: the same block numbers are written on each,
+// and read back through a second cache must come from the right device.
+bool bench_index() {
+    const size_t LOOKUPS = 4000000;
+    const uint32_t NUM_DEVICES = 4;
+
+    std::cout << "block index lookups, ns per lookup\n";
+    std::cout << std::setw(10) << "entries" << std::setw(14) << "index hit" << std::setw(14) << "map hit"
+        << std::setw(14) << "index miss" << std::setw(14) << "map miss" << "\n";
+
+    for (size_t entries = 4096; entries <= (1u << 20); entries *= 16) {
+        BlockIndex index(entries);
+        std::unordered_map<uint64_t, uint32_t> map;
+        std::vector<uint64_t> keys(entries);
+        for (size_t i = 0; i < entries; ++i) {
+            keys[i] = block_key(static_cast<uint32_t>(i % NUM_DEVICES), i / NUM_DEVICES * 3);
+            index.insert(keys[i], static_cast<uint32_t>(i));
+            map[keys[i]] = static_cast<uint32_t>(i);
+        }
+
+        std::mt19937_64 rng(5);
+        std::vector<uint64_t> hits(LOOKUPS);
+        std::vector<uint64_t> misses(LOOKUPS);
+        for (size_t i = 0; i < LOOKUPS; ++i) {
+            hits[i] = keys[rng() % entries];
+            misses[i] = hits[i] + 1;  // Never a multiple of 3 on its device
+        }
+
+        auto time_index = [&](const std::vector<uint64_t>& lookups) {
+            auto start = Clock::now();
+            unsigned sum = 0;
+            for (uint64_t key : lookups) {
+                sum += index.find(key);
+            }
+            g_sink = sum;
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / LOOKUPS;
+        };
+        auto time_map = [&](const std::vector<uint64_t>& lookups) {
+            auto start = Clock::now();
+            unsigned sum = 0;
+            for (uint64_t key : lookups) {
+                auto it = map.find(key);
+                sum += it != map.end() ? it->second : BlockIndex::NOT_FOUND;
+            }
+            g_sink = sum;
+            return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / LOOKUPS;
+        };
+
+        std::cout << std::setw(10) << entries << std::fixed << std::setprecision(1)
+            << std::setw(14) << time_index(hits) << std::setw(14) << time_map(hits)
+            << std::setw(14) << time_index(misses) << std::setw(14) << time_map(misses) << "\n";
+    }
+
+    const int BLOCKS = 1024;
+    std::vector<std::shared_ptr<MemoryBlockDevice>> devices;
+    myBufferCache::Options options;
+    for (uint32_t d = 0; d < NUM_DEVICES; ++d) {
+        devices.push_back(std::make_shared<MemoryBlockDevice>());
+        if (d == 0) {
+            options.device = devices[d];
+        }
+        else {
+            options.devices.push_back(devices[d]);
+        }
+    }
+    options.num_shards = 4;
+
+    size_t errors = 0;
+    {
+        myBufferCache cache(256, options);
+        for (uint32_t d = 0; d < NUM_DEVICES; ++d) {
+            for (int b = 0; b < BLOCKS; ++b) {
+                auto* buf = cache.getblk(block_key(d, b));
+                memset(buf->data, 0, cache.block_size());
+                buf->data[0] = static_cast<char>(d);
+                memcpy(buf->data + 1, &b, sizeof(b));
+                cache.brelse(buf, true);
+            }
+        }
+    }
+    {
+        myBufferCache cache(256, options);
+        for (int b = 0; b < BLOCKS; ++b) {
+            for (uint32_t d = 0; d < NUM_DEVICES; ++d) {
+                auto* buf = cache.getblk(block_key(d, b), myBufferCache::LockMode::Shared);
+                int stamped;
+                memcpy(&stamped, buf->data + 1, sizeof(stamped));
+                if (buf->data[0] != static_cast<char>(d) || stamped != b) {
+                    errors++;
+                }
+                cache.brelse(buf);
+            }
+        }
+    }
+    // Each block was read by both caches and written once
+    for (const auto& device : devices) {
+        if (device->writes() != BLOCKS || device->reads() != 2 * BLOCKS) {
+            errors++;
+        }
+    }
+    std::cout << NUM_DEVICES << " devices behind one cache, " << BLOCKS << " blocks each: "
+        << errors << " errors\n";
+    return errors == 0;
+}
+
+bool bench_stress() {
+    std::cout << std::setw(8) << "policy" << std::setw(14) << "io" << std::setw(6) << "tier" << std::setw(12) << "hit ratio"
+        << std::setw(12) << "writes" << std::setw(10) << "errors" << "\n";
+
+    bool ok = true;
+    ok = stress_policy(myBufferCache::Policy::LRU, false, false) && ok;
+    ok = stress_policy(myBufferCache::Policy::CLOCK, true, true) && ok;
+    ok = stress_policy(myBufferCache::Policy::TwoQ, false, true) && ok;
+    ok = stress_policy(myBufferCache::Policy::ARC, true, false) && ok;
+    return ok;
+}
+
+struct SweepConfig {
+    std::string workload = "zipf";
+    std::vector<size_t> sizes = { 256, 1024, 4096, 16384 };
+    std::vector<int> threads = { 1, 2, 4, 8 };
+    size_t ops = 200000;
+    int blocks = 65536;
+    double writes = 0.0;
+    std::string policy = "lru";
+    size_t shards = 16;
+    std::chrono::microseconds read_latency{ 0 };
+    std::chrono::microseconds write_latency{ 0 };
+    bool warmup = false;
+    bool csv = false;
+};
+
+template <typename T>
+std::vector<T> parse_list(const std::string& text) {
+    std::vector<T> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(static_cast<T>(std::stoll(item)));
+    }
+    return values;
+}
+
+myBufferCache::Policy parse_policy(const std::string& name) {
+    if (name == "lru") return myBufferCache::Policy::LRU;
+    if (name == "clock") return myBufferCache::Policy::CLOCK;
+    if (name == "2q") return myBufferCache::Policy::TwoQ;
+    if (name == "arc") return myBufferCache::Policy::ARC;
+    throw std::invalid_argument("Unknown policy: " + name);
+}
+
+SweepConfig parse_sweep(int argc, char* argv[]) {
+    SweepConfig config;
+    if (argc > 0) {
+        config.workload = argv[0];
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument(arg + " needs a value");
+            return argv[++i];
+        };
+
+        if (arg == "--sizes") config.sizes = parse_list<size_t>(value());
+        else if (arg == "--threads") config.threads = parse_list<int>(value());
+        else if (arg == "--ops") config.ops = std::stoull(value());
+        else if (arg == "--blocks") config.blocks = std::stoi(value());
+        else if (arg == "--writes") config.writes = std::stod(value());
+        else if (arg == "--policy") config.policy = value();
+        else if (arg == "--shards") config.shards = std::stoull(value());
+        else if (arg == "--read-us") config.read_latency = std::chrono::microseconds(std::stoll(value()));
+        else if (arg == "--write-us") config.write_latency = std::chrono::microseconds(std::stoll(value()));
+        else if (arg == "--warmup") config.warmup = true;
+        else if (arg == "--csv") config.csv = true;
+        else throw std::invalid_argument("Unknown option: " + arg);
+    }
+    return config;
+}
+
+// One access stream per thread. Synthetic workloads give every thread its
+// own seed; a recorded trace is dealt out round-robin so that the threads
+// together replay it in roughly its original order.
+std::vector<std::vector<Access>> make_thread_traces(const SweepConfig& config, int num_threads,
+    const std::vector<Access>& recorded) {
+    std::vector<std::vector<Access>> traces(num_threads);
+    const std::string& w = config.workload;
+
+    for (int t = 0; t < num_threads; ++t) {
+        uint64_t seed = static_cast<uint64_t>(t) + 1;
+        if (w == "uniform") {
+            traces[t] = make_uniform_trace(config.blocks, config.ops, config.writes, seed);
+        }
+        else if (w == "zipf" || w.rfind("zipf:", 0) == 0) {
+            double theta = w.size() > 5 ? std::stod(w.substr(5)) : 0.99;
+            traces[t] = make_zipf_trace(config.blocks, theta, config.ops, config.writes, seed);
+        }
+        else if (w == "scan") {
+            // Each thread starts its passes at a different point
+            traces[t] = make_scan_trace(config.blocks, config.ops);
+            int shift = static_cast<int>(static_cast<long long>(config.blocks) * t / num_threads);
+            std::bernoulli_distribution is_write(config.writes);
+            std::mt19937_64 rng(seed);
+            for (auto& access : traces[t]) {
+                access.block_number = (access.block_number + shift) % config.blocks;
+                access.write = is_write(rng);
+            }
+        }
+        else if (w.rfind("trace:", 0) == 0) {
+            for (size_t i = t; i < recorded.size(); i += num_threads) {
+                traces[t].push_back(recorded[i]);
+            }
+        }
+        else {
+            throw std::invalid_argument("Unknown workload: " + w);
+        }
+    }
+    return traces;
+}
+
+struct SweepResult {
+    double ops_per_second;
+    double hit_ratio;
+    LatencyHistogram::Snapshot latency;
+};
+
+SweepResult run_sweep_point(const SweepConfig& config, size_t cache_size, int num_threads,
+    const std::vector<Access>& recorded) {
+    auto traces = make_thread_traces(config, num_threads, recorded);
+
+    myBufferCache::Options options;
+    options.num_shards = std::min(config.shards, cache_size);
+    options.policy = parse_policy(config.policy);
+    if (config.read_latency.count() > 0 || config.write_latency.count() > 0) {
+        options.device = std::make_shared<SlowBlockDevice>(config.read_latency, config.write_latency);
+    }
+    myBufferCache cache(cache_size, options);
+
+    auto replay = [&cache](const std::vector<Access>& trace, LatencyHistogram* latency) {
+        for (const auto& access : trace) {
+            auto start = Clock::now();
+            auto* buf = cache.getblk(access.block_number,
+                access.write ? myBufferCache::LockMode::Exclusive : myBufferCache::LockMode::Shared);
+            if (access.write) {
+                buf->data[0]++;
+            }
+            cache.brelse(buf, access.write);
+            if (latency) {
+                latency->record(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+            }
+        }
+    };
+
+    if (config.warmup) {
+        for (const auto& trace : traces) {
+            replay(trace, nullptr);
+        }
+    }
+    auto before = cache.stats();
+
+    std::vector<LatencyHistogram> latencies(num_threads);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() { replay(traces[t], &latencies[t]); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    auto after = cache.stats();
+
+    SweepResult result;
+    size_t total_ops = 0;
+    for (const auto& trace : traces) {
+        total_ops += trace.size();
+    }
+    result.ops_per_second = total_ops / elapsed.count();
+    size_t hits = after.hits - before.hits;
+    size_t misses = after.misses - before.misses;
+    result.hit_ratio = hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0;
+    for (const auto& latency : latencies) {
+        latency.add_to(result.latency);
+    }
+    return result;
+}
+
+// Latency is measured around every getblk/brelse pair in the driver, so it
+// includes about one clock read (~20 ns) of overhead.
+int bench_sweep(int argc, char* argv[]) {
+    SweepConfig config;
+    std::vector<Access> recorded;
+    try {
+        config = parse_sweep(argc, argv);
+        parse_policy(config.policy);
+        if (config.workload.rfind("trace:", 0) == 0) {
+            recorded = load_trace(config.workload.substr(6));
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (config.csv) {
+        std::cout << "workload,cache_size,threads,mops,hit_ratio,p50_us,p99_us,p999_us\n";
+    }
+    else {
+        std::cout << "workload " << config.workload << ", policy " << config.policy << "\n";
+        std::cout << std::setw(12) << "cache_size" << std::setw(9) << "threads" << std::setw(10) << "Mops/s"
+            << std::setw(11) << "hit ratio" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+            << std::setw(10) << "p999 us" << "\n";
+    }
+
+    for (size_t cache_size : config.sizes) {
+        for (int threads : config.threads) {
+            SweepResult r = run_sweep_point(config, cache_size, threads, recorded);
+            double p50 = r.latency.percentile(0.50) / 1000;
+            double p99 = r.latency.percentile(0.99) / 1000;
+            double p999 = r.latency.percentile(0.999) / 1000;
+
+            if (config.csv) {
+                std::cout << config.workload << "," << cache_size << "," << threads << ","
+                    << r.ops_per_second / 1e6 << "," << r.hit_ratio << ","
+                    << p50 << "," << p99 << "," << p999 << "\n";
+            }
+            else {
+                std::cout << std::setw(12) << cache_size << std::setw(9) << threads
+                    << std::fixed << std::setprecision(2) << std::setw(10) << r.ops_per_second / 1e6
+                    << std::setprecision(3) << std::setw(11) << r.hit_ratio
+                    << std::setprecision(2) << std::setw(10) << p50 << std::setw(10) << p99
+                    << std::setw(10) << p999 << "\n";
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string scenario = argc > 1 ? argv[1] : "lru";
+    size_t max_cache_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : (1u << 20);
+
+    if (scenario == "lru") {
+        bench_lru_hit_latency(max_cache_size);
+    }
+    else if (scenario == "shards") {
+        bench_shard_scaling(argc > 2 ? max_cache_size : 65536);
+    }
+    else if (scenario == "readahead") {
+        bench_readahead();
+    }
+    else if (scenario == "waits") {
+        bench_waits();
+    }
+    else if (scenario == "policies") {
+        bench_policies();
+    }
+    else if (scenario == "flusher") {
+        bench_flusher();
+    }
+    else if (scenario == "sweep") {
+        return bench_sweep(argc - 2, argv + 2);
+    }
+    else if (scenario == "stats") {
+        bench_stats();
+    }
+    else if (scenario == "layout") {
+        bench_layout();
+    }
+    else if (scenario == "batch") {
+        bench_batch();
+    }
+    else if (scenario == "index") {
+        return bench_index() ? 0 : 1;
+    }
+    else if (scenario == "stress") {
+        return bench_stress() ? 0 : 1;
+    }
+    else if (scenario == "io") {
+        bench_io(argc > 2 ? argv[2] : "", argc > 3 && std::string(argv[3]) == "direct");
+    }
+    else if (scenario == "sync") {
+        return bench_sync() ? 0 : 1;
+    }
+    else if (scenario == "async") {
+        bench_async();
+    }
+    else if (scenario == "tier") {
+        bench_tier();
+    }
+    else if (scenario == "warm") {
+        bench_warm();
+    }
+    else if (scenario == "resize") {
+        bench_resize();
+    }
+    else if (scenario == "journal") {
+        return bench_journal(argc > 2 ? argv[2] : ".") ? 0 : 1;
+    }
+    else if (scenario == "device" && argc > 2) {
+        bench_device(argv[2], argc > 3 && std::string(argv[3]) == "direct");
+    }
+    else {
+        std::cerr << "Unknown scenario: " << scenario << "\n";
+        return 1;
+    }
+
+    return 0;
+}
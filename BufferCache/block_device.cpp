@@ -0,0 +1,527 @@
+#include "block_device.h"
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+#endif
+
+namespace {
+
+// Heap block with the alignment direct I/O needs, a power of two
+struct AlignedBlock {
+    char* ptr;
+
+    AlignedBlock(size_t size, size_t alignment) {
+        alignment = std::max(alignment, sizeof(void*));
+#ifdef _WIN32
+        ptr = static_cast<char*>(_aligned_malloc(size, alignment));
+#else
+        void* p = nullptr;
+        ptr = posix_memalign(&p, alignment, size) == 0 ? static_cast<char*>(p) : nullptr;
+#endif
+        if (!ptr) throw std::bad_alloc();
+    }
+    ~AlignedBlock() {
+#ifdef _WIN32
+        _aligned_free(ptr);
+#else
+        free(ptr);
+#endif
+    }
+
+    AlignedBlock(const AlignedBlock&) = delete;
+    AlignedBlock& operator=(const AlignedBlock&) = delete;
+};
+
+// Positional I/O takes a signed 64-bit offset everywhere
+size_t block_offset(uint64_t block_number, size_t block_size) {
+    if (block_number > static_cast<uint64_t>(INT64_MAX) / block_size || block_number > SIZE_MAX / block_size) {
+        throw std::out_of_range("Block number is beyond the largest device offset");
+    }
+    return static_cast<size_t>(block_number) * block_size;
+}
+
+#ifdef _WIN32
+[[noreturn]] void throw_io_error(const char* what) {
+    throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), what);
+}
+#else
+[[noreturn]] void throw_io_error(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// Vectors a single preadv or pwritev may take
+#ifdef IOV_MAX
+const size_t MAX_IOVECS = IOV_MAX;
+#else
+const size_t MAX_IOVECS = 16;  // The POSIX minimum
+#endif
+#endif
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// BlockDevice
+
+void BlockDevice::read_blocks(uint64_t first_block, size_t count, char* const* data) {
+    for (size_t i = 0; i < count; ++i) {
+        read_block(first_block + i, data[i]);
+    }
+}
+
+void BlockDevice::write_blocks(uint64_t first_block, size_t count, const char* const* data) {
+    for (size_t i = 0; i < count; ++i) {
+        write_block(first_block + i, data[i]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// DeviceSet
+
+DeviceSet::DeviceSet(std::vector<std::shared_ptr<BlockDevice>> devices) : m_devices(std::move(devices)) {
+    if (m_devices.empty() || m_devices.size() > MAX_DEVICES) {
+        throw std::invalid_argument("Device set needs between 1 and MAX_DEVICES devices");
+    }
+    for (const auto& device : m_devices) {
+        if (!device) {
+            throw std::invalid_argument("Device set member must not be null");
+        }
+        if (device->block_size() != m_devices[0]->block_size()) {
+            throw std::invalid_argument("Devices of a set must have the same block size");
+        }
+    }
+    m_block_size = m_devices[0]->block_size();
+}
+
+BlockDevice& DeviceSet::device_for(uint64_t first_block, size_t count) const {
+    uint32_t device = key_device(first_block);
+    if (device >= m_devices.size()) {
+        throw std::out_of_range("Block key names no device of the set");
+    }
+    if (count > 1 && key_block(first_block) + (count - 1) >= MAX_DEVICE_BLOCKS) {
+        throw std::out_of_range("Block run crosses the end of a device");
+    }
+    return *m_devices[device];
+}
+
+void DeviceSet::read_block(uint64_t block_number, char* data) {
+    device_for(block_number).read_block(key_block(block_number), data);
+}
+
+void DeviceSet::write_block(uint64_t block_number, const char* data) {
+    device_for(block_number).write_block(key_block(block_number), data);
+}
+
+void DeviceSet::read_blocks(uint64_t first_block, size_t count, char* const* data) {
+    if (count == 0) return;
+    device_for(first_block, count).read_blocks(key_block(first_block), count, data);
+}
+
+void DeviceSet::write_blocks(uint64_t first_block, size_t count, const char* const* data) {
+    if (count == 0) return;
+    device_for(first_block, count).write_blocks(key_block(first_block), count, data);
+}
+
+void DeviceSet::sync() {
+    for (const auto& device : m_devices) {
+        device->sync();
+    }
+}
+
+void DeviceSet::sync_data() {
+    for (const auto& device : m_devices) {
+        device->sync_data();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// MemoryBlockDevice
+
+MemoryBlockDevice::MemoryBlockDevice(size_t block_size) : m_block_size(block_size) {
+    if (block_size == 0) {
+        throw std::invalid_argument("Block size must be greater than 0");
+    }
+}
+
+void MemoryBlockDevice::read_block(uint64_t block_number, char* data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_reads++;
+
+    auto it = m_blocks.find(block_number);
+    if (it != m_blocks.end()) {
+        memcpy(data, it->second.data(), m_block_size);
+    }
+    else {
+        memset(data, 0, m_block_size);
+    }
+}
+
+void MemoryBlockDevice::read_blocks(uint64_t first_block, size_t count, char* const* data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_reads += count;
+
+    for (size_t i = 0; i < count; ++i) {
+        auto it = m_blocks.find(first_block + i);
+        if (it != m_blocks.end()) {
+            memcpy(data[i], it->second.data(), m_block_size);
+        }
+        else {
+            memset(data[i], 0, m_block_size);
+        }
+    }
+}
+
+void MemoryBlockDevice::write_block(uint64_t block_number, const char* data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writes++;
+
+    auto& block = m_blocks[block_number];
+    block.assign(data, data + m_block_size);
+}
+
+void MemoryBlockDevice::write_blocks(uint64_t first_block, size_t count, const char* const* data) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_writes += count;
+
+    for (size_t i = 0; i < count; ++i) {
+        auto& block = m_blocks[first_block + i];
+        block.assign(data[i], data[i] + m_block_size);
+    }
+}
+
+size_t MemoryBlockDevice::reads() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reads;
+}
+
+size_t MemoryBlockDevice::writes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_writes;
+}
+
+// ---------------------------------------------------------------------------
+// FileBlockDevice
+
+FileBlockDevice::FileBlockDevice(const std::string& path, size_t block_size, bool direct_io)
+    : m_block_size(block_size), m_direct_io(direct_io) {
+    if (block_size == 0) {
+        throw std::invalid_argument("Block size must be greater than 0");
+    }
+
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (direct_io) {
+        flags |= FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH;
+    }
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, flags, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw_io_error("Failed to open block device");
+    }
+    m_handle = handle;
+#else
+    int flags = O_RDWR | O_CREAT;
+#ifdef O_DIRECT
+    if (direct_io) {
+        flags |= O_DIRECT;
+    }
+#endif
+    m_fd = ::open(path.c_str(), flags, 0644);
+    if (m_fd < 0) {
+        throw_io_error("Failed to open block device");
+    }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    // macOS has no O_DIRECT; F_NOCACHE is the closest equivalent
+    if (direct_io) {
+        fcntl(m_fd, F_NOCACHE, 1);
+    }
+#endif
+#endif
+
+    if (direct_io) {
+        m_alignment = query_direct_io_alignment();
+        if (m_alignment == 0 || block_size % m_alignment != 0) {
+            size_t alignment = m_alignment;
+#ifdef _WIN32
+            CloseHandle(static_cast<HANDLE>(m_handle));
+#else
+            ::close(m_fd);
+#endif
+            if (alignment == 0) {
+                throw std::invalid_argument("Direct I/O is not supported on this file");
+            }
+            throw std::invalid_argument("Block size must be a multiple of the device's direct I/O alignment ("
+                + std::to_string(alignment) + " bytes)");
+        }
+    }
+}
+
+size_t FileBlockDevice::query_direct_io_alignment() const {
+    size_t alignment = 0;
+#ifdef _WIN32
+    // Unbuffered I/O must be aligned to the sector size; the physical one
+    // can be larger than the logical one the drive emulates
+    FILE_STORAGE_INFO info = {};
+    if (GetFileInformationByHandleEx(static_cast<HANDLE>(m_handle), FileStorageInfo, &info, sizeof(info))) {
+        alignment = std::max(info.LogicalBytesPerSector, info.PhysicalBytesPerSectorForPerformance);
+    }
+#else
+#if defined(__linux__) && defined(STATX_DIOALIGN)
+    // Linux 6.1 and later report it for files and block devices alike
+    struct statx stx = {};
+    if (::statx(m_fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 && (stx.stx_mask & STATX_DIOALIGN)) {
+        if (stx.stx_dio_offset_align == 0) return 0;
+        alignment = std::max(stx.stx_dio_mem_align, stx.stx_dio_offset_align);
+    }
+#endif
+#ifdef BLKSSZGET
+    // A raw device's logical block size
+    struct stat st;
+    int sector_size = 0;
+    if (alignment == 0 && ::fstat(m_fd, &st) == 0 && S_ISBLK(st.st_mode) &&
+        ::ioctl(m_fd, BLKSSZGET, &sector_size) == 0 && sector_size > 0) {
+        alignment = static_cast<size_t>(sector_size);
+    }
+#endif
+#endif
+    if (alignment == 0) {
+        alignment = DEFAULT_DIRECT_IO_ALIGNMENT;
+    }
+    return std::bit_ceil(alignment);
+}
+
+bool FileBlockDevice::is_aligned(const void* p) const {
+    return reinterpret_cast<uintptr_t>(p) % m_alignment == 0;
+}
+
+FileBlockDevice::~FileBlockDevice() {
+#ifdef _WIN32
+    CloseHandle(static_cast<HANDLE>(m_handle));
+#else
+    ::close(m_fd);
+#endif
+}
+
+void FileBlockDevice::read_block(uint64_t block_number, char* data) {
+    size_t offset = block_offset(block_number, m_block_size);
+
+    if (m_direct_io && !is_aligned(data)) {
+        AlignedBlock bounce(m_block_size, m_alignment);
+        read_at(bounce.ptr, offset);
+        memcpy(data, bounce.ptr, m_block_size);
+        return;
+    }
+    read_at(data, offset);
+}
+
+void FileBlockDevice::write_block(uint64_t block_number, const char* data) {
+    size_t offset = block_offset(block_number, m_block_size);
+
+    if (m_direct_io && !is_aligned(data)) {
+        AlignedBlock bounce(m_block_size, m_alignment);
+        memcpy(bounce.ptr, data, m_block_size);
+        write_at(bounce.ptr, offset);
+        return;
+    }
+    write_at(data, offset);
+}
+
+void FileBlockDevice::read_blocks(uint64_t first_block, size_t count, char* const* data) {
+#ifdef _WIN32
+    // ReadFileScatter needs an unbuffered, overlapped handle and page-sized
+    // segments; read block by block instead
+    BlockDevice::read_blocks(first_block, count, data);
+#else
+    if (count == 0) return;
+    size_t offset = block_offset(first_block, m_block_size);
+
+    // Unaligned buffers have to be bounced one at a time
+    if (m_direct_io && !std::all_of(data, data + count, [this](const char* p) { return is_aligned(p); })) {
+        BlockDevice::read_blocks(first_block, count, data);
+        return;
+    }
+
+    std::vector<iovec> iov(count);
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = data[i];
+        iov[i].iov_len = m_block_size;
+    }
+
+    size_t next = 0;  // First vector not completely filled
+    while (next < count) {
+        int n_iov = static_cast<int>(std::min(count - next, MAX_IOVECS));
+        ssize_t n = ::preadv(m_fd, &iov[next], n_iov, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_io_error("Block device read failed");
+        }
+        if (n == 0) {
+            // Past the end of the file: unwritten blocks read as zeros
+            for (; next < count; ++next) {
+                memset(iov[next].iov_base, 0, iov[next].iov_len);
+            }
+            return;
+        }
+        offset += static_cast<size_t>(n);
+
+        // Skip the vectors that were filled and trim a partial one
+        size_t done = static_cast<size_t>(n);
+        while (done > 0) {
+            if (done >= iov[next].iov_len) {
+                done -= iov[next].iov_len;
+                next++;
+            }
+            else {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + done;
+                iov[next].iov_len -= done;
+                done = 0;
+            }
+        }
+    }
+#endif
+}
+
+void FileBlockDevice::write_blocks(uint64_t first_block, size_t count, const char* const* data) {
+#ifdef _WIN32
+    // WriteFileGather has the same restrictions as ReadFileScatter
+    BlockDevice::write_blocks(first_block, count, data);
+#else
+    if (count == 0) return;
+    size_t offset = block_offset(first_block, m_block_size);
+
+    if (m_direct_io && !std::all_of(data, data + count, [this](const char* p) { return is_aligned(p); })) {
+        BlockDevice::write_blocks(first_block, count, data);
+        return;
+    }
+
+    std::vector<iovec> iov(count);
+    for (size_t i = 0; i < count; ++i) {
+        iov[i].iov_base = const_cast<char*>(data[i]);
+        iov[i].iov_len = m_block_size;
+    }
+
+    size_t next = 0;  // First vector not completely written
+    while (next < count) {
+        int n_iov = static_cast<int>(std::min(count - next, MAX_IOVECS));
+        ssize_t n = ::pwritev(m_fd, &iov[next], n_iov, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_io_error("Block device write failed");
+        }
+        if (n == 0) {
+            throw std::runtime_error("Block device write made no progress");
+        }
+        offset += static_cast<size_t>(n);
+
+        // Skip the vectors that were written and trim a partial one
+        size_t done = static_cast<size_t>(n);
+        while (done > 0) {
+            if (done >= iov[next].iov_len) {
+                done -= iov[next].iov_len;
+                next++;
+            }
+            else {
+                iov[next].iov_base = static_cast<char*>(iov[next].iov_base) + done;
+                iov[next].iov_len -= done;
+                done = 0;
+            }
+        }
+    }
+#endif
+}
+
+void FileBlockDevice::sync() {
+#ifdef _WIN32
+    if (!FlushFileBuffers(static_cast<HANDLE>(m_handle))) {
+        throw_io_error("Failed to sync block device");
+    }
+#else
+    if (::fsync(m_fd) != 0) {
+        throw_io_error("Failed to sync block device");
+    }
+#endif
+}
+
+void FileBlockDevice::sync_data() {
+#if !defined(_WIN32) && defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+    if (::fdatasync(m_fd) != 0) {
+        throw_io_error("Failed to sync block device");
+    }
+#else
+    sync();
+#endif
+}
+
+void FileBlockDevice::read_at(char* data, size_t offset) {
+    size_t done = 0;
+    while (done < m_block_size) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(offset + done);
+        ov.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset + done) >> 32);
+        DWORD n = 0;
+        if (!ReadFile(static_cast<HANDLE>(m_handle), data + done,
+                static_cast<DWORD>(m_block_size - done), &n, &ov)) {
+            if (GetLastError() != ERROR_HANDLE_EOF) {
+                throw_io_error("Block device read failed");
+            }
+            n = 0;
+        }
+#else
+        ssize_t n = ::pread(m_fd, data + done, m_block_size - done, static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_io_error("Block device read failed");
+        }
+#endif
+        if (n == 0) {
+            // Past the end of the file: unwritten blocks read as zeros
+            memset(data + done, 0, m_block_size - done);
+            return;
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+void FileBlockDevice::write_at(const char* data, size_t offset) {
+    size_t done = 0;
+    while (done < m_block_size) {
+#ifdef _WIN32
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(offset + done);
+        ov.OffsetHigh = static_cast<DWORD>(static_cast<uint64_t>(offset + done) >> 32);
+        DWORD n = 0;
+        if (!WriteFile(static_cast<HANDLE>(m_handle), data + done,
+                static_cast<DWORD>(m_block_size - done), &n, &ov)) {
+            throw_io_error("Block device write failed");
+        }
+#else
+        ssize_t n = ::pwrite(m_fd, data + done, m_block_size - done, static_cast<off_t>(offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw_io_error("Block device write failed");
+        }
+#endif
+        done += static_cast<size_t>(n);
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Storage behind myBufferCache. Implementations must be safe to call from
+// several threads at once, since each cache shard performs its own I/O.
+class BlockDevice {
+public:
+    virtual ~BlockDevice() = default;
+
+    virtual size_t block_size() const = 0;
+
+    // Transfer exactly block_size() bytes
+    virtual void read_block(uint64_t block_number, char* data) = 0;
+    virtual void write_block(uint64_t block_number, const char* data) = 0;
+
+    // Read or write count consecutive blocks starting at first_block, block
+    // i from or into data[i]. The defaults transfer them one at a time;
+    // devices that can transfer a whole run in one request override them.
+    virtual void read_blocks(uint64_t first_block, size_t count, char* const* data);
+    virtual void write_blocks(uint64_t first_block, size_t count, const char* const* data);
+
+    // Make previous writes durable
+    virtual void sync() {}
+    // Make previous writes to blocks the device already holds durable,
+    // without necessarily its metadata (file size, timestamps). Enough for
+    // overwrites of a preallocated region; the default is a full sync.
+    virtual void sync_data() { sync(); }
+};
+
+// Blocks of several devices in one 64-bit key space: the top DEVICE_BITS
+// bits of a block key name the device, the rest the block on it. Keys of
+// device 0 are plain block numbers. The last device number is left out so
+// that NO_BLOCK never names a block.
+constexpr unsigned DEVICE_BITS = 16;
+constexpr uint32_t MAX_DEVICES = (1u << DEVICE_BITS) - 1;
+constexpr uint64_t MAX_DEVICE_BLOCKS = uint64_t(1) << (64 - DEVICE_BITS);
+constexpr uint64_t NO_BLOCK = UINT64_MAX;
+
+inline uint64_t block_key(uint32_t device, uint64_t block_number) {
+    if (device >= MAX_DEVICES || block_number >= MAX_DEVICE_BLOCKS) {
+        throw std::out_of_range("Device or block number too large for a block key");
+    }
+    return static_cast<uint64_t>(device) << (64 - DEVICE_BITS) | block_number;
+}
+
+constexpr uint32_t key_device(uint64_t key) { return static_cast<uint32_t>(key >> (64 - DEVICE_BITS)); }
+constexpr uint64_t key_block(uint64_t key) { return key & (MAX_DEVICE_BLOCKS - 1); }
+
+// Devices of one block size addressed together by block key, each request
+// passed on to the device its key names. A run of blocks may not cross
+// from one device into the next.
+class DeviceSet : public BlockDevice {
+public:
+    explicit DeviceSet(std::vector<std::shared_ptr<BlockDevice>> devices);
+
+    size_t block_size() const override { return m_block_size; }
+    void read_block(uint64_t block_number, char* data) override;
+    void write_block(uint64_t block_number, const char* data) override;
+    void read_blocks(uint64_t first_block, size_t count, char* const* data) override;
+    void write_blocks(uint64_t first_block, size_t count, const char* const* data) override;
+    // Syncs every device
+    void sync() override;
+    void sync_data() override;
+
+    size_t size() const { return m_devices.size(); }
+    const std::shared_ptr<BlockDevice>& device(uint32_t index) const { return m_devices[index]; }
+
+    // The device holding a run of count blocks from first_block
+    BlockDevice& device_for(uint64_t first_block, size_t count = 1) const;
+
+private:
+    std::vector<std::shared_ptr<BlockDevice>> m_devices;
+    size_t m_block_size;
+};
+
+// Sparse RAM-backed device, mainly for tests and benchmarks.
+// Blocks that were never written read back as zeros.
+class MemoryBlockDevice : public BlockDevice {
+public:
+    explicit MemoryBlockDevice(size_t block_size = 4096);
+
+    size_t block_size() const override { return m_block_size; }
+    void read_block(uint64_t block_number, char* data) override;
+    void write_block(uint64_t block_number, const char* data) override;
+    void read_blocks(uint64_t first_block, size_t count, char* const* data) override;
+    void write_blocks(uint64_t first_block, size_t count, const char* const* data) override;
+
+    size_t reads() const;
+    size_t writes() const;
+
+private:
+    size_t m_block_size;
+    size_t m_reads = 0;
+    size_t m_writes = 0;
+    std::unordered_map<uint64_t, std::vector<char>> m_blocks;
+    mutable std::mutex m_mutex;
+};
+
+// Regular file or raw device accessed with positional I/O (pread/pwrite,
+// or ReadFile/WriteFile with an offset on Windows). Runs of blocks are read
+// and written with a single preadv/pwritev where available. With direct_io the page
+// cache is bypassed (O_DIRECT / FILE_FLAG_NO_BUFFERING), which requires
+// buffers, offsets and sizes aligned to the device's logical block size.
+// That is queried when the device is opened (statx STATX_DIOALIGN or
+// BLKSSZGET, FileStorageInfo on Windows), or taken to be
+// DEFAULT_DIRECT_IO_ALIGNMENT if the system can't tell. The block size must
+// be a multiple of it; unaligned buffers are bounced.
+class FileBlockDevice : public BlockDevice {
+public:
+    // Large enough for 4Kn drives as well as 512-byte sector ones
+    static constexpr size_t DEFAULT_DIRECT_IO_ALIGNMENT = 4096;
+
+    FileBlockDevice(const std::string& path, size_t block_size = 4096, bool direct_io = false);
+    ~FileBlockDevice() override;
+
+    FileBlockDevice(const FileBlockDevice&) = delete;
+    FileBlockDevice& operator=(const FileBlockDevice&) = delete;
+
+    size_t block_size() const override { return m_block_size; }
+    void read_block(uint64_t block_number, char* data) override;
+    void write_block(uint64_t block_number, const char* data) override;
+    void read_blocks(uint64_t first_block, size_t count, char* const* data) override;
+    void write_blocks(uint64_t first_block, size_t count, const char* const* data) override;
+    void sync() override;
+    // fdatasync where available, otherwise the same as sync
+    void sync_data() override;
+
+    bool direct_io() const { return m_direct_io; }
+    // Buffer alignment direct I/O needs here; 1 without direct I/O
+    size_t direct_io_alignment() const { return m_alignment; }
+#ifndef _WIN32
+    // For I/O engines that submit requests on the descriptor themselves
+    int fd() const { return m_fd; }
+#endif
+
+private:
+    size_t m_block_size;
+    bool m_direct_io;
+    size_t m_alignment = 1;
+#ifdef _WIN32
+    void* m_handle;
+#else
+    int m_fd;
+#endif
+
+    void read_at(char* data, size_t offset);
+    void write_at(const char* data, size_t offset);
+    bool is_aligned(const void* p) const;
+    // Alignment direct I/O on the open file or device needs, 0 if it
+    // doesn't support direct I/O at all
+    size_t query_direct_io_alignment() const;
+};
+
+#endif // BLOCK_DEVICE_H
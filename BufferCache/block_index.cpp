@@ -0,0 +1,87 @@
+#include "block_index.h"
+
+BlockIndex::BlockIndex(size_t max_entries) {
+    // Keep the load factor at or below one quarter, so that probes for
+    // blocks that are not cached end as quickly as hits
+    size_t capacity = 16;
+    while (capacity < 4 * max_entries) {
+        capacity *= 2;
+    }
+
+    m_slots = std::make_unique<Slot[]>(capacity);
+    m_mask = capacity - 1;
+}
+
+size_t BlockIndex::home_slot(uint64_t key) const {
+    // murmur3 64-bit finalizer; independent of the Fibonacci hash used for
+    // sharding, and it spreads the device bits into the low ones
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return static_cast<size_t>(key) & m_mask;
+}
+
+uint32_t BlockIndex::find(uint64_t key) const {
+    for (size_t i = home_slot(key), probes = 0; probes <= m_mask; i = (i + 1) & m_mask, ++probes) {
+        const Slot& slot = m_slots[i];
+        uint32_t value = slot.value.load(std::memory_order_acquire);
+        if (value == EMPTY) break;
+
+        if (slot.key.load(std::memory_order_relaxed) == key) {
+            // The slot may have been refilled between the two loads
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.value.load(std::memory_order_relaxed) != value) break;
+            return value - 1;
+        }
+    }
+    return NOT_FOUND;
+}
+
+void BlockIndex::fill(Slot& slot, uint64_t key, uint32_t value) {
+    // Pairs with the fence in find: a reader that sees the new key sees the
+    // slot's value as EMPTY or newer
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.key.store(key, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_release);
+}
+
+void BlockIndex::insert(uint64_t key, uint32_t buffer_index) {
+    erase(key);
+
+    // At most a quarter full, so there is always an empty slot
+    for (size_t i = home_slot(key); ; i = (i + 1) & m_mask) {
+        if (m_slots[i].value.load(std::memory_order_relaxed) == EMPTY) {
+            fill(m_slots[i], key, buffer_index + 1);
+            m_size++;
+            return;
+        }
+    }
+}
+
+void BlockIndex::erase(uint64_t key) {
+    size_t hole = home_slot(key);
+    for (size_t probes = 0; ; hole = (hole + 1) & m_mask, ++probes) {
+        if (probes > m_mask || m_slots[hole].value.load(std::memory_order_relaxed) == EMPTY) return;
+        if (m_slots[hole].key.load(std::memory_order_relaxed) == key) break;
+    }
+    m_slots[hole].value.store(EMPTY, std::memory_order_release);
+    m_size--;
+
+    // Move later entries of the cluster back into the hole where that keeps
+    // them reachable from their home slot, until the cluster ends
+    for (size_t i = (hole + 1) & m_mask; ; i = (i + 1) & m_mask) {
+        Slot& slot = m_slots[i];
+        uint32_t value = slot.value.load(std::memory_order_relaxed);
+        if (value == EMPTY) return;
+
+        uint64_t entry_key = slot.key.load(std::memory_order_relaxed);
+        size_t home = home_slot(entry_key);
+        if (((i - home) & m_mask) >= ((i - hole) & m_mask)) {
+            fill(m_slots[hole], entry_key, value);
+            slot.value.store(EMPTY, std::memory_order_release);
+            hole = i;
+        }
+    }
+}
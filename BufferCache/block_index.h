@@ -0,0 +1,52 @@
+#pragma once
+#ifndef BLOCK_INDEX_H
+#define BLOCK_INDEX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Open-addressing hash table from 64-bit block key to buffer index, sized
+// once for a fixed number of entries: one flat array of slots, linear
+// probing, and no allocation after construction. Erasing shifts the rest
+// of the cluster back into the hole instead of leaving a tombstone, so the
+// table never degrades and never needs rehashing.
+//
+// insert/erase must be serialized by the owner (the shard lock). Lookups
+// never lock and may run concurrently with them; such a lookup can miss an
+// entry that is being moved but never returns a pairing that was not
+// stored, so lock-free callers must treat a miss as "retry under the lock".
+class BlockIndex {
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    explicit BlockIndex(size_t max_entries);
+
+    // Buffer index stored for key, or NOT_FOUND
+    uint32_t find(uint64_t key) const;
+
+    void insert(uint64_t key, uint32_t buffer_index);
+    void erase(uint64_t key);
+
+    size_t size() const { return m_size; }
+
+private:
+    // value is buffer index + 1, or EMPTY. Writers store the key before
+    // publishing the value; readers confirm a matching key by reading the
+    // value again.
+    struct Slot {
+        std::atomic<uint64_t> key{ 0 };
+        std::atomic<uint32_t> value{ 0 };
+    };
+    static constexpr uint32_t EMPTY = 0;
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+    size_t m_size = 0;
+
+    size_t home_slot(uint64_t key) const;
+    void fill(Slot& slot, uint64_t key, uint32_t value);
+};
+
+#endif // BLOCK_INDEX_H
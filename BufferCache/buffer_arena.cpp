@@ -0,0 +1,120 @@
+#include "buffer_arena.h"
+#include <new>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Huge page size assumed when rounding up; 2 MB on x86-64 and most ARM64
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+size_t page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+} // namespace
+
+BufferArena::BufferArena(size_t block_size, size_t num_blocks, bool huge_pages)
+    : m_block_size(block_size), m_bytes(block_size * num_blocks) {
+#ifdef _WIN32
+    if (huge_pages) {
+        // Needs the "Lock pages in memory" privilege; silently skipped otherwise
+        size_t large_page = GetLargePageMinimum();
+        if (large_page > 0) {
+            size_t bytes = round_up(m_bytes, large_page);
+            void* p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            if (p) {
+                m_base = static_cast<char*>(p);
+                m_bytes = bytes;
+                m_huge_pages = true;
+                return;
+            }
+        }
+    }
+
+    void* p = VirtualAlloc(nullptr, m_bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!p) throw std::bad_alloc();
+    m_base = static_cast<char*>(p);
+#else
+#ifdef MAP_HUGETLB
+    if (huge_pages) {
+        size_t bytes = round_up(m_bytes, HUGE_PAGE_SIZE);
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            m_base = static_cast<char*>(p);
+            m_bytes = bytes;
+            m_huge_pages = true;
+            return;
+        }
+    }
+#endif
+
+    if (huge_pages) {
+        m_bytes = round_up(m_bytes, HUGE_PAGE_SIZE);
+    }
+    void* p = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc();
+    m_base = static_cast<char*>(p);
+
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        madvise(m_base, m_bytes, MADV_HUGEPAGE);  // Only a hint
+    }
+#endif
+#endif
+}
+
+BufferArena::~BufferArena() {
+#ifdef _WIN32
+    VirtualFree(m_base, 0, MEM_RELEASE);
+#else
+    munmap(m_base, m_bytes);
+#endif
+}
+
+void BufferArena::release(size_t first, size_t count) {
+    if (m_huge_pages || count == 0) return;
+
+    size_t page = page_size();
+    size_t begin = round_up(first * m_block_size, page);
+    size_t end = (first + count) * m_block_size / page * page;
+    if (begin >= end) return;
+#ifdef _WIN32
+    VirtualFree(m_base + begin, end - begin, MEM_DECOMMIT);
+#else
+    madvise(m_base + begin, end - begin, MADV_DONTNEED);
+#endif
+}
+
+void BufferArena::commit(size_t first, size_t count) {
+#ifdef _WIN32
+    // Whole pages around the blocks; committing a committed page is harmless
+    if (m_huge_pages || count == 0) return;
+    size_t page = page_size();
+    size_t begin = first * m_block_size / page * page;
+    size_t end = round_up((first + count) * m_block_size, page);
+    if (!VirtualAlloc(m_base + begin, end - begin, MEM_COMMIT, PAGE_READWRITE)) {
+        throw std::bad_alloc();
+    }
+#else
+    // Released pages come back zeroed on first touch
+    (void)first;
+    (void)count;
+#endif
+}
@@ -0,0 +1,43 @@
+#pragma once
+#ifndef BUFFER_ARENA_H
+#define BUFFER_ARENA_H
+
+#include <cstddef>
+
+// One contiguous, page-aligned allocation holding the payload of every
+// buffer in the cache. Keeping payloads out of the metadata array means
+// scans over buffer headers stay in a few cache lines and TLB entries.
+// It is sized for the largest the cache may grow to; pages are only
+// backed by memory once used, and can be given back with release().
+//
+// With huge_pages the arena is first requested from explicit huge pages
+// (MAP_HUGETLB / MEM_LARGE_PAGES); if the system has none configured it
+// falls back to normal pages, hinting transparent huge pages on Linux.
+class BufferArena {
+public:
+    BufferArena(size_t block_size, size_t num_blocks, bool huge_pages);
+    ~BufferArena();
+
+    BufferArena(const BufferArena&) = delete;
+    BufferArena& operator=(const BufferArena&) = delete;
+
+    char* block(size_t index) const { return m_base + index * m_block_size; }
+    size_t bytes() const { return m_bytes; }
+
+    // Blocks [first, first + count) go unused for a while: return the pages
+    // wholly inside them to the system (not with explicit huge pages).
+    // commit() makes them usable again; their contents are lost.
+    void release(size_t first, size_t count);
+    void commit(size_t first, size_t count);
+
+    // Whether the arena actually got explicit huge pages
+    bool huge_pages() const { return m_huge_pages; }
+
+private:
+    char* m_base = nullptr;
+    size_t m_block_size;
+    size_t m_bytes;
+    bool m_huge_pages = false;
+};
+
+#endif // BUFFER_ARENA_H
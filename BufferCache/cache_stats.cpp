@@ -0,0 +1,48 @@
+#include "cache_stats.h"
+
+uint64_t LatencyHistogram::Snapshot::count() const {
+    uint64_t total = 0;
+    for (uint64_t n : buckets) {
+        total += n;
+    }
+    return total;
+}
+
+double LatencyHistogram::Snapshot::mean_ns() const {
+    uint64_t n = count();
+    return n ? static_cast<double>(total_ns) / n : 0.0;
+}
+
+double LatencyHistogram::Snapshot::percentile(double q) const {
+    uint64_t n = count();
+    if (n == 0) return 0.0;
+
+    double rank = q * n;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        if (buckets[i] == 0) continue;
+        if (seen + buckets[i] >= rank) {
+            double low = i == 0 ? 0.0 : static_cast<double>(1ull << i);
+            double high = static_cast<double>(1ull << (i + 1));
+            double fraction = (rank - seen) / buckets[i];
+            return low + (high - low) * (fraction < 0 ? 0 : fraction);
+        }
+        seen += buckets[i];
+    }
+    return static_cast<double>(1ull << BUCKETS);
+}
+
+LatencyHistogram::Snapshot& LatencyHistogram::Snapshot::operator+=(const Snapshot& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    total_ns += other.total_ns;
+    return *this;
+}
+
+void LatencyHistogram::add_to(Snapshot& snapshot) const {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        snapshot.buckets[i] += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    snapshot.total_ns += m_total_ns.load(std::memory_order_relaxed);
+}
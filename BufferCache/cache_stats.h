@@ -0,0 +1,50 @@
+#pragma once
+#ifndef CACHE_STATS_H
+#define CACHE_STATS_H
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// Latency histogram with power-of-two buckets: bucket i > 0 counts samples
+// in [2^i, 2^(i+1)) nanoseconds, and bucket 0 those in [0, 2). Recording is one relaxed increment per
+// bucket and total, so it is safe from any thread and never blocks.
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 40;  // The last bucket holds everything from ~9 minutes
+
+    // Plain copy of a histogram, possibly merged from several
+    struct Snapshot {
+        std::array<uint64_t, BUCKETS> buckets{};
+        uint64_t total_ns = 0;
+
+        uint64_t count() const;
+        double mean_ns() const;
+        // Estimated q-quantile (0 <= q <= 1) in nanoseconds, interpolated
+        // within the bucket it falls in
+        double percentile(double q) const;
+
+        Snapshot& operator+=(const Snapshot& other);
+    };
+
+    void record(uint64_t ns) {
+        m_buckets[bucket_for(ns)].fetch_add(1, std::memory_order_relaxed);
+        m_total_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // Adds this histogram's counts to snapshot
+    void add_to(Snapshot& snapshot) const;
+
+private:
+    std::atomic<uint64_t> m_buckets[BUCKETS]{};
+    std::atomic<uint64_t> m_total_ns{ 0 };
+
+    static size_t bucket_for(uint64_t ns) {
+        size_t bucket = static_cast<size_t>(std::bit_width(ns | 1)) - 1;
+        return bucket < BUCKETS - 1 ? bucket : BUCKETS - 1;
+    }
+};
+
+#endif // CACHE_STATS_H
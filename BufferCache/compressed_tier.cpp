@@ -0,0 +1,128 @@
+#include "compressed_tier.h"
+#include "lz_codec.h"
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Compression output of the calling thread, copied into an exactly sized
+// allocation once its size is known
+thread_local std::vector<char> t_scratch;
+
+} // namespace
+
+CompressedTier::CompressedTier(size_t capacity_bytes, size_t block_size, size_t num_shards)
+    : m_capacity(capacity_bytes), m_block_size(block_size), m_num_shards(num_shards) {
+    if (num_shards == 0 || capacity_bytes / num_shards < block_size) {
+        throw std::invalid_argument("Compressed tier must hold at least one block per shard");
+    }
+    m_shard_capacity = capacity_bytes / num_shards;
+    m_shards = std::make_unique<Shard[]>(num_shards);
+}
+
+CompressedTier::Shard& CompressedTier::shard_for(uint64_t block_number) const {
+    // Fibonacci hashing, as for the cache's own shards
+    uint64_t hash = (block_number ^ block_number >> 32) * 0x9E3779B97F4A7C15ull;
+    return m_shards[(hash >> 32) % m_num_shards];
+}
+
+void CompressedTier::store(uint64_t block_number, const char* data) {
+    // Worth compressing only if it saves an eighth of the block
+    if (t_scratch.size() < m_block_size) {
+        t_scratch.resize(m_block_size);
+    }
+    size_t size = lz_compress(data, m_block_size, t_scratch.data(), m_block_size - m_block_size / 8);
+    bool compressed = size != 0;
+    if (!compressed) {
+        size = m_block_size;
+    }
+    auto copy = std::make_unique<char[]>(size);
+    memcpy(copy.get(), compressed ? t_scratch.data() : data, size);
+
+    Shard& shard = shard_for(block_number);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.entries.find(block_number);
+    if (it != shard.entries.end()) {
+        remove(shard, it->second);
+    }
+    while (shard.bytes + size > m_shard_capacity) {
+        remove(shard, *shard.oldest);
+    }
+
+    Entry& entry = shard.entries[block_number];
+    entry.data = std::move(copy);
+    entry.size = static_cast<uint32_t>(size);
+    entry.compressed = compressed;
+    entry.block_number = block_number;
+    entry.older = shard.newest;
+    entry.newer = nullptr;
+    if (shard.newest) {
+        shard.newest->newer = &entry;
+    }
+    else {
+        shard.oldest = &entry;
+    }
+    shard.newest = &entry;
+    shard.bytes += size;
+}
+
+bool CompressedTier::take(uint64_t block_number, char* data) {
+    std::unique_ptr<char[]> stored;
+    size_t size;
+    bool compressed;
+    {
+        Shard& shard = shard_for(block_number);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(block_number);
+        if (it == shard.entries.end()) return false;
+
+        stored = std::move(it->second.data);
+        size = it->second.size;
+        compressed = it->second.compressed;
+        remove(shard, it->second);
+    }
+
+    if (!compressed) {
+        memcpy(data, stored.get(), size);
+        return true;
+    }
+    // A corrupt entry is only a miss; the caller reads the device
+    return lz_decompress(stored.get(), size, data, m_block_size);
+}
+
+void CompressedTier::remove(Shard& shard, Entry& entry) {
+    if (entry.older) {
+        entry.older->newer = entry.newer;
+    }
+    else {
+        shard.oldest = entry.newer;
+    }
+    if (entry.newer) {
+        entry.newer->older = entry.older;
+    }
+    else {
+        shard.newest = entry.older;
+    }
+    shard.bytes -= entry.size;
+    shard.entries.erase(entry.block_number);
+}
+
+size_t CompressedTier::blocks() const {
+    size_t total = 0;
+    for (size_t i = 0; i < m_num_shards; ++i) {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        total += m_shards[i].entries.size();
+    }
+    return total;
+}
+
+size_t CompressedTier::bytes() const {
+    size_t total = 0;
+    for (size_t i = 0; i < m_num_shards; ++i) {
+        std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+        total += m_shards[i].bytes;
+    }
+    return total;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef COMPRESSED_TIER_H
+#define COMPRESSED_TIER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Second cache tier in RAM holding compressed copies (lz_codec) of clean
+// blocks evicted from myBufferCache, within a byte budget of its own.
+// Blocks that don't compress are kept as they are. The tier is exclusive
+// of the cache: take() hands a block back and forgets it, so the two never
+// hold diverging copies.
+//
+// Compression and decompression run with no lock held; each of a few
+// shards has its own map and insertion-ordered list, the oldest entries
+// making room for new ones.
+class CompressedTier {
+public:
+    CompressedTier(size_t capacity_bytes, size_t block_size, size_t num_shards);
+
+    CompressedTier(const CompressedTier&) = delete;
+    CompressedTier& operator=(const CompressedTier&) = delete;
+
+    // Keep a copy of block_number's data, replacing any held before
+    void store(uint64_t block_number, const char* data);
+
+    // If block_number is held, copy its data out, drop it and return true
+    bool take(uint64_t block_number, char* data);
+
+    size_t capacity() const { return m_capacity; }
+    size_t blocks() const;  // Blocks held
+    size_t bytes() const;   // ... their stored size
+
+private:
+    struct Entry {
+        std::unique_ptr<char[]> data;
+        uint32_t size;       // Stored bytes
+        bool compressed;     // Otherwise a plain copy
+        Entry* older = nullptr;
+        Entry* newer = nullptr;
+        uint64_t block_number;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, Entry> entries;
+        Entry* oldest = nullptr;
+        Entry* newest = nullptr;
+        size_t bytes = 0;
+    };
+
+    size_t m_capacity;
+    size_t m_block_size;
+    size_t m_shard_capacity;
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_num_shards;
+
+    Shard& shard_for(uint64_t block_number) const;
+    // Unlink and forget an entry (caller holds the shard lock)
+    void remove(Shard& shard, Entry& entry);
+};
+
+#endif // COMPRESSED_TIER_H
@@ -0,0 +1,73 @@
+#include "executor.h"
+#include <utility>
+
+namespace {
+
+thread_local Executor* t_current = nullptr;
+
+}
+
+void Task::promise_type::FinalAwaiter::await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+    Executor* executor = handle.promise().executor;
+    std::exception_ptr error = std::move(handle.promise().error);
+    handle.destroy();
+    executor->task_finished(error);
+}
+
+Task::~Task() {
+    if (m_handle) {
+        m_handle.destroy();
+    }
+}
+
+void Executor::spawn(Task task) {
+    std::coroutine_handle<Task::promise_type> handle = std::exchange(task.m_handle, nullptr);
+    handle.promise().executor = this;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_tasks;
+    }
+    post([handle] { handle.resume(); });
+}
+
+void Executor::post(std::function<void()> job) {
+    // Notified under the lock: once the job is seen, the last task may
+    // finish and the executor be destroyed
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+    m_cv.notify_one();
+}
+
+void Executor::run() {
+    Executor* previous = std::exchange(t_current, this);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this] { return !m_jobs.empty() || m_tasks == 0; });
+        if (m_jobs.empty()) {
+            break;
+        }
+        std::function<void()> job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+    std::exception_ptr error = std::exchange(m_error, nullptr);
+    lock.unlock();
+    t_current = previous;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+Executor* Executor::current() {
+    return t_current;
+}
+
+void Executor::task_finished(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (error && !m_error) {
+        m_error = error;
+    }
+    --m_tasks;
+}
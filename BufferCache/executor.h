@@ -0,0 +1,85 @@
+#pragma once
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+class Executor;
+
+// Coroutine type for work run by an Executor:
+//
+//     Task work(myBufferCache& cache) { auto* buf = co_await cache.getblk_async(1); ... }
+//     executor.spawn(work(cache));
+//
+// A task starts when the executor first runs it and frees itself when it
+// finishes. An exception escaping it is reported by Executor::run.
+class Task {
+public:
+    struct promise_type {
+        Executor* executor = nullptr;
+        std::exception_ptr error;
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() const noexcept {}
+        };
+
+        Task get_return_object() noexcept { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    Task(Task&& other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+    Task& operator=(Task&&) = delete;
+    ~Task();
+
+private:
+    friend class Executor;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_handle;  // Until spawned
+};
+
+// Runs tasks and other jobs one at a time on the thread that calls run().
+// post() may be called from any thread; I/O completions and buffer
+// releases use it to hand suspended getblk_async calls back.
+class Executor {
+public:
+    Executor() = default;
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Queue a task; it runs once run() gets to it
+    void spawn(Task task);
+    void post(std::function<void()> job);
+
+    // Run jobs until every spawned task has finished, then rethrow the
+    // first exception that escaped a task, if any
+    void run();
+
+    // The executor running on this thread, or nullptr outside run()
+    static Executor* current();
+
+private:
+    friend class Task;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::function<void()>> m_jobs;
+    size_t m_tasks = 0;  // Spawned and not finished
+    std::exception_ptr m_error;
+
+    void task_finished(std::exception_ptr error);
+};
+
+#endif // EXECUTOR_H
@@ -0,0 +1,494 @@
+#include "io_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <cerrno>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace {
+
+using Completion = IoEngine::Completion;
+
+// Calls the device from a pool of threads, one request per thread at a time
+class ThreadPoolIoEngine : public IoEngine {
+public:
+    ThreadPoolIoEngine(std::shared_ptr<BlockDevice> device, size_t threads);
+    ~ThreadPoolIoEngine() override;
+
+    const char* name() const override { return "thread pool"; }
+    void submit_read(uint64_t first_block, size_t count, char* const* data, Completion done) override;
+    void submit_write(uint64_t first_block, size_t count, const char* const* data, Completion done) override;
+    void drain() override;
+
+private:
+    struct Request {
+        bool write;
+        uint64_t first_block;
+        std::vector<char*> data;
+        Completion done;
+    };
+
+    std::shared_ptr<BlockDevice> m_device;
+    size_t m_depth;
+
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;  // Signalled when a request is queued
+    std::condition_variable m_done_cv;  // ... and when one completes
+    std::deque<Request> m_queue;
+    size_t m_in_flight = 0;             // Queued or running
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+
+    void submit(Request request);
+    void worker();
+};
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(std::shared_ptr<BlockDevice> device, size_t threads)
+    : m_device(std::move(device)), m_depth(threads) {
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&ThreadPoolIoEngine::worker, this);
+    }
+}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_work_cv.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ThreadPoolIoEngine::submit_read(uint64_t first_block, size_t count, char* const* data, Completion done) {
+    submit({ false, first_block, std::vector<char*>(data, data + count), std::move(done) });
+}
+
+void ThreadPoolIoEngine::submit_write(uint64_t first_block, size_t count, const char* const* data, Completion done) {
+    std::vector<char*> blocks(count);
+    for (size_t i = 0; i < count; ++i) {
+        blocks[i] = const_cast<char*>(data[i]);
+    }
+    submit({ true, first_block, std::move(blocks), std::move(done) });
+}
+
+void ThreadPoolIoEngine::submit(Request request) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this] { return m_in_flight < m_depth; });
+        m_in_flight++;
+        m_queue.push_back(std::move(request));
+    }
+    m_work_cv.notify_one();
+}
+
+void ThreadPoolIoEngine::drain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_in_flight == 0; });
+}
+
+void ThreadPoolIoEngine::worker() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        // Finish the queue before stopping
+        m_work_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty()) return;
+
+        Request request = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            if (request.write) {
+                m_device->write_blocks(request.first_block, request.data.size(), request.data.data());
+            }
+            else {
+                m_device->read_blocks(request.first_block, request.data.size(), request.data.data());
+            }
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        request.done(error);
+
+        lock.lock();
+        m_in_flight--;
+        m_done_cv.notify_all();
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int ring, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring, to_submit, min_complete, flags, nullptr, 0));
+}
+
+// Submits vectored reads and writes on the device's file descriptor through
+// an io_uring set up with raw system calls. Callers fill submission queue
+// entries under a mutex; one thread waits for and handles completions.
+class UringIoEngine : public IoEngine {
+public:
+    // nullptr if the kernel has no io_uring or does not allow it
+    static std::unique_ptr<IoEngine> open(std::shared_ptr<BlockDevice> device, int fd, size_t queue_depth);
+
+    ~UringIoEngine() override;
+
+    const char* name() const override { return "io_uring"; }
+    void submit_read(uint64_t first_block, size_t count, char* const* data, Completion done) override;
+    void submit_write(uint64_t first_block, size_t count, const char* const* data, Completion done) override;
+    void drain() override;
+
+private:
+    struct Request {
+        bool write;
+        uint64_t first_block;
+        std::vector<char*> data;
+        std::vector<iovec> iov;
+        size_t bytes;
+        Completion done;
+    };
+
+    std::shared_ptr<BlockDevice> m_device;
+    int m_fd;
+    size_t m_block_size;
+    unsigned m_depth = 0;
+
+    // The ring and its shared memory
+    int m_ring = -1;
+    void* m_sq_memory = MAP_FAILED;
+    size_t m_sq_memory_size = 0;
+    void* m_cq_memory = MAP_FAILED;
+    size_t m_cq_memory_size = 0;
+    io_uring_sqe* m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t m_sqes_size = 0;
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned* m_sq_mask = nullptr;
+    unsigned* m_sq_array = nullptr;
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned* m_cq_mask = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+
+    std::mutex m_mutex;
+    std::condition_variable m_done_cv;  // Signalled when a request completes
+    unsigned m_in_flight = 0;
+    std::thread m_reaper;
+
+    UringIoEngine(std::shared_ptr<BlockDevice> device, int fd)
+        : m_device(std::move(device)), m_fd(fd), m_block_size(m_device->block_size()) {}
+
+    bool setup(size_t queue_depth);
+    void unmap();
+    void submit(std::unique_ptr<Request> request, size_t offset);
+    void push_sqe(uint8_t opcode, const Request* request, size_t offset);
+    void reap();
+    void complete(Request* request, int result);
+};
+
+std::unique_ptr<IoEngine> UringIoEngine::open(std::shared_ptr<BlockDevice> device, int fd, size_t queue_depth) {
+    std::unique_ptr<UringIoEngine> engine(new UringIoEngine(std::move(device), fd));
+    if (!engine->setup(queue_depth)) {
+        return nullptr;
+    }
+    return engine;
+}
+
+bool UringIoEngine::setup(size_t queue_depth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    unsigned entries = static_cast<unsigned>(std::min<size_t>(queue_depth, 4096));
+    m_ring = io_uring_setup(entries, &params);
+    if (m_ring < 0) return false;
+
+    m_sq_memory_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_memory_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        m_sq_memory_size = m_cq_memory_size = std::max(m_sq_memory_size, m_cq_memory_size);
+    }
+
+    m_sq_memory = mmap(nullptr, m_sq_memory_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        m_ring, IORING_OFF_SQ_RING);
+    if (m_sq_memory == MAP_FAILED) {
+        unmap();
+        return false;
+    }
+    if (single_mmap) {
+        m_cq_memory = m_sq_memory;
+    }
+    else {
+        m_cq_memory = mmap(nullptr, m_cq_memory_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            m_ring, IORING_OFF_CQ_RING);
+        if (m_cq_memory == MAP_FAILED) {
+            unmap();
+            return false;
+        }
+    }
+    m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED) {
+        unmap();
+        return false;
+    }
+
+    char* sq = static_cast<char*>(m_sq_memory);
+    char* cq = static_cast<char*>(m_cq_memory);
+    m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // The completion queue is at least as large as the submission queue, so
+    // capping requests in flight at the latter means it never overflows
+    m_depth = params.sq_entries;
+    m_reaper = std::thread(&UringIoEngine::reap, this);
+    return true;
+}
+
+void UringIoEngine::unmap() {
+    if (m_sqes != MAP_FAILED) {
+        munmap(m_sqes, m_sqes_size);
+    }
+    if (m_cq_memory != MAP_FAILED && m_cq_memory != m_sq_memory) {
+        munmap(m_cq_memory, m_cq_memory_size);
+    }
+    if (m_sq_memory != MAP_FAILED) {
+        munmap(m_sq_memory, m_sq_memory_size);
+    }
+    if (m_ring >= 0) {
+        ::close(m_ring);
+    }
+    m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    m_sq_memory = m_cq_memory = MAP_FAILED;
+    m_ring = -1;
+}
+
+UringIoEngine::~UringIoEngine() {
+    if (m_reaper.joinable()) {
+        drain();
+
+        // A request without user data tells the reaper to stop
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            push_sqe(IORING_OP_NOP, nullptr, 0);
+        }
+        m_reaper.join();
+    }
+    unmap();
+}
+
+void UringIoEngine::submit_read(uint64_t first_block, size_t count, char* const* data, Completion done) {
+    if (first_block > static_cast<uint64_t>(INT64_MAX) / m_block_size) {
+        throw std::out_of_range("Block number is beyond the largest device offset");
+    }
+    auto request = std::make_unique<Request>(Request{ false, first_block,
+        std::vector<char*>(data, data + count), {}, count * m_block_size, std::move(done) });
+    for (char* block : request->data) {
+        request->iov.push_back({ block, m_block_size });
+    }
+    submit(std::move(request), static_cast<size_t>(first_block) * m_block_size);
+}
+
+void UringIoEngine::submit_write(uint64_t first_block, size_t count, const char* const* data, Completion done) {
+    if (first_block > static_cast<uint64_t>(INT64_MAX) / m_block_size) {
+        throw std::out_of_range("Block number is beyond the largest device offset");
+    }
+    auto request = std::make_unique<Request>(Request{ true, first_block,
+        std::vector<char*>(count), {}, count * m_block_size, std::move(done) });
+    for (size_t i = 0; i < count; ++i) {
+        request->data[i] = const_cast<char*>(data[i]);
+        request->iov.push_back({ request->data[i], m_block_size });
+    }
+    submit(std::move(request), static_cast<size_t>(first_block) * m_block_size);
+}
+
+void UringIoEngine::submit(std::unique_ptr<Request> request, size_t offset) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_in_flight < m_depth; });
+
+    // Counted before the kernel can complete it; if submission fails the
+    // request was never queued, so it stays ours and the count comes back
+    m_in_flight++;
+    try {
+        push_sqe(request->write ? IORING_OP_WRITEV : IORING_OP_READV, request.get(), offset);
+    }
+    catch (...) {
+        m_in_flight--;
+        m_done_cv.notify_all();
+        throw;
+    }
+    request.release();  // Owned by the ring until it completes
+}
+
+void UringIoEngine::push_sqe(uint8_t opcode, const Request* request, size_t offset) {
+    // Only submitters (holding m_mutex) move the tail
+    unsigned tail = std::atomic_ref<unsigned>(*m_sq_tail).load(std::memory_order_relaxed);
+    unsigned index = tail & *m_sq_mask;
+
+    io_uring_sqe& sqe = m_sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = opcode;
+    sqe.fd = m_fd;
+    if (request) {
+        sqe.off = offset;
+        sqe.addr = reinterpret_cast<uint64_t>(request->iov.data());
+        sqe.len = static_cast<uint32_t>(request->iov.size());
+    }
+    sqe.user_data = reinterpret_cast<uint64_t>(request);
+    m_sq_array[index] = index;
+    std::atomic_ref<unsigned>(*m_sq_tail).store(tail + 1, std::memory_order_release);
+
+    while (io_uring_enter(m_ring, 1, 0, 0) < 0) {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            int error = errno;
+            // Entries are submitted one at a time, so unless the kernel has
+            // consumed this one (it will complete), it is the only one
+            // pending and can be taken back before anyone else moves the tail
+            unsigned head = std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+            if (head == tail) {
+                std::atomic_ref<unsigned>(*m_sq_tail).store(tail, std::memory_order_release);
+                throw std::system_error(error, std::generic_category(), "io_uring submission failed");
+            }
+            return;
+        }
+    }
+}
+
+void UringIoEngine::drain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_in_flight == 0; });
+}
+
+void UringIoEngine::reap() {
+    while (true) {
+        if (io_uring_enter(m_ring, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            std::this_thread::yield();
+        }
+
+        unsigned head = std::atomic_ref<unsigned>(*m_cq_head).load(std::memory_order_relaxed);
+        unsigned tail = std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire);
+        bool stop = false;
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = m_cqes[head & *m_cq_mask];
+            auto* request = reinterpret_cast<Request*>(cqe.user_data);
+            int result = cqe.res;
+            std::atomic_ref<unsigned>(*m_cq_head).store(head + 1, std::memory_order_release);
+
+            if (request) {
+                complete(request, result);
+            }
+            else {
+                stop = true;
+            }
+        }
+        if (stop) return;
+    }
+}
+
+void UringIoEngine::complete(Request* raw, int result) {
+    std::unique_ptr<Request> request(raw);
+    std::exception_ptr error;
+
+    if (result < 0 && result != -EINTR && result != -EAGAIN) {
+        error = std::make_exception_ptr(std::system_error(-result, std::generic_category(),
+            request->write ? "Block device write failed" : "Block device read failed"));
+    }
+    else if (result < 0 || static_cast<size_t>(result) < request->bytes) {
+        // Interrupted, or a short read at the end of the file: let the
+        // device redo it, which retries and zero-fills as needed
+        try {
+            if (request->write) {
+                m_device->write_blocks(request->first_block, request->data.size(), request->data.data());
+            }
+            else {
+                m_device->read_blocks(request->first_block, request->data.size(), request->data.data());
+            }
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+    }
+    request->done(error);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_in_flight--;
+    m_done_cv.notify_all();
+}
+
+#endif // HAVE_IO_URING
+
+} // namespace
+
+std::unique_ptr<IoEngine> IoEngine::create(std::shared_ptr<BlockDevice> device, size_t queue_depth) {
+    if (!device) {
+        throw std::invalid_argument("I/O engine needs a device");
+    }
+    if (queue_depth == 0) {
+        throw std::invalid_argument("I/O queue depth must be greater than 0");
+    }
+
+#ifdef HAVE_IO_URING
+    if (auto* file = dynamic_cast<FileBlockDevice*>(device.get())) {
+        if (auto engine = UringIoEngine::open(device, file->fd(), queue_depth)) {
+            return engine;
+        }
+    }
+#endif
+    return std::make_unique<ThreadPoolIoEngine>(std::move(device), queue_depth);
+}
+
+IoEngine::Completion IoBatch::add() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending++;
+    }
+    return [this](std::exception_ptr error) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (error && !m_error) {
+            m_error = error;
+        }
+        if (--m_pending == 0) {
+            m_cv.notify_all();
+        }
+    };
+}
+
+void IoBatch::wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_pending == 0; });
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
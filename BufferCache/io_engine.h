@@ -0,0 +1,57 @@
+#pragma once
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include "block_device.h"
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Asynchronous block I/O for myBufferCache. Requests are queued and run in
+// the background; each one's completion is called on an engine thread with
+// nullptr or the exception the transfer raised. Completions may take locks
+// but must not wait for other requests of the same engine.
+class IoEngine {
+public:
+    using Completion = std::function<void(std::exception_ptr error)>;
+
+    virtual ~IoEngine() = default;
+
+    virtual const char* name() const = 0;
+
+    // Read or write count consecutive blocks starting at first_block, like
+    // BlockDevice::read_blocks and write_blocks. The pointer array is
+    // copied; the buffers must stay valid until the completion runs.
+    // Submission blocks while the queue is full. If it throws, the request
+    // was not queued and done is never called.
+    virtual void submit_read(uint64_t first_block, size_t count, char* const* data, Completion done) = 0;
+    virtual void submit_write(uint64_t first_block, size_t count, const char* const* data, Completion done) = 0;
+
+    // Wait until every request submitted so far has completed
+    virtual void drain() = 0;
+
+    // io_uring when device is a FileBlockDevice and the kernel allows it,
+    // otherwise queue_depth threads calling the device. Either way at most
+    // queue_depth requests are in flight.
+    static std::unique_ptr<IoEngine> create(std::shared_ptr<BlockDevice> device, size_t queue_depth);
+};
+
+// Waits for a group of requests: add() returns the completion for one
+// more request, wait() blocks until all of them have run and rethrows the
+// first error.
+class IoBatch {
+public:
+    IoEngine::Completion add();
+    void wait();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_pending = 0;
+    std::exception_ptr m_error;
+};
+
+#endif // IO_ENGINE_H
@@ -0,0 +1,447 @@
+#include "journal.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+const uint64_t HEADER_MAGIC = 0x32304C4E524A4342ull;      // "BCJRNL02"
+const uint64_t DESCRIPTOR_MAGIC = 0x3230435345444342ull;  // "BCDESC02"
+
+// Header block: magic, first sequence (0 for an empty log), block size,
+// checksum of the preceding fields
+const size_t HEADER_SIZE = 24;
+// Descriptor block: magic, sequence, count, checksum of the descriptor
+// with that field zeroed, then a block number and the checksum of its
+// data for each of the count data blocks that follow. Data checksums are
+// computed by the appending threads, not by the one writing the log.
+const size_t DESCRIPTOR_SIZE = 24;
+const size_t RECORD_SIZE = 12;
+
+// Logs are zero-filled this far ahead, so growing one costs a full sync
+// only every few thousand blocks
+const size_t EXTEND_BYTES = 4 * 1024 * 1024;
+// Blocks of zeros per write while extending
+const size_t EXTEND_RUN = 64;
+
+// Slicing-by-8 tables: tables[0][i] is the CRC of byte i, and tables[k][i]
+// that of byte i followed by k zero bytes
+using CrcTables = std::array<std::array<uint32_t, 256>, 8>;
+
+const CrcTables& crc_tables() {
+    static const CrcTables tables = [] {
+        CrcTables t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (size_t k = 1; k < 8; ++k) {
+                t[k][i] = t[0][t[k - 1][i] & 0xFF] ^ (t[k - 1][i] >> 8);
+            }
+        }
+        return t;
+    }();
+    return tables;
+}
+
+uint32_t load_le32(const char* p) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+}
+
+// CRC-32 (IEEE), continued from crc. Eight bytes a step: every record's
+// data is checksummed by the thread appending it.
+uint32_t crc32(uint32_t crc, const char* data, size_t size) {
+    const CrcTables& t = crc_tables();
+    crc = ~crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint32_t low = load_le32(data) ^ crc;
+        uint32_t high = load_le32(data + 4);
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24] ^
+            t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = t[0][(crc ^ static_cast<unsigned char>(*data)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+template <typename T>
+T load(const char* p) {
+    T value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+template <typename T>
+void store(char* p, T value) {
+    memcpy(p, &value, sizeof(value));
+}
+
+} // namespace
+
+Journal::Journal(std::shared_ptr<BlockDevice> first_log, std::shared_ptr<BlockDevice> second_log) {
+    if (!first_log || !second_log) {
+        throw std::invalid_argument("Journal needs two logs");
+    }
+    m_block_size = first_log->block_size();
+    if (m_block_size < 512 || second_log->block_size() != m_block_size) {
+        throw std::invalid_argument("Journal logs need the same block size, at least 512 bytes");
+    }
+    m_max_per_transaction = (m_block_size - DESCRIPTOR_SIZE) / RECORD_SIZE;
+    m_extend_blocks = std::max<size_t>(EXTEND_BYTES / m_block_size, 1);
+    m_logs[0].device = std::move(first_log);
+    m_logs[1].device = std::move(second_log);
+}
+
+size_t Journal::recover(BlockDevice& device) {
+    if (device.block_size() != m_block_size) {
+        throw std::invalid_argument("Journal block size must match the device");
+    }
+
+    // Transactions of both logs as (sequence, descriptor + data), replayed
+    // in sequence order so later images win
+    std::vector<std::pair<uint64_t, std::vector<char>>> transactions;
+    uint64_t next_sequence = 1;
+    for (Log& log : m_logs) {
+        next_sequence = std::max(next_sequence, scan(log, transactions));
+    }
+    std::sort(transactions.begin(), transactions.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    size_t replayed = 0;
+    for (const auto& [sequence, transaction] : transactions) {
+        uint32_t count = load<uint32_t>(transaction.data() + 16);
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t block_number = load<uint64_t>(transaction.data() + DESCRIPTOR_SIZE + i * RECORD_SIZE);
+            device.write_block(block_number, transaction.data() + (i + 1) * m_block_size);
+        }
+        replayed += count;
+    }
+    device.sync();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_next_sequence = std::max(m_next_sequence, next_sequence);
+    }
+    reset();
+    return replayed;
+}
+
+uint64_t Journal::scan(Log& log, std::vector<std::pair<uint64_t, std::vector<char>>>& transactions) {
+    std::vector<char> block(m_block_size);
+    log.device->read_block(0, block.data());
+    if (load<uint64_t>(block.data()) != HEADER_MAGIC ||
+        load<uint32_t>(block.data() + 16) != m_block_size ||
+        load<uint32_t>(block.data() + 20) != crc32(0, block.data(), HEADER_SIZE - sizeof(uint32_t))) {
+        return 0;
+    }
+    uint64_t sequence = load<uint64_t>(block.data() + 8);
+    if (sequence == 0) return 0;  // Empty
+
+    // Stop at the first transaction that is out of sequence or torn. What
+    // follows may be left from earlier use of the log, with lower sequence
+    // numbers than the header's.
+    uint64_t position = 1;
+    while (true) {
+        std::vector<char> transaction(m_block_size);
+        log.device->read_block(position, transaction.data());
+        uint32_t count = load<uint32_t>(transaction.data() + 16);
+        if (load<uint64_t>(transaction.data()) != DESCRIPTOR_MAGIC ||
+            load<uint64_t>(transaction.data() + 8) != sequence ||
+            count == 0 || count > m_max_per_transaction) {
+            break;
+        }
+
+        transaction.resize((count + 1) * m_block_size);
+        std::vector<char*> data(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            data[i] = transaction.data() + (i + 1) * m_block_size;
+        }
+        log.device->read_blocks(position + 1, count, data.data());
+
+        const char* descriptor = transaction.data();
+        uint32_t checksum = load<uint32_t>(descriptor + 20);
+        store<uint32_t>(transaction.data() + 20, 0);
+        bool intact = crc32(0, descriptor, DESCRIPTOR_SIZE + count * RECORD_SIZE) == checksum;
+        for (uint32_t i = 0; i < count && intact; ++i) {
+            const char* record = descriptor + DESCRIPTOR_SIZE + i * RECORD_SIZE;
+            intact = crc32(0, data[i], m_block_size) == load<uint32_t>(record + 8);
+        }
+        if (!intact) break;
+
+        transactions.emplace_back(sequence, std::move(transaction));
+        sequence++;
+        position += count + 1;
+    }
+    return sequence;
+}
+
+void Journal::reset() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_checkpointing) {
+        throw std::logic_error("Journal checkpoint in progress");
+    }
+    while (m_writing || m_syncing) {
+        (m_writing ? m_write_cv : m_cv).wait(lock);
+    }
+
+    // Empty the second log before starting the first one afresh. Both are
+    // given room for their first commits here, off the commit path.
+    extend(m_logs[1], m_extend_blocks);
+    write_header(m_logs[1], 0);
+    m_logs[1].device->sync();
+    extend(m_logs[0], m_extend_blocks);
+    write_header(m_logs[0], m_next_sequence);
+    m_logs[0].device->sync();
+    for (Log& log : m_logs) {
+        log.next_block = 1;
+        log.unsynced = false;
+        log.blocks.clear();
+    }
+    m_active = 0;
+}
+
+void Journal::extend(Log& log, uint64_t min_blocks) {
+    if (min_blocks <= log.allocated) return;
+    uint64_t target = (min_blocks + m_extend_blocks - 1) / m_extend_blocks * m_extend_blocks;
+
+    std::vector<char> zeros(m_block_size, 0);
+    std::vector<const char*> run(EXTEND_RUN, zeros.data());
+    for (uint64_t block = log.allocated; block < target; block += EXTEND_RUN) {
+        log.device->write_blocks(block, static_cast<size_t>(std::min<uint64_t>(EXTEND_RUN, target - block)),
+            run.data());
+    }
+    // A full sync, so the new size is durable too
+    log.device->sync();
+    log.allocated = target;
+}
+
+void Journal::write_header(Log& log, uint64_t first_sequence) {
+    std::vector<char> block(m_block_size, 0);
+    store<uint64_t>(block.data(), HEADER_MAGIC);
+    store<uint64_t>(block.data() + 8, first_sequence);
+    store<uint32_t>(block.data() + 16, static_cast<uint32_t>(m_block_size));
+    store<uint32_t>(block.data() + 20, crc32(0, block.data(), HEADER_SIZE - sizeof(uint32_t)));
+    log.device->write_block(0, block.data());
+}
+
+uint64_t Journal::append(uint64_t block_number, const char* data) {
+    uint32_t checksum = crc32(0, data, m_block_size);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t offset = m_pending_data.size();
+    m_pending_data.insert(m_pending_data.end(), data, data + m_block_size);
+    m_pending.push_back({ block_number, checksum, offset });
+    return ++m_appended;
+}
+
+void Journal::commit(uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_durable < ticket) {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+        if (m_claimed < ticket) {
+            // Still queued: written by the next write, this caller's if none
+            // is in progress
+            if (m_writing) {
+                m_write_cv.wait(lock);
+                continue;
+            }
+            write_batch(lock);
+        }
+        else if (m_written < ticket || m_syncing) {
+            // Its write finishes, or a sync that may not cover it does
+            m_cv.wait(lock);
+        }
+        else {
+            sync_batch(lock);
+        }
+    }
+}
+
+void Journal::write_batch(std::unique_lock<std::mutex>& lock) {
+    // Write everything queued so far, this caller's record included. The
+    // previous batch may still be syncing meanwhile.
+    m_writing = true;
+    std::vector<Pending> pending;
+    std::vector<char> data;
+    pending.swap(m_pending);
+    data.swap(m_pending_data);
+    uint64_t last = m_appended;
+    m_claimed = last;
+    uint64_t first_sequence = m_next_sequence;
+    m_next_sequence += (pending.size() + m_max_per_transaction - 1) / m_max_per_transaction;
+    Log& log = m_logs[m_active];
+    uint64_t position = log.next_block;
+    lock.unlock();
+
+    std::exception_ptr error;
+    size_t written = 0;
+    try {
+        written = write_pending(log, position, pending, data, first_sequence);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    lock.lock();
+    m_writing = false;
+    if (error) {
+        m_error = error;
+    }
+    else {
+        log.next_block = position + written;
+        log.unsynced = true;
+        m_written = last;
+        for (const Pending& record : pending) {
+            log.blocks.push_back(record.block_number);
+        }
+    }
+    // The records queued meanwhile can be written now. This batch is synced
+    // by this caller or, if a sync is running, once it finishes.
+    m_write_cv.notify_all();
+    if (error) {
+        m_cv.notify_all();
+    }
+}
+
+void Journal::sync_batch(std::unique_lock<std::mutex>& lock) {
+    // Both logs may hold unsynced records if a checkpoint switched between
+    // two writes
+    m_syncing = true;
+    uint64_t last = m_written;
+    Log* logs[2] = {};
+    for (size_t i = 0; i < 2; ++i) {
+        if (m_logs[i].unsynced) {
+            m_logs[i].unsynced = false;
+            logs[i] = &m_logs[i];
+        }
+    }
+    lock.unlock();
+
+    std::exception_ptr error;
+    try {
+        for (Log* log : logs) {
+            if (log) {
+                log->device->sync_data();
+            }
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    lock.lock();
+    m_syncing = false;
+    if (error) {
+        m_error = error;
+    }
+    else {
+        m_durable = std::max(m_durable, last);
+        m_commits++;
+    }
+    m_cv.notify_all();
+    if (error) {
+        m_write_cv.notify_all();
+    }
+}
+
+size_t Journal::write_pending(Log& log, uint64_t position, const std::vector<Pending>& pending,
+    const std::vector<char>& data, uint64_t first_sequence) {
+    if (pending.empty()) return 0;
+
+    size_t num_transactions = (pending.size() + m_max_per_transaction - 1) / m_max_per_transaction;
+    extend(log, position + num_transactions + pending.size());
+
+    std::vector<char> descriptors(num_transactions * m_block_size, 0);
+    std::vector<const char*> blocks;
+    blocks.reserve(num_transactions + pending.size());
+
+    for (size_t t = 0; t < num_transactions; ++t) {
+        size_t first = t * m_max_per_transaction;
+        size_t count = std::min(m_max_per_transaction, pending.size() - first);
+        char* descriptor = descriptors.data() + t * m_block_size;
+        store<uint64_t>(descriptor, DESCRIPTOR_MAGIC);
+        store<uint64_t>(descriptor + 8, first_sequence + t);
+        store<uint32_t>(descriptor + 16, static_cast<uint32_t>(count));
+        blocks.push_back(descriptor);
+        for (size_t i = 0; i < count; ++i) {
+            const Pending& record = pending[first + i];
+            store<uint64_t>(descriptor + DESCRIPTOR_SIZE + i * RECORD_SIZE, record.block_number);
+            store<uint32_t>(descriptor + DESCRIPTOR_SIZE + i * RECORD_SIZE + 8, record.checksum);
+            blocks.push_back(data.data() + record.offset);
+        }
+        store<uint32_t>(descriptor + 20, crc32(0, descriptor, DESCRIPTOR_SIZE + count * RECORD_SIZE));
+    }
+
+    log.device->write_blocks(position, blocks.size(), blocks.data());
+    return blocks.size();
+}
+
+size_t Journal::active_blocks() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_logs[m_active].next_block - 1;
+}
+
+std::vector<uint64_t> Journal::begin_checkpoint() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_checkpointing) {
+        throw std::logic_error("Journal checkpoint in progress");
+    }
+    m_write_cv.wait(lock, [this] { return !m_writing; });
+
+    // The other log was emptied by the previous checkpoint, and has room
+    // for its first commits unless reset was never called. Its new header
+    // becomes durable with the first of them.
+    Log& old_log = m_logs[m_active];
+    m_active ^= 1;
+    Log& new_log = m_logs[m_active];
+    extend(new_log, m_extend_blocks);
+    write_header(new_log, m_next_sequence);
+    new_log.next_block = 1;
+    new_log.blocks.clear();
+    m_checkpointing = true;
+
+    std::vector<uint64_t> blocks = std::move(old_log.blocks);
+    old_log.blocks.clear();
+    std::sort(blocks.begin(), blocks.end());
+    blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    return blocks;
+}
+
+void Journal::finish_checkpoint() {
+    Log* old_log;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_checkpointing) {
+            throw std::logic_error("No journal checkpoint in progress");
+        }
+        old_log = &m_logs[m_active ^ 1];
+    }
+
+    // Nobody else touches the old log until the checkpoint is over
+    write_header(*old_log, 0);
+    old_log->device->sync();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    old_log->next_block = 1;
+    m_checkpointing = false;
+}
+
+size_t Journal::records() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_appended;
+}
+
+size_t Journal::commits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_commits;
+}
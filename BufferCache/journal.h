@@ -0,0 +1,128 @@
+#pragma once
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "block_device.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Write-ahead log of block images for myBufferCache. Records are written
+// in transactions: a descriptor block listing the block numbers and a
+// checksum of each one's data, followed by the data blocks. Each log
+// device starts with a header block naming the sequence number of its
+// first transaction, and recovery replays the transactions that follow
+// in sequence with valid checksums, so a torn tail is ignored.
+//
+// Two logs are used in turn. A checkpoint switches new records to the
+// other log; once the blocks of the old one have been written home it is
+// marked empty and can be reused. Appending never waits for a checkpoint:
+// a log just grows until its turn comes.
+//
+// Logs are zero-filled ahead of use in large steps and synced with their
+// new size, so a commit only overwrites blocks the file already holds and
+// a data-only sync (fdatasync) makes it durable.
+class Journal {
+public:
+    // Both logs must have the same block size, at least 512 bytes
+    Journal(std::shared_ptr<BlockDevice> first_log, std::shared_ptr<BlockDevice> second_log);
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    size_t block_size() const { return m_block_size; }
+
+    // Write the blocks of every committed transaction to device, oldest
+    // first, sync it and empty both logs. Call before appending. Returns
+    // the number of block images replayed.
+    size_t recover(BlockDevice& device);
+
+    // Queue an image of a block (copied) and return a ticket for commit
+    uint64_t append(uint64_t block_number, const char* data);
+
+    // Return once the ticket's record and every one before it are durable.
+    // The first caller to find no write in progress writes all records
+    // queued so far; callers arriving meanwhile wait and are covered by the
+    // next such write (group commit). A caller whose record is written
+    // syncs the log unless a sync is running already, so one batch is
+    // written while the one before it is synced. Once a log write or sync
+    // has failed every commit throws its error.
+    void commit(uint64_t ticket);
+
+    // Block images written to the active log
+    size_t active_blocks() const;
+
+    // Switch new records to the other log and return the distinct blocks
+    // recorded in the old one, sorted. Their current contents must reach
+    // the home device, and be synced there, before finish_checkpoint. Only
+    // one checkpoint may be in progress.
+    std::vector<uint64_t> begin_checkpoint();
+    void finish_checkpoint();
+
+    // Mark both logs empty, once every logged block is home
+    void reset();
+
+    size_t records() const;  // Block images appended
+    size_t commits() const;  // Log syncs
+
+private:
+    struct Log {
+        std::shared_ptr<BlockDevice> device;
+        uint64_t next_block = 1;    // Where the next transaction goes
+        uint64_t allocated = 1;     // Blocks zero-filled and synced, header included
+        bool unsynced = false;      // Written to since the last sync
+        std::vector<uint64_t> blocks;  // Recorded since the header was written
+    };
+
+    struct Pending {
+        uint64_t block_number;
+        uint32_t checksum;  // Of the data
+        size_t offset;      // Into m_pending_data
+    };
+
+    size_t m_block_size;
+    size_t m_max_per_transaction;  // Block numbers a descriptor can hold
+    size_t m_extend_blocks;        // Step a log is zero-filled ahead in
+    Log m_logs[2];
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_write_cv;  // Signalled when a log write finishes
+    std::condition_variable m_cv;        // ... and when a log sync does
+    size_t m_active = 0;
+    uint64_t m_next_sequence = 1;  // Of the next transaction
+    std::vector<Pending> m_pending;
+    std::vector<char> m_pending_data;
+    uint64_t m_appended = 0;       // Tickets handed out
+    uint64_t m_claimed = 0;        // Tickets taken by a write, finished or not
+    uint64_t m_written = 0;        // Tickets covered by a finished write
+    uint64_t m_durable = 0;        // Tickets covered by a synced write
+    bool m_writing = false;
+    bool m_syncing = false;
+    bool m_checkpointing = false;
+    std::exception_ptr m_error;
+    size_t m_commits = 0;
+
+    void write_header(Log& log, uint64_t first_sequence);
+    // Zero-fill the log to hold at least min_blocks, rounded up to a whole
+    // number of steps, and sync it. Only while nobody else writes the log.
+    void extend(Log& log, uint64_t min_blocks);
+    // The two stages of commit, entered and left with the lock held: write
+    // the queued records to the active log, or sync the logs written to
+    void write_batch(std::unique_lock<std::mutex>& lock);
+    void sync_batch(std::unique_lock<std::mutex>& lock);
+    // Write pending as transactions starting at block position of the log,
+    // extending it first if they don't fit; returns the number of blocks
+    // written. The log is not synced.
+    size_t write_pending(Log& log, uint64_t position, const std::vector<Pending>& pending,
+        const std::vector<char>& data, uint64_t first_sequence);
+    // Add the log's transactions to transactions and return the sequence
+    // number that follows them, 0 if the log is empty. Sequence numbers
+    // continue from the highest one found, so leftovers can't be replayed.
+    uint64_t scan(Log& log, std::vector<std::pair<uint64_t, std::vector<char>>>& transactions);
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,201 @@
+#include "lz_codec.h"
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+const size_t MAX_INPUT = 64 * 1024;
+const size_t MIN_MATCH = 4;
+// The format ends every input with at least LAST_LITERALS literals, and
+// no match may start within MATCH_LIMIT bytes of the end
+const size_t LAST_LITERALS = 5;
+const size_t MATCH_LIMIT = 12;
+const int HASH_BITS = 12;
+
+uint32_t load32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint64_t load64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// 255-byte continuation of a token's length field
+size_t put_length(unsigned char* out, size_t op, size_t length) {
+    while (length >= 255) {
+        out[op++] = 255;
+        length -= 255;
+    }
+    out[op++] = static_cast<unsigned char>(length);
+    return op;
+}
+
+// Append a sequence: literals, then a match unless match_length is 0.
+// in_end bounds the input the literals come from.
+bool emit(unsigned char* out, size_t& op, size_t capacity, const unsigned char* literals,
+    size_t literal_length, const unsigned char* in_end, size_t offset, size_t match_length) {
+    size_t needed = 1 + literal_length / 255 + 1 + literal_length;
+    if (match_length) {
+        needed += 2 + (match_length - MIN_MATCH) / 255 + 1;
+    }
+    if (op + needed > capacity) return false;
+
+    size_t token = op++;
+    out[token] = static_cast<unsigned char>((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15) {
+        op = put_length(out, op, literal_length - 15);
+    }
+    if (literal_length <= 16 && capacity - op >= 16 && in_end - literals >= 16) {
+        memcpy(out + op, literals, 16);  // Overrun is rewritten by what follows
+    }
+    else {
+        memcpy(out + op, literals, literal_length);
+    }
+    op += literal_length;
+    if (!match_length) return true;
+
+    out[op++] = static_cast<unsigned char>(offset);
+    out[op++] = static_cast<unsigned char>(offset >> 8);
+    size_t extra = match_length - MIN_MATCH;
+    out[token] |= static_cast<unsigned char>(extra >= 15 ? 15 : extra);
+    if (extra >= 15) {
+        op = put_length(out, op, extra - 15);
+    }
+    return true;
+}
+
+// Read a 255-byte continuation; false if the input ends first
+bool get_length(const unsigned char* in, size_t size, size_t& ip, size_t& length) {
+    unsigned char byte;
+    do {
+        if (ip >= size) return false;
+        byte = in[ip++];
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+} // namespace
+
+size_t lz_compress(const char* src, size_t size, char* dst, size_t capacity) {
+    if (size > MAX_INPUT) return 0;
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+    unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+    size_t op = 0;
+    size_t anchor = 0;  // Start of the pending literals
+
+    // Shorter inputs are all literals
+    if (size > MATCH_LIMIT) {
+        // Last position of each hashed 4-byte sequence. 0 doubles as empty;
+        // candidates are compared anyway.
+        uint16_t table[1 << HASH_BITS] = {};
+        size_t match_start_limit = size - MATCH_LIMIT;
+        size_t match_end_limit = size - LAST_LITERALS;
+
+        size_t ip = 1;
+        while (ip < match_start_limit) {
+            uint32_t sequence = load32(in + ip);
+            uint32_t h = hash4(sequence);
+            size_t ref = table[h];
+            table[h] = static_cast<uint16_t>(ip);
+            if (load32(in + ref) != sequence) {
+                // Step faster the longer nothing has matched
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            // Extend the match a word at a time, then byte by byte
+            size_t length = MIN_MATCH;
+            if constexpr (std::endian::native == std::endian::little) {
+                while (ip + length + 8 <= match_end_limit) {
+                    uint64_t diff = load64(in + ip + length) ^ load64(in + ref + length);
+                    if (diff) {
+                        length += static_cast<size_t>(std::countr_zero(diff)) / 8;
+                        break;
+                    }
+                    length += 8;
+                }
+            }
+            while (ip + length < match_end_limit && in[ip + length] == in[ref + length]) {
+                length++;
+            }
+            if (!emit(out, op, capacity, in + anchor, ip - anchor, in + size, ip - ref, length)) return 0;
+
+            ip += length;
+            anchor = ip;
+            if (ip < match_start_limit) {
+                table[hash4(load32(in + ip - 2))] = static_cast<uint16_t>(ip - 2);
+            }
+        }
+    }
+
+    if (!emit(out, op, capacity, in + anchor, size - anchor, in + size, 0, 0)) return 0;
+    return op;
+}
+
+bool lz_decompress(const char* src, size_t size, char* dst, size_t dst_size) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(src);
+    unsigned char* out = reinterpret_cast<unsigned char*>(dst);
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < size) {
+        unsigned token = in[ip++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(in, size, ip, literal_length)) return false;
+        if (literal_length > size - ip || literal_length > dst_size - op) return false;
+        if (literal_length <= 16 && size - ip >= 16 && dst_size - op >= 16) {
+            memcpy(out + op, in + ip, 16);  // Fixed size, so it compiles to two moves
+        }
+        else {
+            memcpy(out + op, in + ip, literal_length);
+        }
+        ip += literal_length;
+        op += literal_length;
+        if (ip == size) break;  // The last sequence has no match
+
+        if (size - ip < 2) return false;
+        size_t offset = in[ip] | static_cast<size_t>(in[ip + 1]) << 8;
+        ip += 2;
+        if (offset == 0 || offset > op) return false;
+
+        size_t match_length = token & 15;
+        if (match_length == 15 && !get_length(in, size, ip, match_length)) return false;
+        match_length += MIN_MATCH;
+        if (match_length > dst_size - op) return false;
+
+        // Copy in words where the output has room for the overrun; a match
+        // at least a word back reads only bytes already written. Closer
+        // overlapping matches repeat the bytes just written one by one.
+        const unsigned char* match = out + op - offset;
+        if (offset >= 8 && dst_size - op >= match_length + 8) {
+            for (size_t i = 0; i < match_length; i += 8) {
+                memcpy(out + op + i, match + i, 8);
+            }
+        }
+        else if (offset >= match_length) {
+            memcpy(out + op, match, match_length);
+        }
+        else {
+            for (size_t i = 0; i < match_length; ++i) {
+                out[op + i] = match[i];
+            }
+        }
+        op += match_length;
+    }
+    return op == dst_size;
+}
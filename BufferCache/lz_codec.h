@@ -0,0 +1,20 @@
+#pragma once
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+#include <cstddef>
+
+// Byte-oriented LZ77 block codec in the LZ4 block format: sequences of a
+// token, literals and a 16-bit back reference, with no entropy coding, so
+// both directions run at memory speed. Inputs are limited to 64 KB, one
+// cache block, which keeps every offset within 16 bits.
+
+// Compress size bytes of src into dst. Returns the compressed size, or 0
+// if it would exceed capacity; callers then keep the block uncompressed.
+size_t lz_compress(const char* src, size_t size, char* dst, size_t capacity);
+
+// Decompress size bytes of src, which must expand to exactly dst_size
+// bytes. Returns false, with dst partly written, on malformed input.
+bool lz_decompress(const char* src, size_t size, char* dst, size_t dst_size);
+
+#endif // LZ_CODEC_H
@@ -1,23 +1,22 @@
 #include "my_buffer_cache.h"
 #include <thread>
 #include <vector>
+#include <exception>
 #include <iostream>
 
 void worker_thread(myBufferCache& cache, int thread_id) {
     for (int i = 0; i < 5; ++i) {
         int block_num = thread_id * 10 + i;
 
-        // Get buffer from cache
+        // Get buffer from cache (waits if another thread holds it)
         auto* buf = cache.getblk(block_num);
 
-        if (buf) {
-            // Simulate work with the buffer
-            std::cout << "Thread " << thread_id << " working with block "
-                << block_num << std::endl;
+        // Simulate work with the buffer. Nothing is printed here: the cache
+        // records the access in its trace instead.
+        buf->data[0] = static_cast<char>(thread_id);
 
-            // Modify the buffer (mark as dirty)
-            cache.brelse(buf, true);
-        }
+        // Modify the buffer (mark as dirty)
+        cache.brelse(buf, true);
     }
 }
 
@@ -25,7 +24,9 @@ int main() {
     const size_t CACHE_SIZE = 5;
     const int NUM_THREADS = 3;
 
-    myBufferCache cache(CACHE_SIZE);
+    myBufferCache::Options options;
+    options.trace = true;
+    myBufferCache cache(CACHE_SIZE, options);
     std::vector<std::thread> threads;
 
     // Create worker threads
@@ -47,6 +48,16 @@ int main() {
     std::cout << "  Hits: " << cache.hits() << "\n";
     std::cout << "  Misses: " << cache.misses() << "\n";
     std::cout << "  Disk writes: " << cache.disk_writes() << "\n";
+    std::cout << "  Waits for a free buffer: " << cache.free_buffer_waits() << "\n";
+
+    // Decode with: BufferCacheTraceDump buffercache.trace
+    try {
+        cache.dump_trace("buffercache.trace");
+        std::cout << "  Event trace: buffercache.trace\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "memory_pressure.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace {
+
+#ifndef _WIN32
+// A cgroup v2 file holding one number, or SIZE_MAX for "max" or none
+size_t read_cgroup_value(const std::string& path) {
+    std::ifstream in(path);
+    std::string text;
+    if (!(in >> text) || text == "max") return SIZE_MAX;
+    try {
+        return static_cast<size_t>(std::stoull(text));
+    }
+    catch (const std::exception&) {
+        return SIZE_MAX;
+    }
+}
+
+// What is left below the limit of this process's cgroup (v2 only)
+size_t cgroup_available() {
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 3, "0::") != 0) continue;
+        std::string dir = "/sys/fs/cgroup" + line.substr(3);
+        size_t limit = read_cgroup_value(dir + "/memory.max");
+        size_t current = read_cgroup_value(dir + "/memory.current");
+        if (limit == SIZE_MAX || current == SIZE_MAX) return SIZE_MAX;
+        return limit > current ? limit - current : 0;
+    }
+    return SIZE_MAX;
+}
+
+size_t meminfo_available() {
+    std::ifstream in("/proc/meminfo");
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        size_t kilobytes = 0;
+        if (fields >> key >> kilobytes && key == "MemAvailable:") {
+            return kilobytes * 1024;
+        }
+    }
+    return SIZE_MAX;
+}
+#endif
+
+} // namespace
+
+size_t available_memory() {
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status)) return SIZE_MAX;
+    return static_cast<size_t>(status.ullAvailPhys);
+#else
+    return std::min(meminfo_available(), cgroup_available());
+#endif
+}
+
+std::function<size_t(size_t)> fixed_memory_budget(size_t limit_bytes) {
+    return [limit_bytes](size_t) { return limit_bytes; };
+}
+
+std::function<size_t(size_t)> free_memory_budget(size_t min_free_bytes, size_t limit_bytes) {
+    return [min_free_bytes, limit_bytes](size_t current_bytes) {
+        size_t available = available_memory();
+        size_t budget;
+        if (available == SIZE_MAX) {
+            budget = current_bytes;  // Nothing to go by
+        }
+        else if (available >= min_free_bytes) {
+            budget = current_bytes + (available - min_free_bytes);
+        }
+        else {
+            size_t shortfall = min_free_bytes - available;
+            budget = current_bytes > shortfall ? current_bytes - shortfall : 0;
+        }
+        return limit_bytes ? std::min(budget, limit_bytes) : budget;
+    };
+}
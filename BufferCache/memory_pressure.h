@@ -0,0 +1,25 @@
+#pragma once
+#ifndef MEMORY_PRESSURE_H
+#define MEMORY_PRESSURE_H
+
+#include <cstddef>
+#include <functional>
+
+// Memory budgets for myBufferCache::Options::memory_budget. A budget is
+// called with the bytes the cache's blocks take now and returns the bytes
+// they may take.
+
+// Bytes the system could give this process now: MemAvailable, or what is
+// left below the memory.max of the process's cgroup if that is less
+// (Linux), or the available physical memory (Windows). SIZE_MAX if unknown.
+size_t available_memory();
+
+// Always limit_bytes, for a configured limit
+std::function<size_t(size_t)> fixed_memory_budget(size_t limit_bytes);
+
+// Grows the cache into available memory while more than min_free_bytes
+// stay available, and shrinks it by the shortfall when fewer do, never
+// beyond limit_bytes (0: no limit)
+std::function<size_t(size_t)> free_memory_budget(size_t min_free_bytes, size_t limit_bytes = 0);
+
+#endif // MEMORY_PRESSURE_H
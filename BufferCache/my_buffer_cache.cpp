@@ -1,154 +1,2358 @@
 #include "my_buffer_cache.h"
 #include <algorithm>
 #include <cstring>
-#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <cstdint>
+#include <stdexcept>
 
-myBufferCache::myBufferCache(size_t cache_size)
-    : m_capacity(cache_size), m_buffers(cache_size) {
+namespace {
+
+using Buffer = myBufferCache::Buffer;
+using LockMode = myBufferCache::LockMode;
+
+using Clock = std::chrono::steady_clock;
+
+// How often an allocation retries when its victim gets pinned under it
+const int MAX_VICTIM_ATTEMPTS = 4;
+
+// getblk_many batches up to this size are checked for duplicates pairwise
+const size_t SMALL_BATCH = 16;
+
+// bsync pins at most this many dirty buffers of a shard at a time
+const size_t SYNC_BATCH = 256;
+
+// Longest run of blocks merged into one vectored write; well under IOV_MAX
+const size_t MAX_WRITE_RUN = 256;
+
+// Warm restart: saved blocks are loaded in groups of WARM_BATCH, hottest
+// group first and each sorted, reading up to MAX_WARM_RUN consecutive
+// blocks at a time, with up to WARM_IN_FLIGHT reads queued on the I/O
+// engine. While getblk is reading the device the loader keeps one read
+// queued, or without an engine waits, checking every WARM_POLL, but no
+// longer than WARM_MAX_DEFER so it can't starve.
+const size_t WARM_BATCH = 1024;
+const size_t MAX_WARM_RUN = 64;
+const size_t WARM_IN_FLIGHT = 8;
+const auto WARM_POLL = std::chrono::microseconds(100);
+const auto WARM_MAX_DEFER = std::chrono::milliseconds(1);
+
+// resize() retires at most SHRINK_BATCH buffers of a shard per lock hold,
+// and waits SHRINK_RETRY before looking again at buffers that were pinned
+const size_t SHRINK_BATCH = 64;
+const auto SHRINK_RETRY = std::chrono::milliseconds(1);
+
+// The memory-pressure thread ignores budgets within 1/MEMORY_HYSTERESIS of
+// the current size
+const size_t MEMORY_HYSTERESIS = 32;
+
+// Warm-set file: magic, block size and block count, then the block keys
+// as 64-bit integers in native byte order
+const char WARM_MAGIC[8] = { 'B', 'C', 'W', 'A', 'R', 'M', '0', '2' };
+
+// Statistics stripe of the calling thread, assigned round-robin
+std::atomic<unsigned> g_next_stats_stripe{ 0 };
+thread_local unsigned t_stats_stripe = g_next_stats_stripe.fetch_add(1, std::memory_order_relaxed);
+
+// Hits seen by the calling thread, to pick which ones get timed
+thread_local unsigned t_hit_tick = 0;
+
+uint64_t elapsed_ns(Clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+uint8_t trace_flags(LockMode mode) {
+    return mode == LockMode::Exclusive ? TRACE_EXCLUSIVE : 0;
+}
+
+uint32_t trace_duration(uint64_t ns) {
+    return ns > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ns);
+}
+
+uint32_t pinned_state(LockMode mode) {
+    return 1 | (mode == LockMode::Exclusive ? Buffer::EXCLUSIVE : 0);
+}
+
+bool can_pin(uint32_t state, LockMode mode) {
+    if (mode == LockMode::Exclusive) {
+        return state == 0;
+    }
+    return (state & (Buffer::EXCLUSIVE | Buffer::FROZEN)) == 0 && (state & Buffer::PIN_MASK) != Buffer::PIN_MASK;
+}
+
+// Pin without the shard lock; fails if another holder conflicts or the
+// buffer is being loaded or evicted
+bool try_pin(Buffer* buffer, LockMode mode) {
+    uint32_t state = buffer->state.load();
+    while (can_pin(state, mode)) {
+        uint32_t next = mode == LockMode::Exclusive ? pinned_state(mode) : state + 1;
+        if (buffer->state.compare_exchange_weak(state, next)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drop one pin; returns true if it was the last one
+bool unpin(Buffer* buffer) {
+    uint32_t state = buffer->state.load();
+    uint32_t next;
+    do {
+        if ((state & Buffer::PIN_MASK) == 0) return false;
+        next = state - 1;
+        if ((next & Buffer::PIN_MASK) == 0) {
+            next &= ~Buffer::EXCLUSIVE;
+        }
+    } while (!buffer->state.compare_exchange_weak(state, next));
+    return (next & Buffer::PIN_MASK) == 0;
+}
+
+// Buffers of shard i when total are split over num_shards; the first
+// shards take the remainder
+size_t shard_share(size_t total, size_t num_shards, size_t i) {
+    return total / num_shards + (i < total % num_shards ? 1 : 0);
+}
+
+// Whether block is the one after a run of n blocks from first on the same
+// device, so the run can grow by it
+bool continues_run(uint64_t block, uint64_t first, size_t n) {
+    return block == first + n && key_device(block) == key_device(first);
+}
+
+// Frozen and holding no block: out of use until resize() grows the cache
+bool retired(const Buffer* buffer) {
+    return buffer->block_number == NO_BLOCK && buffer->state.load() == Buffer::FROZEN;
+}
+
+// Counts a device read on behalf of getblk or read-ahead while it runs,
+// for the warm-restart loader to give way to
+class ForegroundRead {
+public:
+    explicit ForegroundRead(std::atomic<int>& reads) : m_reads(reads) {
+        m_reads.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~ForegroundRead() {
+        m_reads.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    ForegroundRead(const ForegroundRead&) = delete;
+    ForegroundRead& operator=(const ForegroundRead&) = delete;
+
+private:
+    std::atomic<int>& m_reads;
+};
+
+// Block keys saved by save_warm_set; none if the file is missing or was
+// written for another block size
+std::vector<uint64_t> read_warm_set(const std::string& path, size_t block_size) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return {};
+
+    char magic[sizeof(WARM_MAGIC)];
+    uint32_t saved_block_size = 0;
+    uint32_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&saved_block_size), sizeof(saved_block_size));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || memcmp(magic, WARM_MAGIC, sizeof(magic)) != 0 || saved_block_size != block_size) {
+        return {};
+    }
+
+    std::vector<uint64_t> blocks(count);
+    in.read(reinterpret_cast<char*>(blocks.data()), static_cast<std::streamsize>(count * sizeof(uint64_t)));
+    blocks.resize(static_cast<size_t>(in.gcount()) / sizeof(uint64_t));
+    return blocks;
+}
+
+} // namespace
+
+myBufferCache::myBufferCache(size_t cache_size, size_t num_shards)
+    : myBufferCache(cache_size, Options{ num_shards, nullptr }) {
+}
+
+myBufferCache::myBufferCache(size_t cache_size, const Options& options)
+    : m_capacity(cache_size), m_options(options) {
+    size_t num_shards = options.num_shards;
     if (cache_size == 0) {
         throw std::invalid_argument("Cache size must be greater than 0");
     }
+    if (num_shards == 0 || num_shards > cache_size) {
+        throw std::invalid_argument("Shard count must be between 1 and the cache size");
+    }
+    size_t max_size = options.max_cache_size ? options.max_cache_size : cache_size;
+    if (max_size < cache_size || max_size > UINT32_MAX - 1) {
+        throw std::invalid_argument("Maximum cache size must be at least the cache size");
+    }
+    size_t block_size = options.block_size;
+    if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE || (block_size & (block_size - 1)) != 0) {
+        throw std::invalid_argument("Block size must be a power of two between 512 bytes and 64 KB");
+    }
+    std::vector<std::shared_ptr<BlockDevice>> devices{ options.device };
+    if (!devices[0]) {
+        devices[0] = std::make_shared<MemoryBlockDevice>(block_size);
+    }
+    devices.insert(devices.end(), options.devices.begin(), options.devices.end());
+    for (const auto& device : devices) {
+        if (device && device->block_size() != block_size) {
+            throw std::invalid_argument("Device block size must match the cache block size");
+        }
+    }
+    m_device = std::make_shared<DeviceSet>(std::move(devices));
+    if (!options.journal_path.empty() && options.journal_checkpoint_blocks == 0) {
+        throw std::invalid_argument("Journal checkpoint size must be greater than 0");
+    }
+    if (options.readahead_min_window == 0 || options.readahead_max_window < options.readahead_min_window) {
+        throw std::invalid_argument("Read-ahead window bounds are invalid");
+    }
+    if (options.flush_dirty_ratio < 0 || options.throttle_dirty_ratio < options.flush_dirty_ratio) {
+        throw std::invalid_argument("Dirty ratio thresholds are invalid");
+    }
+    m_arena = std::make_unique<BufferArena>(block_size, max_size, options.huge_pages);
+    m_buffers = std::vector<Buffer>(max_size);
+    for (size_t i = 0; i < max_size; ++i) {
+        m_buffers[i].data = m_arena->block(i);
+    }
+    m_stats = std::make_unique<StatsStripe[]>(NUM_STAT_STRIPES);
+    if (options.trace) {
+        m_trace = std::make_unique<TraceRing>(options.trace_events_per_thread);
+    }
+    if (options.async_io) {
+        for (size_t i = 0; i < m_device->size(); ++i) {
+            m_io.push_back(IoEngine::create(m_device->device(static_cast<uint32_t>(i)), options.io_queue_depth));
+        }
+    }
+    if (options.compressed_tier_bytes > 0) {
+        m_tier = std::make_unique<CompressedTier>(options.compressed_tier_bytes, block_size, num_shards);
+    }
+
+    // Split the buffers as evenly as possible, each shard's range leaving
+    // room for its share of the maximum size
+    Buffer* next = m_buffers.data();
+    m_shards.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+        size_t count = shard_share(cache_size, num_shards, i);
+        size_t reserved = shard_share(max_size, num_shards, i);
+        auto shard = std::make_unique<Shard>(reserved);
+        shard->buffers_begin = next;
+        shard->buffers_end = shard->retire_from = next + count;
+        shard->buffers_limit = next + reserved;
+        next += reserved;
+
+        // Hand out buffers from the front of the range first
+        shard->free_list.reserve(reserved);
+        for (Buffer* buf = shard->buffers_end; buf != shard->buffers_begin; ) {
+            shard->free_list.push_back(--buf);
+        }
+        shard->policy = ReplacementPolicy::create(options.policy, count, reserved);
+        m_arena->release(shard->buffers_end - m_buffers.data(), reserved - count);
+
+        m_shards.push_back(std::move(shard));
+    }
+
+    if (options.readahead) {
+        m_streams = std::make_unique<Stream[]>(NUM_STREAMS);
+    }
+
+    // Bring the device up to date before anything is read from it. Only
+    // now that nothing else can fail: a rejected option must leave the
+    // device and the logs untouched.
+    if (!options.journal_path.empty()) {
+        m_journal = std::make_unique<Journal>(
+            std::make_shared<FileBlockDevice>(options.journal_path + ".0", block_size),
+            std::make_shared<FileBlockDevice>(options.journal_path + ".1", block_size));
+        m_recovered_blocks = m_journal->recover(*m_device);
+    }
+
+    if (options.background_flush) {
+        set_thresholds(cache_size);
+        m_flush_thread = std::thread(&myBufferCache::flusher_worker, this);
+    }
+
+    if (m_journal) {
+        m_checkpoint_thread = std::thread(&myBufferCache::checkpoint_worker, this);
+    }
+
+    if (!options.warm_path.empty()) {
+        m_warming = true;
+        m_warm_thread = std::thread(&myBufferCache::warm_worker, this);
+    }
+
+    if (options.memory_budget) {
+        m_memory_thread = std::thread(&myBufferCache::memory_worker, this);
+    }
+}
+
+myBufferCache::~myBufferCache() {
+    {
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+        m_memory_stop = true;
+    }
+    m_memory_cv.notify_all();
+    if (m_memory_thread.joinable()) {
+        m_memory_thread.join();
+    }
+
+    m_warm_stop = true;
+    if (m_warm_thread.joinable()) {
+        m_warm_thread.join();
+    }
+    if (!m_options.warm_path.empty()) {
+        try {
+            save_warm_set(m_options.warm_path);
+        }
+        catch (const std::exception&) {
+            // The next start is only slower
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_flush_mutex);
+        m_flush_stop = true;
+    }
+    m_flush_cv.notify_all();
+    m_throttle_cv.notify_all();
+    if (m_flush_thread.joinable()) {
+        m_flush_thread.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_readahead_mutex);
+        m_readahead_stop = true;
+    }
+    m_readahead_cv.notify_all();
+    if (m_readahead_thread.joinable()) {
+        m_readahead_thread.join();
+    }
+    for (auto& io : m_io) {
+        io->drain();  // Queued read-ahead
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_checkpoint_mutex);
+        m_checkpoint_stop = true;
+    }
+    m_checkpoint_cv.notify_all();
+    if (m_checkpoint_thread.joinable()) {
+        m_checkpoint_thread.join();
+    }
+
+    bsync(); // Ensure all dirty buffers are written to disk
+
+    // Everything logged is home now, an unfinished checkpoint's blocks included
+    if (m_journal) {
+        if (m_checkpoint_started) {
+            m_journal->finish_checkpoint();
+        }
+        m_journal->reset();
+    }
+}
+
+size_t myBufferCache::shard_index(uint64_t block_number) const {
+    if (m_shards.size() == 1) {
+        return 0;
+    }
+
+    // Fibonacci hashing spreads runs of consecutive blocks over all shards;
+    // the key is folded first so the device bits take part
+    uint64_t hash = (block_number ^ block_number >> 32) * 0x9E3779B97F4A7C15ull;
+    return (hash >> 32) % m_shards.size();
+}
+
+myBufferCache::Buffer* myBufferCache::getblk(uint64_t block_number, LockMode mode) {
+    if (m_streams) {
+        note_access(block_number);
+    }
+    return get_buffer(block_number, mode);
+}
+
+myBufferCache::Buffer* myBufferCache::get_buffer(uint64_t block_number, LockMode mode) {
+    Shard& shard = shard_for(block_number);
+    if (Buffer* buf = get_cached(shard, block_number, mode)) {
+        return buf;
+    }
+
+    // Misses are always timed, hits through the lock like the others
+    bool sampled = t_hit_tick % HIT_SAMPLE_INTERVAL == 0;
+    Clock::time_point start = Clock::now();
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    bool waited_for_lock = false;
+    bool waited_for_free = false;
+
+    while (true) {
+        // Check if block is already in cache
+        if (Buffer* buf = find_buffer(shard, block_number)) {
+            if (!try_pin(buf, mode)) {
+                if (!waited_for_lock) {
+                    waited_for_lock = true;
+                    count(LOCK_WAITS);
+                }
+                // The buffer may be evicted while we sleep, so look it up again
+                wait_for_release(shard, lock, buf, mode);
+                continue;
+            }
+
+            count(HITS);
+            if (buf->readahead.exchange(false)) {
+                count(READAHEAD_HITS);
+            }
+            shard.policy->on_hit(buf);
+            if (sampled) {
+                local_stats().hit_latency.record(elapsed_ns(start));
+            }
+            if (m_trace) {
+                m_trace->record(TraceEventType::GetblkHit, block_number, trace_flags(mode));
+            }
+            return buf;
+        }
+
+        if (Buffer* buf = claim_buffer(shard, lock, block_number)) {
+            // Read with the lock released; callers asking for the same block
+            // wait on the frozen buffer meanwhile
+            lock.unlock();
+            bool from_tier = false;
+            try {
+                from_tier = load_from_tier(block_number, buf->data);
+                if (!from_tier) {
+                    read_from_disk(block_number, *buf);
+                }
+            }
+            catch (...) {
+                lock.lock();
+                abandon_buffer(shard, buf);
+                throw;
+            }
+            buf->valid = true;
+            buf->state.store(pinned_state(mode));
+            if (shard.waiters > 0) {
+                lock.lock();
+                wake_waiters(shard);
+            }
+
+            count(MISSES);
+            StatsStripe& stats = local_stats();
+            (from_tier ? stats.tier_latency : stats.miss_latency).record(elapsed_ns(start));
+            if (m_trace) {
+                m_trace->record(TraceEventType::GetblkMiss, block_number, trace_flags(mode));
+            }
+            return buf;
+        }
+        if (find_buffer(shard, block_number)) {
+            continue;  // Cached by someone else while a victim was written back
+        }
+
+        // Every buffer in the shard is pinned; someone else may also load
+        // this block while we wait
+        if (!waited_for_free) {
+            waited_for_free = true;
+            count(FREE_WAITS);
+        }
+        wait_for_release(shard, lock, nullptr, mode);
+    }
+}
+
+myBufferCache::Buffer* myBufferCache::get_cached(Shard& shard, uint64_t block_number, LockMode mode) {
+    bool sampled = ++t_hit_tick % HIT_SAMPLE_INTERVAL == 0;
+    Clock::time_point start = sampled ? Clock::now() : Clock::time_point();
+
+    // A cached block that can be pinned right away needs no lock
+    Buffer* buf = pin_cached(shard, block_number, mode);
+    if (!buf) return nullptr;
+
+    StatsStripe& stats = local_stats();
+    stats.counters[HITS].fetch_add(1, std::memory_order_relaxed);
+    if (buf->readahead.load(std::memory_order_relaxed) && buf->readahead.exchange(false)) {
+        stats.counters[READAHEAD_HITS].fetch_add(1, std::memory_order_relaxed);
+    }
+    if (sampled) {
+        stats.hit_latency.record(elapsed_ns(start));
+    }
+    if (m_trace) {
+        m_trace->record(TraceEventType::GetblkHit, block_number, trace_flags(mode));
+    }
+    return buf;
+}
+
+myBufferCache::Buffer* myBufferCache::pin_cached(Shard& shard, uint64_t block_number, LockMode mode) {
+    uint32_t index = shard.index.find(block_number);
+    if (index == BlockIndex::NOT_FOUND) return nullptr;
+
+    // The index may be stale, so check the buffer still holds the block
+    // once it can no longer be evicted
+    Buffer* buf = &m_buffers[index];
+    if (!try_pin(buf, mode)) return nullptr;
+    if (!buf->valid || buf->block_number != block_number) {
+        release_pin(shard, buf);
+        return nullptr;
+    }
+
+    if (!buf->referenced.load(std::memory_order_relaxed)) {
+        buf->referenced.store(true, std::memory_order_relaxed);
+    }
+    return buf;
+}
+
+void myBufferCache::wait_for_release(Shard& shard, std::unique_lock<std::mutex>& lock,
+    const Buffer* buffer, LockMode mode) {
+    auto start = Clock::now();
+
+    // Pins are dropped without the lock, so announce the wait before checking
+    // once more; release_pin checks waiters after unpinning (both seq_cst)
+    shard.waiters++;
+    if (still_blocked(shard, buffer, mode)) {
+        shard.wait_cv.wait(lock);
+    }
+    shard.waiters--;
+
+    count(WAIT_TIME_NS, elapsed_ns(start));
+}
+
+bool myBufferCache::still_blocked(const Shard& shard, const Buffer* buffer, LockMode mode) const {
+    if (buffer) {
+        return !can_pin(buffer->state.load(), mode);
+    }
+    return std::none_of(shard.buffers_begin, shard.buffers_end,
+        [](const Buffer& buf) { return buf.state.load() == 0; });
+}
+
+void myBufferCache::wake_waiters(Shard& shard) {
+    shard.wait_cv.notify_all();
+
+    // Parked getblk_async calls look the block up again on their executors
+    while (GetblkOperation* op = shard.async_waiters) {
+        shard.async_waiters = op->m_next_waiter;
+        shard.waiters--;
+        op->m_executor->post([this, op] { retry_getblk(*op); });
+    }
+}
+
+myBufferCache::Buffer* myBufferCache::breada(uint64_t block_number, uint64_t ra_block_number) {
+    queue_readahead(ra_block_number, ra_block_number);
+    return getblk(block_number);
+}
+
+void myBufferCache::getblk_many(std::span<const uint64_t> blocks, std::span<Buffer*> out, LockMode mode) {
+    if (out.size() != blocks.size()) {
+        throw std::invalid_argument("getblk_many needs one output slot per block");
+    }
+    std::fill(out.begin(), out.end(), nullptr);
+    size_t n = blocks.size();
+    if (n == 0) return;
+
+    // Short batches are checked for duplicates pairwise, sparing an allocation
+    bool distinct = true;
+    if (n <= SMALL_BATCH) {
+        for (size_t i = 1; i < n && distinct; ++i) {
+            distinct = std::find(blocks.begin(), blocks.begin() + i, blocks[i]) == blocks.begin() + i;
+        }
+    }
+    else {
+        std::vector<uint64_t> sorted(blocks.begin(), blocks.end());
+        std::sort(sorted.begin(), sorted.end());
+        distinct = std::adjacent_find(sorted.begin(), sorted.end()) == sorted.end();
+    }
+    if (!distinct) {
+        throw std::invalid_argument("getblk_many blocks must be distinct");
+    }
+
+    // Hits that can be pinned right away need no lock, as in getblk
+    auto start = Clock::now();
+    size_t hits = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (Buffer* buf = pin_cached(shard_for(blocks[i]), blocks[i], mode)) {
+            if (buf->readahead.load(std::memory_order_relaxed) && buf->readahead.exchange(false)) {
+                count(READAHEAD_HITS);
+            }
+            out[i] = buf;
+            hits++;
+        }
+    }
+
+    if (hits == n) {
+        count(HITS, n);
+        for (uint64_t block_number : blocks) {
+            if (m_trace) {
+                m_trace->record(TraceEventType::GetblkHit, block_number, trace_flags(mode));
+            }
+            if (m_streams) {
+                note_access(block_number);
+            }
+        }
+        return;
+    }
+
+    std::vector<bool> hit(n, false);
+    for (size_t i = 0; i < n; ++i) {
+        hit[i] = out[i] != nullptr;
+    }
+    std::vector<bool> from_tier(n, false);
+
+    // The rest ordered by shard, then block, so every shard is locked once
+    struct Request {
+        size_t shard;
+        size_t position;  // Index into blocks
+    };
+    std::vector<Request> requests;
+    requests.reserve(n - hits);
+    for (size_t i = 0; i < n; ++i) {
+        if (!out[i]) {
+            requests.push_back({ shard_index(blocks[i]), i });
+        }
+    }
+    std::sort(requests.begin(), requests.end(), [&](const Request& a, const Request& b) {
+        return a.shard != b.shard ? a.shard < b.shard : blocks[a.position] < blocks[b.position];
+    });
+
+    size_t first_blocked = n;   // First position that would have to wait
+    std::vector<size_t> loads;  // Positions claimed for loading
+
+    try {
+        // Pin the hits and claim buffers for the misses, one shard at a time
+        for (size_t r = 0; r < requests.size(); ) {
+            size_t shard_number = requests[r].shard;
+            Shard& shard = *m_shards[shard_number];
+            std::unique_lock<std::mutex> lock(shard.mutex);
+
+            for (; r < requests.size() && requests[r].shard == shard_number; ++r) {
+                size_t i = requests[r].position;
+                if (Buffer* buf = find_buffer(shard, blocks[i])) {
+                    if (!try_pin(buf, mode)) {
+                        first_blocked = std::min(first_blocked, i);
+                        continue;
+                    }
+                    if (buf->readahead.exchange(false)) {
+                        count(READAHEAD_HITS);
+                    }
+                    shard.policy->on_hit(buf);
+                    out[i] = buf;
+                    hit[i] = true;
+                }
+                else if (Buffer* buf = claim_buffer(shard, lock, blocks[i])) {
+                    out[i] = buf;
+                    loads.push_back(i);
+                }
+                else {
+                    first_blocked = std::min(first_blocked, i);
+                }
+            }
+        }
+
+        // Load the misses with no lock held: those the compressed tier
+        // holds from there, the others with one device request per run of
+        // consecutive blocks, all queued at once with an I/O engine.
+        // Claimed buffers are frozen, so nobody else touches them meanwhile.
+        std::vector<size_t> reads;
+        reads.reserve(loads.size());
+        for (size_t i : loads) {
+            if (load_from_tier(blocks[i], out[i]->data)) {
+                from_tier[i] = true;
+            }
+            else {
+                reads.push_back(i);
+            }
+        }
+        std::sort(reads.begin(), reads.end(), [&](size_t a, size_t b) { return blocks[a] < blocks[b]; });
+        std::vector<char*> run;
+        IoBatch io;
+        for (size_t l = 0; l < reads.size(); ) {
+            uint64_t first_block = blocks[reads[l]];
+            run.clear();
+            do {
+                run.push_back(out[reads[l]]->data);
+                ++l;
+            } while (l < reads.size() && continues_run(blocks[reads[l]], first_block, run.size()));
+
+            if (!m_io.empty()) {
+                submit_read_run(first_block, run.size(), run.data(), io.add());
+            }
+            else {
+                read_run_from_disk(first_block, run.size(), run.data());
+            }
+        }
+        io.wait();
+    }
+    catch (...) {
+        for (size_t i : loads) {
+            Shard& shard = shard_for(blocks[i]);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            abandon_buffer(shard, out[i]);
+            out[i] = nullptr;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (out[i]) {
+                release_pin(shard_for(blocks[i]), out[i]);
+                out[i] = nullptr;
+            }
+        }
+        throw;
+    }
+
+    // Publish the loaded buffers
+    uint64_t miss_ns = elapsed_ns(start);
+    for (size_t i : loads) {
+        Buffer* buf = out[i];
+        Shard& shard = shard_for(blocks[i]);
+        buf->valid = true;
+        buf->state.store(pinned_state(mode));
+        if (shard.waiters > 0) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            wake_waiters(shard);
+        }
+    }
+
+    // Holding later blocks while waiting for an earlier one could deadlock
+    // against a caller locking in order, so give those back and take the
+    // rest one by one. The positions kept are the ones counted here.
+    for (size_t i = first_blocked + 1; i < n; ++i) {
+        if (out[i]) {
+            release_pin(shard_for(blocks[i]), out[i]);
+            out[i] = nullptr;
+        }
+    }
+    size_t kept_hits = static_cast<size_t>(std::count(hit.begin(), hit.begin() + first_blocked, true));
+    count(HITS, kept_hits);
+    count(MISSES, first_blocked - kept_hits);
+    for (size_t i = 0; i < first_blocked; ++i) {
+        if (!hit[i]) {
+            StatsStripe& stats = local_stats();
+            (from_tier[i] ? stats.tier_latency : stats.miss_latency).record(miss_ns);
+        }
+        if (m_trace) {
+            m_trace->record(hit[i] ? TraceEventType::GetblkHit : TraceEventType::GetblkMiss, blocks[i], trace_flags(mode));
+        }
+    }
+
+    size_t i = first_blocked;
+    try {
+        for (; i < n; ++i) {
+            out[i] = get_buffer(blocks[i], mode);
+        }
+    }
+    catch (...) {
+        for (size_t j = 0; j < i; ++j) {
+            release_pin(shard_for(blocks[j]), out[j]);
+            out[j] = nullptr;
+        }
+        throw;
+    }
+
+    if (m_streams) {
+        for (uint64_t block_number : blocks) {
+            note_access(block_number);
+        }
+    }
+}
+
+void myBufferCache::brelse_many(std::span<Buffer* const> buffers, bool mark_dirty) {
+    // Clean releases take no lock anyway
+    if (!mark_dirty) {
+        for (Buffer* buf : buffers) {
+            brelse(buf);
+        }
+        return;
+    }
+
+    // Dirty ones grouped by shard, so each shard lock is taken once
+    std::vector<std::pair<size_t, Buffer*>> by_shard;
+    by_shard.reserve(buffers.size());
+    for (Buffer* buf : buffers) {
+        if (!buf) continue;
+        if (m_trace) {
+            m_trace->record(TraceEventType::Brelse, buf->block_number, TRACE_DIRTY);
+        }
+        by_shard.emplace_back(shard_index(buf->block_number), buf);
+    }
+    std::sort(by_shard.begin(), by_shard.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for (size_t b = 0; b < by_shard.size(); ) {
+        size_t shard_number = by_shard[b].first;
+        Shard& shard = *m_shards[shard_number];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (; b < by_shard.size() && by_shard[b].first == shard_number; ++b) {
+            Buffer* buf = by_shard[b].second;
+            this->mark_dirty(shard, buf);
+            if (unpin(buf)) {
+                shard.policy->on_release(buf);
+            }
+        }
+        if (shard.waiters > 0) {
+            wake_waiters(shard);
+        }
+    }
+
+    if (!by_shard.empty() && m_flush_thread.joinable()) {
+        throttle_writer();
+    }
+}
+
+myBufferCache::GetblkOperation myBufferCache::getblk_async(uint64_t block_number, LockMode mode) {
+    if (m_streams) {
+        note_access(block_number);
+    }
+    return GetblkOperation(*this, block_number, mode);
+}
+
+myBufferCache::BwriteOperation myBufferCache::bwrite_async(Buffer* buffer) {
+    return BwriteOperation(*this, buffer);
+}
+
+bool myBufferCache::GetblkOperation::await_ready() {
+    m_buffer = m_cache.get_cached(m_cache.shard_for(m_block_number), m_block_number, m_mode);
+    return m_buffer != nullptr;
+}
+
+bool myBufferCache::GetblkOperation::await_suspend(std::coroutine_handle<> handle) {
+    m_executor = Executor::current();
+    if (!m_executor) {
+        throw std::logic_error("getblk_async must be awaited in a task run by an Executor");
+    }
+    m_handle = handle;
+    m_start = Clock::now();
+    return m_cache.advance_getblk(*this);
+}
+
+myBufferCache::Buffer* myBufferCache::GetblkOperation::await_resume() const {
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+    return m_buffer;
+}
+
+bool myBufferCache::BwriteOperation::await_suspend(std::coroutine_handle<> handle) {
+    return m_cache.start_bwrite(*this, handle);
+}
+
+void myBufferCache::BwriteOperation::await_resume() const {
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+bool myBufferCache::advance_getblk(GetblkOperation& op) {
+    uint64_t block_number = op.m_block_number;
+    Shard& shard = shard_for(block_number);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    // The steps of get_buffer, except that waiting parks the operation
+    // instead of the thread
+    try {
+        while (true) {
+            if (Buffer* buf = find_buffer(shard, block_number)) {
+                if (try_pin(buf, op.m_mode)) {
+                    count(HITS);
+                    if (buf->readahead.exchange(false)) {
+                        count(READAHEAD_HITS);
+                    }
+                    shard.policy->on_hit(buf);
+                    if (m_trace) {
+                        m_trace->record(TraceEventType::GetblkHit, block_number, trace_flags(op.m_mode));
+                    }
+                    op.m_buffer = buf;
+                    return false;
+                }
+                if (!op.m_waited_for_lock) {
+                    op.m_waited_for_lock = true;
+                    count(LOCK_WAITS);
+                }
+                if (park(shard, op, buf)) return true;
+                continue;
+            }
+
+            if (Buffer* buf = claim_buffer(shard, lock, block_number)) {
+                lock.unlock();
+                if (load_from_tier(block_number, buf->data)) {
+                    finish_getblk_read(shard, op, buf, nullptr, true);
+                    return false;
+                }
+                if (!m_io.empty()) {
+                    char* data = buf->data;
+                    submit_read_run(block_number, 1, &data, [this, &shard, &op, buf](std::exception_ptr error) {
+                        // Resuming may destroy op, so take what we need first
+                        Executor* executor = op.m_executor;
+                        std::coroutine_handle<> handle = op.m_handle;
+                        finish_getblk_read(shard, op, buf, error, false);
+                        executor->post([handle] { handle.resume(); });
+                    });
+                    return true;
+                }
+
+                std::exception_ptr error;
+                try {
+                    read_from_disk(block_number, *buf);
+                }
+                catch (...) {
+                    error = std::current_exception();
+                }
+                finish_getblk_read(shard, op, buf, error, false);
+                return false;
+            }
+            if (find_buffer(shard, block_number)) {
+                continue;
+            }
+
+            if (!op.m_waited_for_free) {
+                op.m_waited_for_free = true;
+                count(FREE_WAITS);
+            }
+            if (park(shard, op, nullptr)) return true;
+        }
+    }
+    catch (...) {
+        op.m_error = std::current_exception();
+        return false;
+    }
+}
+
+void myBufferCache::retry_getblk(GetblkOperation& op) {
+    count(WAIT_TIME_NS, elapsed_ns(op.m_wait_start));
+    if (!advance_getblk(op)) {
+        op.m_handle.resume();
+    }
+}
+
+bool myBufferCache::park(Shard& shard, GetblkOperation& op, const Buffer* buffer) {
+    // Announced before checking once more, as in wait_for_release
+    shard.waiters++;
+    if (!still_blocked(shard, buffer, op.m_mode)) {
+        shard.waiters--;
+        return false;
+    }
+    op.m_wait_start = Clock::now();
+    op.m_next_waiter = shard.async_waiters;
+    shard.async_waiters = &op;
+    return true;
+}
+
+void myBufferCache::finish_getblk_read(Shard& shard, GetblkOperation& op, Buffer* buffer, std::exception_ptr error,
+    bool from_tier) {
+    if (error) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        abandon_buffer(shard, buffer);
+        op.m_error = error;
+        return;
+    }
+
+    buffer->valid = true;
+    buffer->state.store(pinned_state(op.m_mode));
+    if (shard.waiters > 0) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        wake_waiters(shard);
+    }
+
+    count(MISSES);
+    StatsStripe& stats = local_stats();
+    (from_tier ? stats.tier_latency : stats.miss_latency).record(elapsed_ns(op.m_start));
+    if (m_trace) {
+        m_trace->record(TraceEventType::GetblkMiss, op.m_block_number, trace_flags(op.m_mode));
+    }
+    op.m_buffer = buffer;
+}
+
+bool myBufferCache::start_bwrite(BwriteOperation& op, std::coroutine_handle<> handle) {
+    // A journal commit waits for the log, so it is done in place too
+    if (m_io.empty() || m_journal) {
+        try {
+            bwrite(op.m_buffer);
+        }
+        catch (...) {
+            op.m_error = std::current_exception();
+        }
+        return false;
+    }
+
+    Executor* executor = Executor::current();
+    if (!executor) {
+        throw std::logic_error("bwrite_async must be awaited in a task run by an Executor");
+    }
+
+    // The caller's pin keeps the buffer in place during the write, as in bwrite
+    Shard& shard = shard_for(op.m_buffer->block_number);
+    const char* data = op.m_buffer->data;
+    submit_write_run(op.m_buffer->block_number, 1, &data, [this, &shard, &op, executor, handle](std::exception_ptr error) {
+        if (error) {
+            op.m_error = error;
+        }
+        else {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            mark_clean(shard, op.m_buffer);
+        }
+        executor->post([handle] { handle.resume(); });
+    });
+    return true;
+}
+
+void myBufferCache::brelse(Buffer* buffer, bool mark_dirty) {
+    if (!buffer) return;
+
+    Shard& shard = shard_for(buffer->block_number);
+    if (m_trace) {
+        m_trace->record(TraceEventType::Brelse, buffer->block_number, mark_dirty ? TRACE_DIRTY : 0);
+    }
+
+    // A clean release only drops the pin. The hit that pinned the buffer
+    // already set its reference bit, so the policy still sees the access.
+    if (!mark_dirty) {
+        release_pin(shard, buffer);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        this->mark_dirty(shard, buffer);
+        if (unpin(buffer)) {
+            shard.policy->on_release(buffer);
+        }
+
+        if (shard.waiters > 0) {
+            wake_waiters(shard);
+        }
+    }
+
+    if (m_flush_thread.joinable()) {
+        throttle_writer();
+    }
+}
+
+void myBufferCache::release_pin(Shard& shard, Buffer* buffer) {
+    unpin(buffer);
+    if (shard.waiters > 0) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        wake_waiters(shard);
+    }
+}
+
+void myBufferCache::bwrite(Buffer* buffer) {
+    if (!buffer || !buffer->valid) return;
+
+    // The caller's pin keeps the buffer in place during the write
+    Shard& shard = shard_for(buffer->block_number);
+    if (m_journal) {
+        // Dirty before it is logged, so a checkpoint of that log writes it
+        // home unless a write-back already has
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            mark_dirty(shard, buffer);
+        }
+        m_journal->commit(m_journal->append(buffer->block_number, buffer->data));
+        if (m_journal->active_blocks() >= m_options.journal_checkpoint_blocks) {
+            wake_checkpointer();
+        }
+        return;
+    }
+
+    write_to_disk(*buffer);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    mark_clean(shard, buffer);
+}
+
+void myBufferCache::bsync() {
+    bsync_range(0, UINT64_MAX);
+}
+
+void myBufferCache::bsync_range(uint64_t first_block, uint64_t last_block) {
+    // Work up through the range taking at most SYNC_BATCH dirty buffers per
+    // shard at a time, so each shard lock is only held while picking them
+    // and few buffers are pinned at once. The shared pin keeps writers out
+    // during the write. Buffers that can't be pinned, held exclusively or
+    // frozen by an eviction writing them back, are waited for at the end.
+    uint64_t next = first_block;
+    std::vector<Buffer*> batch;
+    std::vector<uint64_t> blocked;
+    while (next <= last_block) {
+        uint64_t end = last_block;  // Last block covered by this round
+        batch.clear();
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            size_t taken = 0;
+            for (auto it = shard->dirty_blocks.lower_bound(next);
+                it != shard->dirty_blocks.end() && it->first <= end; ++it) {
+                if (taken == SYNC_BATCH) {
+                    end = it->first - 1;
+                    break;
+                }
+                taken++;
+                if (try_pin(it->second, LockMode::Shared)) {
+                    batch.push_back(it->second);
+                }
+                else {
+                    blocked.push_back(it->first);
+                }
+            }
+        }
+
+        // Shards visited before the round was cut short may have gone past
+        // it; those blocks come up again in the next round
+        auto beyond = std::partition(batch.begin(), batch.end(),
+            [end](const Buffer* buf) { return buf->block_number <= end; });
+        for (auto it = beyond; it != batch.end(); ++it) {
+            release_pin(shard_for((*it)->block_number), *it);
+        }
+        batch.erase(beyond, batch.end());
+        blocked.erase(std::remove_if(blocked.begin(), blocked.end(),
+            [end](uint64_t block_number) { return block_number > end; }), blocked.end());
+
+        write_back_batch(batch);
+        if (end == last_block) break;
+        next = end + 1;
+    }
+
+    write_back_blocked(blocked);
+    m_device->sync();
+}
+
+void myBufferCache::wake_checkpointer() {
+    {
+        std::lock_guard<std::mutex> lock(m_checkpoint_mutex);
+        m_checkpoint_requested = true;
+    }
+    m_checkpoint_cv.notify_one();
+}
+
+void myBufferCache::checkpoint_worker() {
+    std::unique_lock<std::mutex> lock(m_checkpoint_mutex);
+
+    while (true) {
+        m_checkpoint_cv.wait(lock, [this] { return m_checkpoint_stop || m_checkpoint_requested; });
+        if (m_checkpoint_stop) break;
+        m_checkpoint_requested = false;
+
+        lock.unlock();
+        try {
+            checkpoint();
+        }
+        catch (const std::exception&) {
+            // The log stays in use; the next request retries its blocks
+        }
+        lock.lock();
+    }
+}
+
+void myBufferCache::checkpoint() {
+    if (!m_checkpoint_started) {
+        m_checkpoint_blocks = m_journal->begin_checkpoint();
+        m_checkpoint_started = true;
+    }
+    write_home(m_checkpoint_blocks);
+    m_device->sync();
+    m_journal->finish_checkpoint();
+    m_checkpoint_started = false;
+    m_checkpoint_blocks.clear();
+    count(CHECKPOINTS);
+}
+
+void myBufferCache::write_home(const std::vector<uint64_t>& blocks) {
+    // A buffer that is clean, or no longer cached, was written back after
+    // it was logged. The dirty ones are pinned SYNC_BATCH at a time; those
+    // that can't be pinned are waited for at the end.
+    std::vector<Buffer*> batch;
+    std::vector<uint64_t> blocked;
+    for (size_t i = 0; i < blocks.size(); ) {
+        batch.clear();
+        for (; i < blocks.size() && batch.size() < SYNC_BATCH; ++i) {
+            Shard& shard = shard_for(blocks[i]);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Buffer* buf = find_buffer(shard, blocks[i]);
+            if (!buf || !buf->valid || !buf->dirty) continue;
+            if (try_pin(buf, LockMode::Shared)) {
+                batch.push_back(buf);
+            }
+            else {
+                blocked.push_back(blocks[i]);
+            }
+        }
+        write_back_batch(batch);
+    }
+    write_back_blocked(blocked);
+}
+
+void myBufferCache::write_back_blocked(const std::vector<uint64_t>& blocks) {
+    // An eviction writing a frozen buffer back marks it clean before
+    // unfreezing it, so a block found clean or gone has been written
+    std::vector<Buffer*> batch;
+    for (uint64_t block_number : blocks) {
+        Shard& shard = shard_for(block_number);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        while (Buffer* buf = find_buffer(shard, block_number)) {
+            if (!buf->valid || !buf->dirty) break;
+            if (try_pin(buf, LockMode::Shared)) {
+                lock.unlock();
+                batch.assign(1, buf);
+                write_back_batch(batch);
+                break;
+            }
+            wait_for_release(shard, lock, buf, LockMode::Shared);
+        }
+    }
+}
+
+void myBufferCache::write_back_batch(std::vector<Buffer*>& batch) {
+    if (batch.empty()) return;
+
+    // Write in block order with no lock held, runs of consecutive blocks as
+    // one request each. The buffers are pinned shared, so they stay put and
+    // unmodified.
+    std::sort(batch.begin(), batch.end(),
+        [](const Buffer* a, const Buffer* b) { return a->block_number < b->block_number; });
+    std::vector<const char*> data(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        data[i] = batch[i]->data;
+    }
+
+    std::vector<char> written(batch.size(), 0);
+    std::exception_ptr error;
+    IoBatch io;
+    for (size_t i = 0; i < batch.size() && !error; ) {
+        size_t run = 1;
+        while (i + run < batch.size() && run < MAX_WRITE_RUN &&
+            continues_run(batch[i + run]->block_number, batch[i]->block_number, run)) {
+            run++;
+        }
+
+        if (!m_io.empty()) {
+            submit_write_run(batch[i]->block_number, run, &data[i], [&written, i, run, done = io.add()](std::exception_ptr e) {
+                if (!e) {
+                    std::fill(written.begin() + i, written.begin() + i + run, 1);
+                }
+                done(e);
+            });
+        }
+        else {
+            try {
+                write_run_to_disk(batch[i]->block_number, run, &data[i]);
+                std::fill(written.begin() + i, written.begin() + i + run, 1);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        }
+        i += run;
+    }
+    try {
+        io.wait();
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    // Mark the written ones clean and unpin all, one lock per shard
+    std::vector<std::pair<size_t, size_t>> by_shard;  // Shard, index into batch
+    by_shard.reserve(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        by_shard.emplace_back(shard_index(batch[i]->block_number), i);
+    }
+    std::sort(by_shard.begin(), by_shard.end());
+
+    for (size_t b = 0; b < by_shard.size(); ) {
+        size_t shard_number = by_shard[b].first;
+        Shard& shard = *m_shards[shard_number];
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (; b < by_shard.size() && by_shard[b].first == shard_number; ++b) {
+            size_t i = by_shard[b].second;
+            if (written[i]) {
+                mark_clean(shard, batch[i]);
+            }
+            unpin(batch[i]);
+        }
+        if (shard.waiters > 0) {
+            wake_waiters(shard);
+        }
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void myBufferCache::save_warm_set(const std::string& path) const {
+    // Each shard's blocks by rank, then interleaved so that a prefix of
+    // the file is the hottest part of every shard
+    std::vector<std::vector<uint64_t>> ranked(m_shards.size());
+    std::vector<Buffer*> buffers;
+    size_t count = 0;
+    for (size_t i = 0; i < m_shards.size(); ++i) {
+        buffers.clear();
+        std::lock_guard<std::mutex> lock(m_shards[i]->mutex);
+        m_shards[i]->policy->hottest_first(buffers);
+        for (const Buffer* buffer : buffers) {
+            if (buffer->valid) {
+                ranked[i].push_back(buffer->block_number);
+            }
+        }
+        count += ranked[i].size();
+    }
+
+    std::vector<uint64_t> blocks;
+    blocks.reserve(count);
+    for (size_t rank = 0; blocks.size() < count; ++rank) {
+        for (const auto& shard_blocks : ranked) {
+            if (rank < shard_blocks.size()) {
+                blocks.push_back(shard_blocks[rank]);
+            }
+        }
+    }
+
+    // Written aside and renamed over the old file, so a crash leaves one
+    // or the other
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot create warm-set file " + temp_path);
+        }
+        uint32_t saved_block_size = static_cast<uint32_t>(block_size());
+        uint32_t saved_count = static_cast<uint32_t>(blocks.size());
+        out.write(WARM_MAGIC, sizeof(WARM_MAGIC));
+        out.write(reinterpret_cast<const char*>(&saved_block_size), sizeof(saved_block_size));
+        out.write(reinterpret_cast<const char*>(&saved_count), sizeof(saved_count));
+        out.write(reinterpret_cast<const char*>(blocks.data()),
+            static_cast<std::streamsize>(blocks.size() * sizeof(uint64_t)));
+        if (!out.flush()) {
+            throw std::runtime_error("Failed to write warm-set file " + temp_path);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        throw std::runtime_error("Cannot replace warm-set file " + path + ": " + error.message());
+    }
 }
 
-myBufferCache::~myBufferCache() {
-    bsync(); // Ensure all dirty buffers are written to disk
-}
+void myBufferCache::warm_worker() {
+    std::vector<uint64_t> saved = read_warm_set(m_options.warm_path, block_size());
+    // Skip blocks of devices the cache no longer has
+    saved.erase(std::remove_if(saved.begin(), saved.end(),
+        [this](uint64_t block) { return key_device(block) >= m_device->size(); }), saved.end());
+    if (saved.size() > m_capacity) {
+        saved.resize(m_capacity);  // Only the hottest fit
+    }
 
-myBufferCache::Buffer* myBufferCache::getblk(int block_number) {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<uint64_t> batch;
+    bool room = true;
+    for (size_t begin = 0; room && begin < saved.size() && !m_warm_stop; begin += WARM_BATCH) {
+        // Sorted, so the reads sweep the device and merge into runs
+        size_t end = std::min(saved.size(), begin + WARM_BATCH);
+        batch.assign(saved.begin() + begin, saved.begin() + end);
+        std::sort(batch.begin(), batch.end());
+        batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
 
-    // Check if block is already in cache
-    if (Buffer* buf = find_buffer(block_number)) {
-        m_hits++;
-        remove_from_lru(buf); // Will be added back when released
-        return buf;
+        for (size_t i = 0; room && i < batch.size() && !m_warm_stop; ) {
+            size_t n = 1;
+            while (i + n < batch.size() && n < MAX_WARM_RUN && continues_run(batch[i + n], batch[i], n)) {
+                ++n;
+            }
+            room = warm_run(batch.data() + i, n);
+            i += n;
+        }
     }
 
-    m_misses++;
-    return allocate_buffer(block_number);
+    std::unique_lock<std::mutex> lock(m_warm_mutex);
+    m_warm_cv.wait(lock, [this] { return m_warm_in_flight == 0; });
+    m_warming = false;
 }
 
-void myBufferCache::brelse(Buffer* buffer, bool mark_dirty) {
-    if (!buffer) return;
+bool myBufferCache::warm_run(const uint64_t* blocks, size_t n) {
+    // Give way to getblk misses: without an I/O engine hold back for a
+    // while, with one keep a single load in flight instead of several
+    {
+        auto deadline = Clock::now() + WARM_MAX_DEFER;
+        std::unique_lock<std::mutex> lock(m_warm_mutex);
+        while (!m_warm_stop) {
+            size_t limit = !m_io.empty() ? WARM_IN_FLIGHT : 1;
+            if (m_foreground_reads.load(std::memory_order_relaxed) > 0) {
+                limit = !m_io.empty() ? 1 : (Clock::now() < deadline ? 0 : 1);
+            }
+            if (m_warm_in_flight < limit) break;
+            m_warm_cv.wait_for(lock, WARM_POLL);
+        }
+    }
+    if (m_warm_failed) return false;
 
-    std::lock_guard<std::mutex> lock(m_mutex);
+    // Only free buffers are taken, so nothing already cached is displaced.
+    // Claimed buffers stay frozen until read, as for prefetch.
+    std::vector<Buffer*> claimed(n, nullptr);
+    bool any_free = false;
+    for (size_t i = 0; i < n; ++i) {
+        Shard& shard = shard_for(blocks[i]);
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        if (shard.free_list.empty() || find_buffer(shard, blocks[i])) continue;
+        claimed[i] = claim_buffer(shard, lock, blocks[i]);
+        any_free = true;
+    }
+    if (!any_free) {
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            if (!shard->free_list.empty()) return true;
+        }
+        return false;
+    }
 
-    if (mark_dirty) {
-        buffer->dirty = true;
+    // Blocks the compressed tier holds come from there, as for prefetch, so
+    // the tier never keeps a copy of a block that is also cached
+    std::vector<Buffer*> from_tier;
+    for (size_t i = 0; i < n; ++i) {
+        if (claimed[i] && load_from_tier(blocks[i], claimed[i]->data)) {
+            from_tier.push_back(claimed[i]);
+            claimed[i] = nullptr;
+        }
+    }
+    if (!from_tier.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(m_warm_mutex);
+            ++m_warm_in_flight;
+        }
+        finish_warm_load(from_tier, nullptr);
     }
 
-    add_to_lru(buffer);
-}
+    // One read per stretch of claimed blocks
+    for (size_t i = 0; i < n; ) {
+        if (!claimed[i]) {
+            ++i;
+            continue;
+        }
+        uint64_t first_block = blocks[i];
+        std::vector<Buffer*> buffers;
+        std::vector<char*> data;
+        for (; i < n && claimed[i]; ++i) {
+            buffers.push_back(claimed[i]);
+            data.push_back(claimed[i]->data);
+        }
 
-void myBufferCache::bwrite(Buffer* buffer) {
-    if (!buffer || !buffer->valid) return;
+        {
+            std::lock_guard<std::mutex> lock(m_warm_mutex);
+            ++m_warm_in_flight;
+        }
+        if (!m_io.empty()) {
+            try {
+                io_for(first_block, data.size()).submit_read(key_block(first_block), data.size(), data.data(),
+                    [this, buffers](std::exception_ptr error) {
+                        if (!error) {
+                            count(DISK_READS, buffers.size());
+                        }
+                        finish_warm_load(buffers, error);
+                    });
+            }
+            catch (...) {
+                finish_warm_load(buffers, std::current_exception());
+            }
+            continue;
+        }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-    write_to_disk(*buffer);
-    buffer->dirty = false;
-    m_disk_writes++;
+        std::exception_ptr error;
+        try {
+            m_device->read_blocks(first_block, data.size(), data.data());
+            count(DISK_READS, data.size());
+        }
+        catch (...) {
+            error = std::current_exception();
+        }
+        finish_warm_load(buffers, error);
+    }
+    return !m_warm_failed;
 }
 
-void myBufferCache::bsync() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    for (auto& buf : m_buffers) {
-        if (buf.valid && buf.dirty) {
-            write_to_disk(buf);
-            buf.dirty = false;
-            m_disk_writes++;
+void myBufferCache::finish_warm_load(const std::vector<Buffer*>& buffers, std::exception_ptr error) {
+    // Loading is best effort: after a failed read the rest is given up,
+    // and getblk reports the error
+    for (Buffer* buffer : buffers) {
+        Shard& shard = shard_for(buffer->block_number);
+        if (error) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            abandon_buffer(shard, buffer);
+            continue;
+        }
+        buffer->valid = true;
+        buffer->state.store(0);
+        if (shard.waiters > 0) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            wake_waiters(shard);
         }
     }
+    if (error) {
+        m_warm_failed = true;
+    }
+    else {
+        count(WARM_LOADS, buffers.size());
+    }
+
+    std::lock_guard<std::mutex> lock(m_warm_mutex);
+    --m_warm_in_flight;
+    m_warm_cv.notify_all();
 }
 
-myBufferCache::Buffer* myBufferCache::find_buffer(int block_number) {
-    auto it = m_block_map.find(block_number);
-    return (it != m_block_map.end()) ? it->second : nullptr;
+myBufferCache::Buffer* myBufferCache::find_buffer(Shard& shard, uint64_t block_number) {
+    uint32_t index = shard.index.find(block_number);
+    return index != BlockIndex::NOT_FOUND ? &m_buffers[index] : nullptr;
 }
 
-myBufferCache::Buffer* myBufferCache::allocate_buffer(int block_number) {
+myBufferCache::Buffer* myBufferCache::claim_buffer(Shard& shard, std::unique_lock<std::mutex>& lock, uint64_t block_number) {
     Buffer* buffer = nullptr;
 
     // Try to find an unused buffer
-    for (auto& buf : m_buffers) {
-        if (!buf.valid) {
-            buffer = &buf;
-            break;
-        }
+    if (!shard.free_list.empty()) {
+        buffer = shard.free_list.back();
+        shard.free_list.pop_back();
     }
 
-    // If all buffers are in use, evict the LRU one
-    if (!buffer && !m_lru_list.empty()) {
-        buffer = m_lru_list.back();
+    // If all buffers are in use, ask the policy for a victim
+    if (!buffer) {
+        // With a flusher running, prefer a clean buffer close to the victim
+        // position over a synchronous write-back, and let the flusher catch up
+        bool prefer_clean = m_flush_thread.joinable();
+        auto start = Clock::now();
+        const Buffer* written_back = nullptr;
+        bool stashed = false;
+
+        // The victim was unpinned when the policy chose it, but a lock-free
+        // hit may pin it before it is frozen; pick another one then
+        for (int attempt = 0; !buffer && attempt < MAX_VICTIM_ATTEMPTS; ++attempt) {
+            Buffer* victim = shard.policy->choose_victim(block_number, prefer_clean);
+            if (!victim) break;
+
+            uint32_t unpinned = 0;
+            if (!victim->state.compare_exchange_strong(unpinned, Buffer::FROZEN)) continue;
+            if (!victim->dirty) {
+                buffer = victim;
+
+                // Keep a compressed copy, compressing with the lock
+                // released. Frozen and still indexed, the victim can't be
+                // changed or loaded again meanwhile, so the tier never
+                // holds a copy older than the device's.
+                if (m_tier && victim->valid) {
+                    lock.unlock();
+                    try {
+                        m_tier->store(victim->block_number, victim->data);
+                    }
+                    catch (const std::bad_alloc&) {
+                        // The tier is only a cache
+                    }
+                    lock.lock();
+                    stashed = true;
+                }
+                break;
+            }
 
-        // Write back if dirty
-        if (buffer->dirty) {
-            write_to_disk(*buffer);
-            m_disk_writes++;
+            // Write a dirty victim back with the lock released; frozen, it
+            // can't be pinned or changed meanwhile. Clean, it is normally
+            // chosen again on the next attempt. A failed write leaves it
+            // cached and dirty.
+            if (prefer_clean) {
+                wake_flusher();
+            }
+            lock.unlock();
+            try {
+                write_to_disk(*victim);
+            }
+            catch (...) {
+                lock.lock();
+                victim->state.store(0);
+                if (shard.waiters > 0) {
+                    wake_waiters(shard);
+                }
+                throw;
+            }
+            lock.lock();
+            mark_clean(shard, victim);
+            victim->state.store(0);
+            if (shard.waiters > 0) {
+                wake_waiters(shard);
+            }
+            written_back = victim;
+            count(DIRTY_EVICTIONS);
+
+            if (find_buffer(shard, block_number)) {
+                return nullptr;
+            }
         }
 
-        // Remove from map
-        m_block_map.erase(buffer->block_number);
+        if (buffer) {
+            if (m_trace) {
+                m_trace->record(TraceEventType::Evict, buffer->block_number, buffer == written_back ? TRACE_DIRTY : 0);
+            }
+
+            shard.policy->on_evict(buffer);
+
+            if (buffer->readahead) {
+                count(READAHEAD_WASTED);
+            }
+
+            // Remove from index
+            shard.index.erase(buffer->block_number);
+            buffer->valid = false;
+
+            count(EVICTIONS);
+            local_stats().eviction_latency.record(elapsed_ns(start));
+
+            // With the lock dropped, others may have come to wait for the
+            // victim's block, or loaded the block wanted here
+            if (stashed) {
+                bool raced = find_buffer(shard, block_number) != nullptr;
+                if (raced) {
+                    free_buffer(shard, buffer);
+                }
+                if (shard.waiters > 0) {
+                    wake_waiters(shard);
+                }
+                if (raced) return nullptr;
+            }
+        }
     }
 
     if (buffer) {
-        // Initialize new buffer
+        // Initialize new buffer; it stays frozen, so lock-free lookups
+        // ignore it and others looking for the block wait until the caller
+        // publishes its pin state
         buffer->block_number = block_number;
         buffer->dirty = false;
-        buffer->valid = true;
-        read_from_disk(block_number, *buffer);
+        buffer->readahead = false;
+        buffer->referenced = false;
 
-        // Add to map
-        m_block_map[block_number] = buffer;
+        // Add to index
+        shard.index.insert(block_number, static_cast<uint32_t>(buffer - m_buffers.data()));
+        shard.policy->on_insert(buffer);
     }
 
     return buffer;
 }
 
-void myBufferCache::add_to_lru(Buffer* buffer) {
-    if (!buffer) return;
+void myBufferCache::abandon_buffer(Shard& shard, Buffer* buffer) {
+    shard.policy->on_evict(buffer);
+    shard.index.erase(buffer->block_number);
+    buffer->valid = false;
+    free_buffer(shard, buffer);
 
-    // Remove if already in list
-    remove_from_lru(buffer);
+    // Anyone waiting for the block has to look it up again
+    if (shard.waiters > 0) {
+        wake_waiters(shard);
+    }
+}
 
-    // Add to front (MRU position)
-    m_lru_list.push_front(buffer);
+void myBufferCache::free_buffer(Shard& shard, Buffer* buffer) {
+    if (buffer >= shard.retire_from) {
+        buffer->block_number = NO_BLOCK;  // Stays frozen
+        return;
+    }
+    shard.free_list.push_back(buffer);
 }
 
-void myBufferCache::remove_from_lru(Buffer* buffer) {
-    if (!buffer) return;
+void myBufferCache::resize(size_t cache_size) {
+    if (cache_size < m_shards.size() || cache_size > m_buffers.size()) {
+        throw std::invalid_argument("Cache size must be between the shard count and the maximum cache size");
+    }
+
+    std::lock_guard<std::mutex> resize_lock(m_resize_mutex);
+    size_t old_size = m_capacity;
+    if (cache_size == old_size) return;
+
+    // Shrinking lowers the dirty thresholds first, so the flusher starts
+    // on the smaller target while buffers are retired
+    if (cache_size < old_size) {
+        m_capacity = cache_size;
+        set_thresholds(cache_size);
+    }
+    try {
+        for (size_t i = 0; i < m_shards.size(); ++i) {
+            size_t count = shard_share(cache_size, m_shards.size(), i);
+            if (cache_size > old_size) {
+                grow_shard(*m_shards[i], count);
+            }
+            else {
+                shrink_shard(*m_shards[i], count);
+            }
+        }
+    }
+    catch (...) {
+        // Some shards stopped short; count what there is
+        size_t total = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            total += shard->buffers_end - shard->buffers_begin;
+        }
+        m_capacity = total;
+        set_thresholds(total);
+        throw;
+    }
+    m_capacity = cache_size;
+    set_thresholds(cache_size);
+}
+
+void myBufferCache::grow_shard(Shard& shard, size_t count) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Buffer* end = shard.buffers_begin + count;
+    m_arena->commit(shard.buffers_end - m_buffers.data(), end - shard.buffers_end);
+
+    // Retired buffers are frozen like free ones; lowest first, as at construction
+    for (Buffer* buf = end; buf != shard.buffers_end; ) {
+        shard.free_list.push_back(--buf);
+    }
+    shard.buffers_end = shard.retire_from = end;
+    shard.policy->set_capacity(count);
+    if (shard.waiters > 0) {
+        wake_waiters(shard);
+    }
+}
+
+void myBufferCache::shrink_shard(Shard& shard, size_t count) {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    Buffer* old_end = shard.buffers_end;
+    shard.retire_from = shard.buffers_begin + count;
+    shard.policy->set_capacity(count);
+
+    // Free buffers past the new size retire at once
+    auto& free_list = shard.free_list;
+    free_list.erase(std::remove_if(free_list.begin(), free_list.end(), [&shard](Buffer* buf) {
+        if (buf < shard.retire_from) return false;
+        buf->block_number = NO_BLOCK;
+        return true;
+    }), free_list.end());
+
+    try {
+        while (shard.buffers_end > shard.retire_from) {
+            size_t done = 0;
+            bool blocked = false;
+            for (Buffer* buf = shard.retire_from; buf < shard.buffers_end && done < SHRINK_BATCH; ++buf) {
+                if (retired(buf)) continue;
+                if (retire_buffer(shard, lock, buf)) {
+                    ++done;
+                }
+                else {
+                    blocked = true;
+                }
+            }
+            while (shard.buffers_end > shard.retire_from && retired(shard.buffers_end - 1)) {
+                --shard.buffers_end;
+            }
+            if (shard.buffers_end == shard.retire_from) break;
+
+            // Let others have the shard between batches, and give the
+            // holders of pinned buffers time to release them
+            lock.unlock();
+            if (blocked && done == 0) {
+                std::this_thread::sleep_for(SHRINK_RETRY);
+            }
+            else {
+                std::this_thread::yield();
+            }
+            lock.lock();
+        }
+    }
+    catch (...) {
+        // Stop here; what was retired below the current end is free again
+        for (Buffer* buf = shard.retire_from; buf < shard.buffers_end; ++buf) {
+            if (retired(buf)) {
+                free_list.push_back(buf);
+            }
+        }
+        shard.retire_from = shard.buffers_end;
+        shard.policy->set_capacity(shard.buffers_end - shard.buffers_begin);
+        throw;
+    }
+
+    Buffer* end = shard.buffers_end;
+    lock.unlock();
+    m_arena->release(end - m_buffers.data(), old_end - end);
+}
+
+bool myBufferCache::retire_buffer(Shard& shard, std::unique_lock<std::mutex>& lock, Buffer* buf) {
+    // Unpinned and not frozen, the buffer holds a block
+    uint32_t unpinned = 0;
+    if (!buf->state.compare_exchange_strong(unpinned, Buffer::FROZEN)) return false;
+
+    // Write back with the lock released, as for a dirty victim
+    if (buf->dirty) {
+        lock.unlock();
+        try {
+            write_to_disk(*buf);
+        }
+        catch (...) {
+            lock.lock();
+            buf->state.store(0);
+            if (shard.waiters > 0) {
+                wake_waiters(shard);
+            }
+            throw;
+        }
+        lock.lock();
+        mark_clean(shard, buf);
+    }
+
+    // Keep the block if the policy has a colder one to give up instead:
+    // copy it over and let the colder buffer take its place
+    Buffer* evicted = buf;
+    Buffer* colder = shard.policy->choose_victim(buf->block_number, true);
+    unpinned = 0;
+    if (colder && colder != buf && colder < shard.retire_from && !colder->dirty &&
+        colder->state.compare_exchange_strong(unpinned, Buffer::FROZEN)) {
+        evicted = colder;
+    }
+    if (m_trace) {
+        m_trace->record(TraceEventType::Evict, evicted->block_number, 0);
+    }
+    if (evicted->readahead) {
+        count(READAHEAD_WASTED);
+    }
+    count(EVICTIONS);
+
+    if (evicted == colder) {
+        shard.policy->on_evict(colder);
+        shard.index.erase(colder->block_number);
+        memcpy(colder->data, buf->data, block_size());
+        colder->block_number = buf->block_number;
+        colder->readahead = buf->readahead.load();
+        colder->referenced = buf->referenced.load();
+        shard.policy->on_move(buf, colder);
+        shard.index.insert(colder->block_number, static_cast<uint32_t>(colder - m_buffers.data()));
+        colder->state.store(0);
+    }
+    else {
+        shard.policy->on_evict(buf);
+        shard.index.erase(buf->block_number);
+    }
+    buf->valid = false;
+    buf->readahead = false;
+    buf->block_number = NO_BLOCK;
+
+    // Those waiting for the block look it up again
+    if (shard.waiters > 0) {
+        wake_waiters(shard);
+    }
+    return true;
+}
+
+void myBufferCache::set_thresholds(size_t cache_size) {
+    if (!m_options.background_flush) return;
+    m_flush_threshold = static_cast<size_t>(m_options.flush_dirty_ratio * cache_size);
+    m_throttle_threshold = std::max<size_t>(1, static_cast<size_t>(m_options.throttle_dirty_ratio * cache_size));
+}
+
+void myBufferCache::memory_worker() {
+    std::unique_lock<std::mutex> lock(m_memory_mutex);
+    while (!m_memory_cv.wait_for(lock, m_options.memory_poll_interval, [this] { return m_memory_stop; })) {
+        lock.unlock();
+        try {
+            size_t current = capacity();
+            size_t budget = m_options.memory_budget(current * block_size());
+            size_t target = std::clamp(budget / block_size(), m_shards.size(), m_buffers.size());
+
+            // Small changes aren't worth the evictions
+            size_t slack = std::max(m_shards.size(), current / MEMORY_HYSTERESIS);
+            if (target + slack <= current || target >= current + slack ||
+                (target == m_buffers.size() && target != current)) {
+                resize(target);
+            }
+        }
+        catch (const std::exception&) {
+            // Tried again at the next poll
+        }
+        lock.lock();
+    }
+}
+
+void myBufferCache::note_access(uint64_t block_number) {
+    size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % NUM_STREAMS;
+    Stream& stream = m_streams[slot];
+    uint64_t first = 1;
+    uint64_t last = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(stream.mutex);
+
+        // Another thread hashed to this slot: start over with its stream
+        if (stream.owner != std::this_thread::get_id()) {
+            stream.owner = std::this_thread::get_id();
+            stream.last_block = NO_BLOCK;
+            stream.window = 0;
+        }
+
+        bool sequential = stream.last_block != NO_BLOCK && continues_run(block_number, stream.last_block, 1);
+        stream.last_block = block_number;
+        if (!sequential) {
+            stream.window = 0;
+            stream.ra_end = block_number + 1;
+            return;
+        }
+
+        // Keep roughly one window queued ahead of the reader. Each time it
+        // gets within half a window of the end, queue more and grow the window.
+        if (stream.window == 0) {
+            stream.window = m_options.readahead_min_window;
+            stream.ra_end = block_number + 1;
+        }
+        else if (stream.ra_end < block_number + 1 + (stream.window + 1) / 2) {
+            stream.window = std::min(stream.window * 2, m_options.readahead_max_window);
+        }
+        else {
+            return;
+        }
+
+        // Not past the last block of the device
+        uint64_t device_end = block_number | (MAX_DEVICE_BLOCKS - 1);
+        first = std::max(stream.ra_end, block_number + 1);
+        last = block_number + std::min<uint64_t>(stream.window, device_end - block_number);
+        stream.ra_end = last + 1;
+    }
+
+    queue_readahead(first, last);
+}
+
+void myBufferCache::queue_readahead(uint64_t first_block, uint64_t last_block) {
+    if (last_block < first_block) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_readahead_mutex);
+        if (m_readahead_stop) return;
+
+        // Drop requests when the worker falls far behind; they are only hints
+        size_t queue_limit = 4 * m_options.readahead_max_window;
+        for (uint64_t block = first_block; block <= last_block && m_readahead_queue.size() < queue_limit; ++block) {
+            m_readahead_queue.push_back(block);
+            if (block == last_block) break;
+        }
+
+        if (!m_readahead_thread.joinable()) {
+            m_readahead_thread = std::thread(&myBufferCache::readahead_worker, this);
+        }
+    }
+    m_readahead_cv.notify_one();
+}
+
+void myBufferCache::readahead_worker() {
+    std::unique_lock<std::mutex> lock(m_readahead_mutex);
+
+    while (true) {
+        m_readahead_cv.wait(lock, [this] { return m_readahead_stop || !m_readahead_queue.empty(); });
+        if (m_readahead_stop) return;
+
+        uint64_t block_number = m_readahead_queue.front();
+        m_readahead_queue.pop_front();
+
+        lock.unlock();
+        prefetch(block_number);
+        lock.lock();
+    }
+}
+
+void myBufferCache::prefetch(uint64_t block_number) {
+    Shard& shard = shard_for(block_number);
+    Buffer* buffer = nullptr;
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        if (find_buffer(shard, block_number)) return;
+
+        try {
+            buffer = claim_buffer(shard, lock, block_number);
+        }
+        catch (const std::exception&) {
+            return; // Read-ahead is best effort; a real getblk will report the error
+        }
+        if (!buffer) return;
+    }
+
+    if (load_from_tier(block_number, buffer->data)) {
+        finish_prefetch(shard, buffer, nullptr);
+        return;
+    }
+
+    // With an I/O engine the worker only queues the read, so a whole
+    // window can be in flight at once
+    if (!m_io.empty()) {
+        char* data = buffer->data;
+        submit_read_run(block_number, 1, &data, [this, &shard, buffer](std::exception_ptr error) {
+            finish_prefetch(shard, buffer, error);
+        });
+        return;
+    }
+
+    std::exception_ptr error;
+    try {
+        read_from_disk(block_number, *buffer);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+    finish_prefetch(shard, buffer, error);
+}
+
+void myBufferCache::finish_prefetch(Shard& shard, Buffer* buffer, std::exception_ptr error) {
+    if (error) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        abandon_buffer(shard, buffer);
+        return;
+    }
+
+    buffer->readahead = true;
+    buffer->valid = true;
+    buffer->state.store(0);
+    count(READAHEAD_ISSUED);
+    if (shard.waiters > 0) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        wake_waiters(shard);
+    }
+}
+
+void myBufferCache::mark_dirty(Shard& shard, Buffer* buffer) {
+    if (buffer->dirty) return;
+
+    buffer->dirty = true;
+    buffer->dirty_since = std::chrono::steady_clock::now();
+
+    // Append to the dirty list so it stays ordered by age
+    buffer->dirty_prev = shard.dirty_tail;
+    buffer->dirty_next = nullptr;
+    if (shard.dirty_tail) {
+        shard.dirty_tail->dirty_next = buffer;
+    }
+    else {
+        shard.dirty_head = buffer;
+    }
+    shard.dirty_tail = buffer;
+    shard.dirty_blocks.emplace(buffer->block_number, buffer);
+
+    size_t dirty = m_dirty_count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (m_flush_threshold && dirty == m_flush_threshold + 1) {
+        wake_flusher();
+    }
+}
+
+void myBufferCache::mark_clean(Shard& shard, Buffer* buffer) {
+    if (!buffer->dirty) return;
+
+    buffer->dirty = false;
+    if (buffer->dirty_prev) {
+        buffer->dirty_prev->dirty_next = buffer->dirty_next;
+    }
+    else {
+        shard.dirty_head = buffer->dirty_next;
+    }
+    if (buffer->dirty_next) {
+        buffer->dirty_next->dirty_prev = buffer->dirty_prev;
+    }
+    else {
+        shard.dirty_tail = buffer->dirty_prev;
+    }
+    buffer->dirty_prev = nullptr;
+    buffer->dirty_next = nullptr;
+    shard.dirty_blocks.erase(buffer->block_number);
+
+    m_dirty_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void myBufferCache::wake_flusher() {
+    if (!m_flush_thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_flush_mutex);
+        m_flush_requested = true;
+    }
+    m_flush_cv.notify_one();
+}
+
+void myBufferCache::throttle_writer() {
+    if (dirty_count() <= m_throttle_threshold) return;
+
+    count(THROTTLED_WRITES);
+    wake_flusher();
+
+    // Wait for the flusher to bring the dirty count back under the limit.
+    // The timeout covers write-backs done by evictions or bsync, which don't
+    // signal m_throttle_cv.
+    std::unique_lock<std::mutex> lock(m_flush_mutex);
+    while (!m_flush_stop && dirty_count() > m_throttle_threshold) {
+        m_throttle_cv.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+void myBufferCache::flusher_worker() {
+    std::unique_lock<std::mutex> lock(m_flush_mutex);
+
+    while (!m_flush_stop) {
+        m_flush_cv.wait_for(lock, m_options.flush_interval,
+            [this] { return m_flush_stop || m_flush_requested; });
+        if (m_flush_stop) break;
+        m_flush_requested = false;
+
+        lock.unlock();
+        try {
+            flush_pass();
+        }
+        catch (const std::exception&) {
+            // Keep the data dirty; the next pass or bsync() will retry
+        }
+        lock.lock();
+
+        m_throttle_cv.notify_all();
+    }
+}
+
+void myBufferCache::flush_pass() {
+    // Flush everything older than flush_age. Once over the dirty threshold,
+    // keep flushing the oldest buffers until half of it is left.
+    auto cutoff = std::chrono::steady_clock::now() - m_options.flush_age;
+    size_t target = dirty_count() > m_flush_threshold ? m_flush_threshold / 2 : SIZE_MAX;
+
+    for (auto& shard : m_shards) {
+        while (flush_shard(*shard, cutoff, target) > 0) {
+            m_throttle_cv.notify_all();
+        }
+    }
+}
+
+size_t myBufferCache::flush_shard(Shard& shard, std::chrono::steady_clock::time_point cutoff, size_t target) {
+    // Take a batch at a time, so buffers dirtied meanwhile are seen in
+    // order; with an I/O engine, enough to fill its queue
+    size_t max_batch = !m_io.empty() ? std::max<size_t>(16, m_options.io_queue_depth) : 16;
+    std::vector<Buffer*> batch;
+
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        for (Buffer* buf = shard.dirty_head; buf && batch.size() < max_batch; buf = buf->dirty_next) {
+            bool too_old = buf->dirty_since <= cutoff;
+            bool over_limit = dirty_count() > target + batch.size();
+            if (!too_old && !over_limit) break;  // The rest of the list is younger
+
+            // A buffer locked exclusively may be changing under us; skip it
+            if (try_pin(buf, LockMode::Shared)) {
+                batch.push_back(buf);
+            }
+        }
+    }
+
+    size_t n = batch.size();
+    write_back_batch(batch);
+    count(FLUSHER_WRITES, n);
+    return n;
+}
 
-    auto it = std::find(m_lru_list.begin(), m_lru_list.end(), buffer);
-    if (it != m_lru_list.end()) {
-        m_lru_list.erase(it);
+bool myBufferCache::load_from_tier(uint64_t block_number, char* data) {
+    if (!m_tier) return false;
+
+    bool found = m_tier->take(block_number, data);
+    count(found ? TIER_HITS : TIER_MISSES);
+    return found;
+}
+
+void myBufferCache::read_from_disk(uint64_t block_number, Buffer& buffer) {
+    ForegroundRead foreground(m_foreground_reads);
+    Clock::time_point start = m_trace ? Clock::now() : Clock::time_point();
+    m_device->read_block(block_number, buffer.data);
+    count(DISK_READS);
+    if (m_trace) {
+        m_trace->record(TraceEventType::Read, block_number, 0, trace_duration(elapsed_ns(start)));
     }
 }
 
-void myBufferCache::read_from_disk(int block_number, Buffer& buffer) {
-    // Simulate disk read - in real system this would be actual disk I/O
-    std::cout << "Reading block " << block_number << " from disk\n";
-    memset(buffer.data, 0, sizeof(buffer.data));
-    snprintf(buffer.data, sizeof(buffer.data), "Data for block %d", block_number);
+void myBufferCache::read_run_from_disk(uint64_t first_block, size_t n, char* const* data) {
+    ForegroundRead foreground(m_foreground_reads);
+    Clock::time_point start = m_trace ? Clock::now() : Clock::time_point();
+    m_device->read_blocks(first_block, n, data);
+    count(DISK_READS, n);
+    if (m_trace) {
+        m_trace->record(TraceEventType::Read, first_block, 0, trace_duration(elapsed_ns(start)));
+    }
 }
 
 void myBufferCache::write_to_disk(const Buffer& buffer) {
-    // Simulate disk write - in real system this would be actual disk I/O
-    std::cout << "Writing block " << buffer.block_number << " to disk\n";
+    auto start = Clock::now();
+    m_device->write_block(buffer.block_number, buffer.data);
+
+    StatsStripe& stats = local_stats();
+    stats.counters[DISK_WRITES].fetch_add(1, std::memory_order_relaxed);
+    uint64_t ns = elapsed_ns(start);
+    stats.writeback_latency.record(ns);
+    if (m_trace) {
+        m_trace->record(TraceEventType::Write, buffer.block_number, 0, trace_duration(ns));
+    }
+}
+
+void myBufferCache::write_run_to_disk(uint64_t first_block, size_t n, const char* const* data) {
+    auto start = Clock::now();
+    m_device->write_blocks(first_block, n, data);
+
+    StatsStripe& stats = local_stats();
+    stats.counters[DISK_WRITES].fetch_add(n, std::memory_order_relaxed);
+    uint64_t ns = elapsed_ns(start);
+    stats.writeback_latency.record(ns);
+    if (m_trace) {
+        m_trace->record(TraceEventType::Write, first_block, 0, trace_duration(ns));
+    }
+}
+
+IoEngine& myBufferCache::io_for(uint64_t first_block, size_t n) const {
+    m_device->device_for(first_block, n);  // Throws for keys of no device
+    return *m_io[key_device(first_block)];
+}
+
+void myBufferCache::submit_read_run(uint64_t first_block, size_t n, char* const* data, IoEngine::Completion done) {
+    auto start = Clock::now();
+    m_foreground_reads.fetch_add(1, std::memory_order_relaxed);
+    auto complete = [this, first_block, n, start, done](std::exception_ptr error) {
+        m_foreground_reads.fetch_sub(1, std::memory_order_relaxed);
+        if (!error) {
+            count(DISK_READS, n);
+            if (m_trace) {
+                m_trace->record(TraceEventType::Read, first_block, 0, trace_duration(elapsed_ns(start)));
+            }
+        }
+        done(error);
+    };
+
+    try {
+        io_for(first_block, n).submit_read(key_block(first_block), n, data, std::move(complete));
+    }
+    catch (...) {
+        // Not submitted, so complete never runs: the count comes back here
+        m_foreground_reads.fetch_sub(1, std::memory_order_relaxed);
+        done(std::current_exception());
+    }
+}
+
+void myBufferCache::submit_write_run(uint64_t first_block, size_t n, const char* const* data, IoEngine::Completion done) {
+    auto start = Clock::now();
+    auto complete = [this, first_block, n, start, done](std::exception_ptr error) {
+        if (!error) {
+            uint64_t ns = elapsed_ns(start);
+            StatsStripe& stats = local_stats();
+            stats.counters[DISK_WRITES].fetch_add(n, std::memory_order_relaxed);
+            stats.writeback_latency.record(ns);
+            if (m_trace) {
+                m_trace->record(TraceEventType::Write, first_block, 0, trace_duration(ns));
+            }
+        }
+        done(error);
+    };
+
+    try {
+        io_for(first_block, n).submit_write(key_block(first_block), n, data, std::move(complete));
+    }
+    catch (...) {
+        done(std::current_exception());
+    }
+}
+
+void myBufferCache::dump_trace(const std::string& path) const {
+    if (!m_trace) {
+        throw std::logic_error("Tracing is not enabled for this cache");
+    }
+    m_trace->dump(path);
 }
 
 size_t myBufferCache::size() const {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_block_map.size();
+    size_t total = 0;
+    for (auto& shard : m_shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        total += shard->index.size();
+    }
+    return total;
+}
+
+myBufferCache::StatsStripe& myBufferCache::local_stats() const {
+    return m_stats[t_stats_stripe % NUM_STAT_STRIPES];
+}
+
+void myBufferCache::count(Counter counter, uint64_t n) const {
+    local_stats().counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+size_t myBufferCache::total(Counter counter) const {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < NUM_STAT_STRIPES; ++i) {
+        sum += m_stats[i].counters[counter].load(std::memory_order_relaxed);
+    }
+    return static_cast<size_t>(sum);
+}
+
+myBufferCache::Stats myBufferCache::stats() const {
+    Stats stats;
+    stats.hits = total(HITS);
+    stats.misses = total(MISSES);
+    stats.evictions = total(EVICTIONS);
+    stats.dirty_evictions = total(DIRTY_EVICTIONS);
+    stats.disk_reads = total(DISK_READS);
+    stats.disk_writes = total(DISK_WRITES);
+    stats.readahead_issued = total(READAHEAD_ISSUED);
+    stats.readahead_hits = total(READAHEAD_HITS);
+    stats.readahead_wasted = total(READAHEAD_WASTED);
+    stats.flusher_writes = total(FLUSHER_WRITES);
+    stats.throttled_writes = total(THROTTLED_WRITES);
+    stats.lock_waits = total(LOCK_WAITS);
+    stats.free_waits = total(FREE_WAITS);
+    stats.wait_time = std::chrono::nanoseconds(total(WAIT_TIME_NS));
+    stats.dirty = dirty_count();
+    if (m_journal) {
+        stats.journal_records = m_journal->records();
+        stats.journal_commits = m_journal->commits();
+    }
+    stats.checkpoints = total(CHECKPOINTS);
+    stats.tier_hits = total(TIER_HITS);
+    stats.tier_misses = total(TIER_MISSES);
+    stats.warm_loaded = total(WARM_LOADS);
+    if (m_tier) {
+        stats.tier_blocks = m_tier->blocks();
+        stats.tier_bytes = m_tier->bytes();
+        if (stats.tier_bytes > 0) {
+            stats.tier_compression_ratio = static_cast<double>(stats.tier_blocks * block_size()) / stats.tier_bytes;
+        }
+    }
+
+    for (size_t i = 0; i < NUM_STAT_STRIPES; ++i) {
+        m_stats[i].hit_latency.add_to(stats.hit_latency);
+        m_stats[i].miss_latency.add_to(stats.miss_latency);
+        m_stats[i].tier_latency.add_to(stats.tier_latency);
+        m_stats[i].writeback_latency.add_to(stats.writeback_latency);
+        m_stats[i].eviction_latency.add_to(stats.eviction_latency);
+    }
+    return stats;
 }
 
 size_t myBufferCache::hits() const {
-    return m_hits;
+    return total(HITS);
 }
 
 size_t myBufferCache::misses() const {
-    return m_misses;
+    return total(MISSES);
 }
 
 size_t myBufferCache::disk_writes() const {
-    return m_disk_writes;
+    return total(DISK_WRITES);
+}
+
+size_t myBufferCache::readahead_issued() const {
+    return total(READAHEAD_ISSUED);
+}
+
+size_t myBufferCache::readahead_hits() const {
+    return total(READAHEAD_HITS);
+}
+
+size_t myBufferCache::readahead_wasted() const {
+    return total(READAHEAD_WASTED);
+}
+
+size_t myBufferCache::flusher_writes() const {
+    return total(FLUSHER_WRITES);
+}
+
+size_t myBufferCache::eviction_writebacks() const {
+    return total(DIRTY_EVICTIONS);
+}
+
+size_t myBufferCache::throttled_writes() const {
+    return total(THROTTLED_WRITES);
+}
+
+size_t myBufferCache::buffer_lock_waits() const {
+    return total(LOCK_WAITS);
+}
+
+size_t myBufferCache::free_buffer_waits() const {
+    return total(FREE_WAITS);
+}
+
+std::chrono::nanoseconds myBufferCache::wait_time() const {
+    return std::chrono::nanoseconds(total(WAIT_TIME_NS));
 }
\ No newline at end of file
@@ -2,65 +2,698 @@
 #ifndef UNIX_BUFFER_CACHE_H
 #define UNIX_BUFFER_CACHE_H
 
+#include <map>
 #include <unordered_map>
-#include <list>
+#include <vector>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
 #include <functional>
+#include <span>
+#include <string>
+#include "block_device.h"
+#include "block_index.h"
+#include "buffer_arena.h"
+#include "cache_stats.h"
+#include "compressed_tier.h"
+#include "executor.h"
+#include "io_engine.h"
+#include "journal.h"
+#include "memory_pressure.h"
+#include "trace_ring.h"
 
 class myBufferCache {
 public:
-    // Represents a disk block in memory
+    static constexpr size_t BLOCK_SIZE = 4096;  // Default block size, typical for Unix
+    static constexpr size_t MIN_BLOCK_SIZE = 512;
+    static constexpr size_t MAX_BLOCK_SIZE = 64 * 1024;
+
+    // Represents a disk block in memory. Buffers only hold metadata; the
+    // block data lives in the cache's BufferArena, page aligned, so it can be
+    // handed straight to O_DIRECT reads and header scans stay compact.
+    //
+    // block_number and valid only change while the buffer is FROZEN, so a
+    // caller that managed to pin it may read them without the shard lock.
     struct Buffer {
-        int block_number;       // Disk block number
+        char* data;             // Block data, block_size() bytes
+        uint64_t block_number;  // Block key: device and block (see block_key)
         bool dirty;             // Whether the block has been modified
         bool valid;             // Whether the data is valid
-        char data[4096];        // Block data (typically 4KB in Unix systems)
+        std::atomic<bool> readahead;  // Loaded by read-ahead and not requested yet
+
+        // Pin state in one atomic word so cache hits can pin a buffer without
+        // the shard lock: the number of callers holding it between getblk and
+        // brelse, plus EXCLUSIVE when one holder may modify it and FROZEN
+        // while the cache is loading or evicting it. A pinned buffer is never
+        // evicted.
+        static constexpr uint32_t PIN_MASK = 0xFFFF;
+        static constexpr uint32_t EXCLUSIVE = 1u << 16;
+        static constexpr uint32_t FROZEN = 1u << 17;
+        std::atomic<uint32_t> state;
+
+        // Intrusive links and state owned by the shard's ReplacementPolicy,
+        // so every policy operation is O(1)
+        Buffer* policy_prev;
+        Buffer* policy_next;
+        unsigned char policy_queue;    // Which of the policy's lists holds the buffer
+        std::atomic<bool> referenced;  // Set by lock-free hits and releases
+
+        // Links in the shard's dirty list, oldest modification first
+        Buffer* dirty_prev;
+        Buffer* dirty_next;
+        std::chrono::steady_clock::time_point dirty_since;
+
+        Buffer() : data(nullptr), block_number(NO_BLOCK), dirty(false), valid(false), readahead(false),
+            state(FROZEN),
+            policy_prev(nullptr), policy_next(nullptr), policy_queue(0), referenced(false),
+            dirty_prev(nullptr), dirty_next(nullptr) {}
+
+        unsigned pin_count() const { return state.load() & PIN_MASK; }
+        // Held by a caller or by the cache itself; not evictable
+        bool pinned() const { return (state.load() & (PIN_MASK | FROZEN)) != 0; }
+        bool exclusive() const { return (state.load() & EXCLUSIVE) != 0; }
+    };
+
+    // How getblk locks the returned buffer
+    enum class LockMode {
+        Shared,     // Several readers may hold the buffer at once
+        Exclusive   // A single holder that may modify the data (default)
+    };
+
+    enum class Policy {
+        LRU,     // Least recently used (default)
+        CLOCK,   // Second chance with a reference bit
+        TwoQ,    // 2Q: new blocks must be re-referenced to enter the main LRU
+        ARC      // Adaptive replacement cache
+    };
+
+    // Replacement strategy of one shard. All calls are made with the shard
+    // lock held; pinned buffers must never be chosen as victims.
+    //
+    // Hits and releases that bypass the lock only set Buffer::referenced.
+    // Policies fold those deferred references in when the buffer comes up
+    // for eviction, as CLOCK does.
+    class ReplacementPolicy {
+    public:
+        virtual ~ReplacementPolicy() = default;
+
+        virtual const char* name() const = 0;
+
+        // buffer now holds a newly loaded block (buffer->block_number is set)
+        virtual void on_insert(Buffer* buffer) = 0;
+        // A cached block was requested again (through the locked path)
+        virtual void on_hit(Buffer* buffer) = 0;
+        // The caller released the buffer
+        virtual void on_release(Buffer* buffer) { (void)buffer; }
+        // Pick a buffer to make room for incoming_block; nullptr if all are
+        // pinned. With prefer_clean, a clean buffer near the victim position is
+        // taken over a dirty one.
+        virtual Buffer* choose_victim(uint64_t incoming_block, bool prefer_clean) = 0;
+        // The victim's block is leaving the cache
+        virtual void on_evict(Buffer* buffer) = 0;
+        // Append every buffer the policy holds, those it would keep
+        // longest first
+        virtual void hottest_first(std::vector<Buffer*>& out) const = 0;
+        // to now holds from's block, which it takes over from a buffer being
+        // retired by resize(); to keeps from's place, and from is forgotten
+        virtual void on_move(Buffer* from, Buffer* to) = 0;
+        // The shard now has capacity buffers
+        virtual void set_capacity(size_t capacity) { (void)capacity; }
+
+        // For a shard of capacity buffers that can grow to max_capacity;
+        // the policy allocates nothing more after this
+        static std::unique_ptr<ReplacementPolicy> create(Policy policy, size_t capacity, size_t max_capacity);
+    };
+
+    struct Options {
+        // Block numbers are hashed across this many independent shards,
+        // each with its own lock
+        size_t num_shards = 1;
+
+        // Backing storage; an in-memory device is used when empty
+        std::shared_ptr<BlockDevice> device;
+
+        // Further devices fronted by the same cache, numbered from 1 (device
+        // is number 0), all with its block size. Their blocks are addressed
+        // by the keys block_key(device, block) makes; the blocks of device 0
+        // keep their plain numbers. Every device gets its own I/O engine.
+        std::vector<std::shared_ptr<BlockDevice>> devices{};
+
+        // Replacement policy used by every shard
+        Policy policy = Policy::LRU;
 
-        Buffer() : block_number(-1), dirty(false), valid(false) {}
+        // Sequential read-ahead: once a thread reads consecutive blocks the
+        // following ones are loaded in the background. The window starts at
+        // readahead_min_window blocks and doubles up to readahead_max_window
+        // while the stream stays sequential.
+        bool readahead = false;
+        size_t readahead_min_window = 4;
+        size_t readahead_max_window = 64;
+
+        // Background flusher (bdflush). Every flush_interval a thread writes
+        // back released buffers that have been dirty for flush_age, and the
+        // oldest ones whenever more than flush_dirty_ratio of the cache is
+        // dirty. brelse(buf, true) blocks while more than
+        // throttle_dirty_ratio of the cache is dirty.
+        bool background_flush = false;
+        std::chrono::milliseconds flush_interval{ 100 };
+        std::chrono::milliseconds flush_age{ 1000 };
+        double flush_dirty_ratio = 0.10;
+        double throttle_dirty_ratio = 0.40;
+
+        // Bytes per block: a power of two between MIN_BLOCK_SIZE and
+        // MAX_BLOCK_SIZE, equal to the device's block size
+        size_t block_size = BLOCK_SIZE;
+
+        // Back the buffer arena with huge pages where the system allows it
+        bool huge_pages = false;
+
+        // Record getblk, brelse, evict, read and write events in per-thread
+        // rings of trace_events_per_thread entries (see dump_trace)
+        bool trace = false;
+        size_t trace_events_per_thread = 4096;
+
+        // Queue batched misses (getblk_many), read-ahead, getblk_async and
+        // bwrite_async, and the write-backs of the flusher and bsync on an
+        // IoEngine, io_uring or a thread pool, with up to io_queue_depth
+        // requests in flight. Without it they are done one at a time.
+        // Either way no shard lock is held during device I/O.
+        bool async_io = false;
+        size_t io_queue_depth = 32;
+
+        // Write-ahead journal, off when journal_path is empty. bwrite then
+        // logs the block to journal_path + ".0" or ".1" instead of writing
+        // it home, and returns once the log is synced; concurrent bwrites
+        // share one sync (group commit). The buffer stays dirty until a
+        // write-back or a checkpoint: when the active log holds
+        // journal_checkpoint_blocks blocks, a background thread switches to
+        // the other one and writes home the blocks logged in the first.
+        // The logs are replayed onto the device on construction, so after a
+        // crash every block written with bwrite holds the contents of its
+        // last completed bwrite, or of one in progress; changes that were
+        // only released dirty since then may be lost.
+        std::string journal_path{};
+        size_t journal_checkpoint_blocks = 16384;
+
+        // Compressed second tier, off when 0. Clean blocks evicted from the
+        // cache are kept compressed in up to this many bytes of RAM (at
+        // least one block per shard), and a miss takes its block from there
+        // instead of reading the device when it can.
+        size_t compressed_tier_bytes = 0;
+
+        // Warm restart, off when warm_path is empty. The destructor saves
+        // the cached block numbers there (see save_warm_set), and the
+        // constructor starts a thread that reads the saved blocks back into
+        // free buffers, hottest first, never evicting anything: sorted, a
+        // run of consecutive blocks per device request, several requests
+        // queued with async_io, and holding back while getblk misses are
+        // reading the device.
+        std::string warm_path{};
+
+        // Largest size resize() may grow the cache to, in blocks; 0 keeps
+        // it at the initial size. Buffer headers for all of them are
+        // allocated up front, so buffers never move, and the arena is
+        // reserved but only takes memory for the blocks in use (all of it
+        // with explicit huge pages).
+        size_t max_cache_size = 0;
+
+        // Memory-pressure hook, off when empty. Every memory_poll_interval
+        // a thread calls it with the bytes the cache's blocks take now and
+        // resizes the cache to what fits in the bytes it returns, between
+        // one block per shard and max_cache_size. See memory_pressure.h
+        // for budgets following a fixed limit or the memory left free.
+        std::function<size_t(size_t)> memory_budget{};
+        std::chrono::milliseconds memory_poll_interval{ 1000 };
     };
 
+    // Point-in-time copy of the cache counters. Counters are per thread
+    // stripe and summed without stopping the cache, so each value is exact
+    // but they may be a few operations apart from each other.
+    struct Stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;           // Blocks dropped to make room
+        size_t dirty_evictions = 0;     // ... that had to be written back first
+        size_t disk_reads = 0;
+        size_t disk_writes = 0;
+        size_t readahead_issued = 0;    // Blocks loaded by read-ahead
+        size_t readahead_hits = 0;      // ... that were later requested
+        size_t readahead_wasted = 0;    // ... that were evicted unused
+        size_t flusher_writes = 0;      // Write-backs done by the flusher
+        size_t throttled_writes = 0;    // brelse calls that had to wait
+        size_t lock_waits = 0;          // getblk calls that waited for a holder
+        size_t free_waits = 0;          // getblk calls that waited for any buffer
+        std::chrono::nanoseconds wait_time{ 0 };  // Total time spent in those waits
+        size_t dirty = 0;
+        size_t journal_records = 0;     // Blocks logged by bwrite
+        size_t journal_commits = 0;     // ... log syncs they shared
+        size_t checkpoints = 0;         // Logs emptied by writing their blocks home
+        size_t tier_hits = 0;           // Misses served by the compressed tier
+        size_t tier_misses = 0;         // ... and those it could not serve
+        size_t tier_blocks = 0;         // Blocks held by the tier
+        size_t tier_bytes = 0;          // ... and the memory they take
+        double tier_compression_ratio = 0.0;  // Block bytes per stored byte
+        size_t warm_loaded = 0;         // Blocks loaded by the warm-restart thread
+
+        // getblk latency split by outcome (hits are sampled, 1 in
+        // HIT_SAMPLE_INTERVAL; misses read from the device, or served by
+        // the compressed tier), device writes, and freeing a victim
+        // including its write-back or compression
+        LatencyHistogram::Snapshot hit_latency;
+        LatencyHistogram::Snapshot miss_latency;
+        LatencyHistogram::Snapshot tier_latency;
+        LatencyHistogram::Snapshot writeback_latency;
+        LatencyHistogram::Snapshot eviction_latency;
+
+        double hit_ratio() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+        double tier_hit_ratio() const {
+            return tier_hits + tier_misses ? static_cast<double>(tier_hits) / (tier_hits + tier_misses) : 0.0;
+        }
+    };
+
+    // Only every HIT_SAMPLE_INTERVAL-th hit of a thread is timed; reading the
+    // clock would otherwise cost about as much as the hit itself
+    static constexpr unsigned HIT_SAMPLE_INTERVAL = 64;
+
     // Constructor with configurable cache size
-    explicit myBufferCache(size_t cache_size);
+    explicit myBufferCache(size_t cache_size, size_t num_shards = 1);
+    myBufferCache(size_t cache_size, const Options& options);
     ~myBufferCache();
 
-    // Main interface methods
-    Buffer* getblk(int block_number);
+    // Main interface methods. getblk returns the buffer pinned and locked in
+    // the given mode, waiting while another holder conflicts or while every
+    // buffer of the shard is pinned; it never returns nullptr. Each getblk
+    // must be paired with one brelse.
+    //
+    // A hit that can be pinned straight away takes no lock at all, and
+    // neither does a brelse that does not dirty the buffer. A miss holds the
+    // shard lock only to claim a buffer and reads the block without it;
+    // callers asking for the same block meanwhile wait for that read.
+    //
+    // Block numbers throughout are block keys (block_device.h): a plain
+    // number for Options::device, block_key(device, block) for the others.
+    // A key naming no device throws std::out_of_range when it is read.
+    Buffer* getblk(uint64_t block_number, LockMode mode = LockMode::Exclusive);
     void brelse(Buffer* buffer, bool mark_dirty = false);
-    void bwrite(Buffer* buffer);  // Write buffer to disk
-    void bsync();                // Sync all dirty buffers to disk
+    void bwrite(Buffer* buffer);  // Write buffer to disk, or to the journal
+
+    // Write dirty buffers back and sync the device: all of them, or those
+    // of blocks first_block..last_block. They go out in ascending block
+    // order, each run of consecutive blocks as one vectored write, and
+    // only the dirty buffers are visited. Shard locks are held only while
+    // picking up to a few hundred buffers at a time, never during the
+    // writes, so the cache stays usable throughout. Buffers held
+    // exclusively, or being written back by an eviction, are waited for:
+    // don't sync blocks the calling thread holds exclusively.
+    void bsync();
+    void bsync_range(uint64_t first_block, uint64_t last_block);
+
+    // Classic breada: getblk(block_number) and start loading ra_block_number
+    // in the background
+    Buffer* breada(uint64_t block_number, uint64_t ra_block_number);
+
+    // Batched getblk: out[i] receives blocks[i] as getblk(blocks[i], mode)
+    // would return it, but hits are pinned and misses claimed under one lock
+    // acquisition per shard, and misses on consecutive blocks are loaded with
+    // a single BlockDevice::read_blocks call made without any lock held.
+    // Blocks must be distinct (std::invalid_argument otherwise). Blocks that
+    // cannot be had without waiting are then taken in order with getblk, so
+    // the usual rule applies: lock several blocks in a consistent order.
+    void getblk_many(std::span<const uint64_t> blocks, std::span<Buffer*> out, LockMode mode = LockMode::Exclusive);
+    // brelse every buffer (nullptr entries are skipped). Marking them dirty
+    // takes each shard lock once for the whole batch.
+    void brelse_many(std::span<Buffer* const> buffers, bool mark_dirty = false);
+
+    // Awaitable getblk and bwrite for coroutines run by an Executor:
+    //
+    //     Buffer* buf = co_await cache.getblk_async(block_number);
+    //     ...
+    //     co_await cache.bwrite_async(buf);
+    //     cache.brelse(buf);
+    //
+    // A hit completes without suspending. A miss suspends the coroutine
+    // until the block has been read, and a conflicting holder until it
+    // releases the buffer; the executor runs other tasks meanwhile and
+    // resumes the coroutine once the buffer is pinned or an error is
+    // thrown. Reads and writes are queued on the I/O engine
+    // (Options::async_io); without one they are done in place and block
+    // the executor thread. Suspending outside Executor::run throws
+    // std::logic_error.
+    class GetblkOperation;
+    class BwriteOperation;
+    GetblkOperation getblk_async(uint64_t block_number, LockMode mode = LockMode::Exclusive);
+    BwriteOperation bwrite_async(Buffer* buffer);
+
+    // Save the numbers of the cached blocks to path for Options::warm_path,
+    // hottest first by each shard's policy, the shards interleaved. The
+    // file is replaced atomically; std::runtime_error on I/O errors.
+    void save_warm_set(const std::string& path) const;
+    // Whether the warm-restart thread is still loading
+    bool warming() const { return m_warming.load(); }
+
+    // Change the number of buffers, from one per shard up to
+    // Options::max_cache_size (std::invalid_argument otherwise). Growing
+    // adds free buffers at once. Shrinking takes buffers out of use a few
+    // at a time with the shard lock released in between: a dirty one is
+    // written back first, and the block it holds either moves into the
+    // buffer of a colder block, which is evicted instead, or is evicted
+    // itself if it is the coldest. Pinned buffers are waited for, so
+    // shrinking returns only once no caller holds a buffer being removed.
+    // Buffer pointers stay valid throughout. Calls are serialized.
+    void resize(size_t cache_size);
+    size_t capacity() const { return m_capacity.load(); }
 
     // Statistics
+    Stats stats() const;
     size_t size() const;
     size_t hits() const;
     size_t misses() const;
     size_t disk_writes() const;
+    size_t readahead_issued() const;  // Blocks loaded by read-ahead
+    size_t readahead_hits() const;    // ... that were later requested
+    size_t readahead_wasted() const;  // ... that were evicted unused
+    size_t dirty_count() const { return m_dirty_count.load(std::memory_order_relaxed); }
+    size_t flusher_writes() const;       // Write-backs done by the flusher
+    size_t eviction_writebacks() const;  // Write-backs paid for by a miss
+    size_t recovered_blocks() const { return m_recovered_blocks; }  // Replayed from the journal
+    size_t throttled_writes() const;     // brelse calls that had to wait
+    size_t buffer_lock_waits() const;    // getblk calls that waited for a holder
+    size_t free_buffer_waits() const;    // getblk calls that waited for any buffer
+    std::chrono::nanoseconds wait_time() const;  // Total time spent in those waits
+    size_t shard_count() const { return m_shards.size(); }
+    size_t block_size() const { return m_options.block_size; }
+    bool huge_pages() const { return m_arena->huge_pages(); }
+    const char* policy_name() const { return m_shards[0]->policy->name(); }
+    BlockDevice& device(uint32_t index = 0) const { return *m_device->device(index); }
+    size_t device_count() const { return m_device->size(); }
+    const char* io_engine_name() const { return m_io.empty() ? "synchronous" : m_io[0]->name(); }
+
+    // Event trace, or nullptr when Options::trace is off. dump_trace writes
+    // it to a file for BufferCacheTraceDump; it throws std::logic_error if
+    // tracing is off and std::runtime_error on I/O errors.
+    const TraceRing* trace() const { return m_trace.get(); }
+    void dump_trace(const std::string& path) const;
+
+    class GetblkOperation {
+    public:
+        bool await_ready();
+        bool await_suspend(std::coroutine_handle<> handle);
+        Buffer* await_resume() const;
+
+    private:
+        friend class myBufferCache;
+
+        GetblkOperation(myBufferCache& cache, uint64_t block_number, LockMode mode)
+            : m_cache(cache), m_block_number(block_number), m_mode(mode) {}
+
+        myBufferCache& m_cache;
+        uint64_t m_block_number;
+        LockMode m_mode;
+        Buffer* m_buffer = nullptr;
+        std::exception_ptr m_error;
+
+        // Set once suspended
+        std::coroutine_handle<> m_handle;
+        Executor* m_executor = nullptr;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::steady_clock::time_point m_wait_start;
+        bool m_waited_for_lock = false;
+        bool m_waited_for_free = false;
+        GetblkOperation* m_next_waiter = nullptr;  // In Shard::async_waiters
+    };
+
+    class BwriteOperation {
+    public:
+        bool await_ready() const { return !m_buffer || !m_buffer->valid; }
+        bool await_suspend(std::coroutine_handle<> handle);
+        void await_resume() const;
+
+    private:
+        friend class myBufferCache;
+
+        BwriteOperation(myBufferCache& cache, Buffer* buffer) : m_cache(cache), m_buffer(buffer) {}
+
+        myBufferCache& m_cache;
+        Buffer* m_buffer;
+        std::exception_ptr m_error;
+    };
 
 private:
+    // A slice of the cache with its own map, LRU list and lock. Shards are
+    // cache-line aligned so that neighbouring locks don't share a line.
+    struct alignas(64) Shard {
+        Buffer* buffers_begin = nullptr;  // Buffers owned by this shard,
+        Buffer* buffers_end = nullptr;    // up to the current size
+        Buffer* buffers_limit = nullptr;  // ... and to Options::max_cache_size
+        // While resize() shrinks the shard, the buffers from here to
+        // buffers_end are being retired rather than reused; otherwise
+        // equal to buffers_end
+        Buffer* retire_from = nullptr;
+
+        // Buffers that have never held a block
+        std::vector<Buffer*> free_list;
+
+        // Replacement state, and block key -> index into m_buffers.
+        // The index may be searched without the lock.
+        std::unique_ptr<ReplacementPolicy> policy;
+        BlockIndex index;
+
+        // Dirty buffers in the order they were first modified, and by
+        // block number for bsync
+        Buffer* dirty_head = nullptr;
+        Buffer* dirty_tail = nullptr;
+        std::map<uint64_t, Buffer*> dirty_blocks;
+
+        // Synchronization. Callers waiting for a buffer to be released sleep
+        // on wait_cv, or are parked on async_waiters if they came through
+        // getblk_async; brelse only wakes them when waiters (which counts
+        // both) is non-zero.
+        mutable std::mutex mutex;
+        std::condition_variable wait_cv;
+        std::atomic<size_t> waiters{ 0 };
+        GetblkOperation* async_waiters = nullptr;
+
+        explicit Shard(size_t capacity) : index(capacity) {}
+    };
+
+    // Statistics are kept in a few cache-line aligned stripes, each thread
+    // updating the one it was assigned, so counting never contends on the
+    // shard locks or on a shared line.
+    enum Counter {
+        HITS, MISSES, EVICTIONS, DIRTY_EVICTIONS, DISK_READS, DISK_WRITES,
+        READAHEAD_ISSUED, READAHEAD_HITS, READAHEAD_WASTED, FLUSHER_WRITES,
+        THROTTLED_WRITES, LOCK_WAITS, FREE_WAITS, WAIT_TIME_NS, CHECKPOINTS, TIER_HITS, TIER_MISSES,
+        WARM_LOADS, NUM_COUNTERS
+    };
+
+    struct alignas(64) StatsStripe {
+        std::atomic<uint64_t> counters[NUM_COUNTERS]{};
+        LatencyHistogram hit_latency;
+        LatencyHistogram miss_latency;
+        LatencyHistogram tier_latency;
+        LatencyHistogram writeback_latency;
+        LatencyHistogram eviction_latency;
+    };
+    static constexpr size_t NUM_STAT_STRIPES = 16;
+
+    // Sequential access state of one reader thread
+    struct alignas(64) Stream {
+        std::mutex mutex;
+        std::thread::id owner;
+        uint64_t last_block = NO_BLOCK;
+        uint64_t ra_end = 0;   // First block not yet queued for read-ahead
+        size_t window = 0;     // Current read-ahead window, 0 when not sequential
+    };
+    static constexpr size_t NUM_STREAMS = 64;
+
     // Cache storage and metadata
-    size_t m_capacity;
-    size_t m_hits = 0;
-    size_t m_misses = 0;
-    size_t m_disk_writes = 0;
+    std::atomic<size_t> m_capacity;
+    std::shared_ptr<DeviceSet> m_device;  // Options::device and devices, by block key
+    Options m_options;
 
-    // Actual buffer storage
+    // Block data, and the buffer headers pointing into it, split into one
+    // contiguous range per shard, sized for Options::max_cache_size
+    std::unique_ptr<BufferArena> m_arena;
     std::vector<Buffer> m_buffers;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::unique_ptr<StatsStripe[]> m_stats;
+    std::unique_ptr<TraceRing> m_trace;
+    std::vector<std::unique_ptr<IoEngine>> m_io;  // One per device, only with Options::async_io
+    std::unique_ptr<CompressedTier> m_tier;  // Only with Options::compressed_tier_bytes
+
+    // Read-ahead state; the worker thread is started on first use
+    std::unique_ptr<Stream[]> m_streams;
+    std::thread m_readahead_thread;
+    std::mutex m_readahead_mutex;
+    std::condition_variable m_readahead_cv;
+    std::deque<uint64_t> m_readahead_queue;
+    bool m_readahead_stop = false;
+
+    // Background flusher state
+    std::atomic<size_t> m_dirty_count{ 0 };
+    std::atomic<size_t> m_flush_threshold{ 0 };     // Dirty buffers that trigger a flush
+    std::atomic<size_t> m_throttle_threshold{ 0 };  // Dirty buffers that block writers
+    std::thread m_flush_thread;
+    std::mutex m_flush_mutex;
+    std::condition_variable m_flush_cv;
+    std::condition_variable m_throttle_cv;
+    bool m_flush_stop = false;
+    bool m_flush_requested = false;
+
+    // Journal and checkpointer state, only with Options::journal_path. The
+    // blocks of a checkpoint are kept until they are home, so one that
+    // fails is retried.
+    std::unique_ptr<Journal> m_journal;
+    size_t m_recovered_blocks = 0;
+    std::thread m_checkpoint_thread;
+    std::mutex m_checkpoint_mutex;
+    std::condition_variable m_checkpoint_cv;
+    bool m_checkpoint_stop = false;
+    bool m_checkpoint_requested = false;
+    bool m_checkpoint_started = false;
+    std::vector<uint64_t> m_checkpoint_blocks;
+
+    // Warm-restart loader, only with Options::warm_path. Device reads made
+    // for getblk and read-ahead are counted in m_foreground_reads so the
+    // loader can give way to them.
+    std::thread m_warm_thread;
+    std::atomic<bool> m_warm_stop{ false };
+    std::atomic<bool> m_warming{ false };
+    std::atomic<bool> m_warm_failed{ false };
+    std::atomic<int> m_foreground_reads{ 0 };
+    std::mutex m_warm_mutex;
+    std::condition_variable m_warm_cv;
+    size_t m_warm_in_flight = 0;  // Loader reads not yet finished
 
-    // LRU management
-    std::list<Buffer*> m_lru_list;
-    std::unordered_map<int, Buffer*> m_block_map;
+    // Resizing, and the memory-pressure thread of Options::memory_budget
+    std::mutex m_resize_mutex;
+    std::thread m_memory_thread;
+    std::mutex m_memory_mutex;
+    std::condition_variable m_memory_cv;
+    bool m_memory_stop = false;
 
-    // Synchronization
-    mutable std::mutex m_mutex;
+    size_t shard_index(uint64_t block_number) const;
+    Shard& shard_for(uint64_t block_number) const { return *m_shards[shard_index(block_number)]; }
 
-    // Disk I/O simulation (would be replaced with actual disk ops in real system)
-    void read_from_disk(int block_number, Buffer& buffer);
+    // Statistics helpers
+    StatsStripe& local_stats() const;
+    void count(Counter counter, uint64_t n = 1) const;
+    size_t total(Counter counter) const;
+
+    // Read-ahead helpers
+    void note_access(uint64_t block_number);
+    void queue_readahead(uint64_t first_block, uint64_t last_block);
+    void readahead_worker();
+    void prefetch(uint64_t block_number);
+    void finish_prefetch(Shard& shard, Buffer* buffer, std::exception_ptr error);
+
+    // Dirty tracking and background flushing
+    void mark_dirty(Shard& shard, Buffer* buffer);
+    void mark_clean(Shard& shard, Buffer* buffer);
+    void wake_flusher();
+    void throttle_writer();
+    void flusher_worker();
+    void flush_pass();
+    size_t flush_shard(Shard& shard, std::chrono::steady_clock::time_point cutoff, size_t target);
+    // Write back buffers pinned shared, from any shards, sorted by block
+    // and merging runs; then mark them clean, unpin them and rethrow the
+    // first error
+    void write_back_batch(std::vector<Buffer*>& batch);
+    // Write back those of the given blocks that are still dirty, waiting
+    // for each until it can be pinned shared; for the blocks bsync_range
+    // and write_home found held exclusively or frozen
+    void write_back_blocked(const std::vector<uint64_t>& blocks);
+
+    // Journal checkpoints, run by the checkpointer thread. write_home
+    // writes back the dirty buffers of the given sorted blocks, waiting for
+    // those held exclusively.
+    void wake_checkpointer();
+    void checkpoint_worker();
+    void checkpoint();
+    void write_home(const std::vector<uint64_t>& blocks);
+
+    // Resize helpers. A retired buffer is frozen and holds no block; growing
+    // hands retired buffers out again. retire_buffer returns false if buf
+    // is pinned for now. free_buffer puts a buffer that holds no block back
+    // on the free list, or retires it if it is being retired.
+    void grow_shard(Shard& shard, size_t count);
+    void shrink_shard(Shard& shard, size_t count);
+    bool retire_buffer(Shard& shard, std::unique_lock<std::mutex>& lock, Buffer* buf);
+    void free_buffer(Shard& shard, Buffer* buffer);
+    void set_thresholds(size_t cache_size);
+    void memory_worker();
+
+    // Warm restart: load the blocks saved at m_options.warm_path; one run
+    // of sorted blocks into free buffers, returning false once there are
+    // none left or a read failed; publish (or abandon) a loaded stretch
+    void warm_worker();
+    bool warm_run(const uint64_t* blocks, size_t n);
+    void finish_warm_load(const std::vector<Buffer*>& buffers, std::exception_ptr error);
+
+    // Copy block_number out of the compressed tier into data; false if
+    // there is no tier or the block isn't in it. Call without a shard lock,
+    // on a claimed buffer, before reading the device.
+    bool load_from_tier(uint64_t block_number, char* data);
+
+    // Disk I/O through m_device, or queued on the device's engine in m_io
+    // by the submit_ variants. None of them may be called with a shard
+    // lock held.
+    void read_from_disk(uint64_t block_number, Buffer& buffer);
+    void read_run_from_disk(uint64_t first_block, size_t n, char* const* data);
     void write_to_disk(const Buffer& buffer);
+    void write_run_to_disk(uint64_t first_block, size_t n, const char* const* data);
+    void submit_read_run(uint64_t first_block, size_t n, char* const* data, IoEngine::Completion done);
+    void submit_write_run(uint64_t first_block, size_t n, const char* const* data, IoEngine::Completion done);
+    // The engine of the device holding a run of n blocks from first_block,
+    // which it takes as key_block(first_block)
+    IoEngine& io_for(uint64_t first_block, size_t n) const;
+
+    // getblk without the read-ahead bookkeeping, and its lock-free hit
+    // path, which returns nullptr on a miss
+    Buffer* get_buffer(uint64_t block_number, LockMode mode);
+    Buffer* get_cached(Shard& shard, uint64_t block_number, LockMode mode);
+    // The cached buffer for block_number, pinned without the shard lock, or
+    // nullptr if it is not cached or cannot be pinned straight away
+    Buffer* pin_cached(Shard& shard, uint64_t block_number, LockMode mode);
+
+    // Drop a pin without the shard lock and wake any waiters
+    void release_pin(Shard& shard, Buffer* buffer);
+
+    // Helper methods (caller holds shard.mutex). claim_buffer frees a
+    // buffer for block_number without reading it: the buffer is indexed but
+    // not valid, and stays frozen until the caller has loaded it and
+    // publishes it by storing its pin state, or gives it back with
+    // abandon_buffer. It drops the lock while writing back a dirty victim
+    // or compressing a clean one into the tier, and returns nullptr if no
+    // buffer could be freed or if the block was cached by someone else
+    // meanwhile.
+    Buffer* find_buffer(Shard& shard, uint64_t block_number);
+    Buffer* claim_buffer(Shard& shard, std::unique_lock<std::mutex>& lock, uint64_t block_number);
+    void abandon_buffer(Shard& shard, Buffer* buffer);
+    void wait_for_release(Shard& shard, std::unique_lock<std::mutex>& lock, const Buffer* buffer, LockMode mode);
+    // Whether a caller wanting buffer (any buffer of the shard if nullptr)
+    // in the given mode still has to wait
+    bool still_blocked(const Shard& shard, const Buffer* buffer, LockMode mode) const;
+    // Wake every waiter, posting parked getblk_async calls back to their
+    // executors to try again
+    void wake_waiters(Shard& shard);
 
-    // Helper methods
-    Buffer* find_buffer(int block_number);
-    Buffer* allocate_buffer(int block_number);
-    void add_to_lru(Buffer* buffer);
-    void remove_from_lru(Buffer* buffer);
+    // getblk_async steps, run on the operation's executor.
+    // advance_getblk returns true while the operation is suspended; it is
+    // then resumed by whoever completes it. park returns false, without
+    // parking, if the wait is already over.
+    bool advance_getblk(GetblkOperation& op);
+    void retry_getblk(GetblkOperation& op);
+    bool park(Shard& shard, GetblkOperation& op, const Buffer* buffer);
+    void finish_getblk_read(Shard& shard, GetblkOperation& op, Buffer* buffer, std::exception_ptr error,
+        bool from_tier);
+    bool start_bwrite(BwriteOperation& op, std::coroutine_handle<> handle);
 };
 
 #endif // UNIX_BUFFER_CACHE_H
@@ -0,0 +1,593 @@
+#include "my_buffer_cache.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+using Buffer = myBufferCache::Buffer;
+using ReplacementPolicy = myBufferCache::ReplacementPolicy;
+
+// How far past the natural victim a policy looks for a clean buffer
+const int MAX_CLEAN_SEARCH = 8;
+
+// Doubly-linked list threaded through Buffer::policy_prev/policy_next.
+// Head is the most recently inserted end.
+class BufferList {
+public:
+    size_t size() const { return m_size; }
+    Buffer* tail() const { return m_tail; }
+
+    void push_front(Buffer* buffer) {
+        buffer->policy_prev = nullptr;
+        buffer->policy_next = m_head;
+        if (m_head) {
+            m_head->policy_prev = buffer;
+        }
+        else {
+            m_tail = buffer;
+        }
+        m_head = buffer;
+        m_size++;
+    }
+
+    void remove(Buffer* buffer) {
+        if (buffer->policy_prev) {
+            buffer->policy_prev->policy_next = buffer->policy_next;
+        }
+        else {
+            m_head = buffer->policy_next;
+        }
+        if (buffer->policy_next) {
+            buffer->policy_next->policy_prev = buffer->policy_prev;
+        }
+        else {
+            m_tail = buffer->policy_prev;
+        }
+        buffer->policy_prev = nullptr;
+        buffer->policy_next = nullptr;
+        m_size--;
+    }
+
+    void move_to_front(Buffer* buffer) {
+        if (buffer == m_head) return;
+        remove(buffer);
+        push_front(buffer);
+    }
+
+    // Put to where from is, unlinking from
+    void replace(Buffer* from, Buffer* to) {
+        to->policy_prev = from->policy_prev;
+        to->policy_next = from->policy_next;
+        if (to->policy_prev) {
+            to->policy_prev->policy_next = to;
+        }
+        else {
+            m_head = to;
+        }
+        if (to->policy_next) {
+            to->policy_next->policy_prev = to;
+        }
+        else {
+            m_tail = to;
+        }
+        from->policy_prev = nullptr;
+        from->policy_next = nullptr;
+    }
+
+    // Appends the buffers from head to tail, those hit since the policy
+    // last saw them (reference bit set) first, since they are in fact the
+    // most recently used
+    void append_by_recency(std::vector<Buffer*>& out) const {
+        for (Buffer* buf = m_head; buf; buf = buf->policy_next) {
+            if (buf->referenced.load(std::memory_order_relaxed)) out.push_back(buf);
+        }
+        for (Buffer* buf = m_head; buf; buf = buf->policy_next) {
+            if (!buf->referenced.load(std::memory_order_relaxed)) out.push_back(buf);
+        }
+    }
+
+    // Walks from the tail towards the head and returns the first buffer that
+    // is not pinned. With prefer_clean, up to MAX_CLEAN_SEARCH further
+    // candidates are checked for one that needs no write-back.
+    //
+    // A buffer whose reference bit is set was hit since the policy last
+    // saw it. The bit is cleared and the buffer handed to on_referenced,
+    // which returns true if it moved the buffer out of the victim position.
+    template <typename OnReferenced>
+    Buffer* pick_from_tail(bool prefer_clean, OnReferenced on_referenced) {
+        Buffer* first = nullptr;
+        int checked = 0;
+        size_t steps = m_size;
+
+        for (Buffer* buf = m_tail, *prev = nullptr; buf && steps > 0; buf = prev, --steps) {
+            prev = buf->policy_prev;
+            if (buf->pinned()) continue;
+            if (buf->referenced.exchange(false) && on_referenced(buf)) continue;
+            if (!prefer_clean || !buf->dirty) {
+                return buf;
+            }
+            if (!first) {
+                first = buf;
+            }
+            if (++checked > MAX_CLEAN_SEARCH) break;
+        }
+        return first;
+    }
+
+private:
+    Buffer* m_head = nullptr;
+    Buffer* m_tail = nullptr;
+    size_t m_size = 0;
+};
+
+// FIFO lists of block numbers that recently left the cache, with O(1)
+// lookup. A block is on at most one of them. Sized once for the most
+// entries the lists hold together: the entries are nodes of one array,
+// linked by index, and a BlockIndex maps each block to its node, so
+// nothing is allocated after construction. The owner keeps the lists
+// within max_entries; should it not, pushing drops the oldest entry of a
+// list to make room.
+class GhostLists {
+public:
+    static constexpr int NONE = -1;
+
+    // max_entries must be at least 1
+    GhostLists(int lists, size_t max_entries)
+        : m_nodes(std::make_unique<Node[]>(max_entries)), m_index(max_entries), m_lists(lists) {
+        for (size_t i = 0; i + 1 < max_entries; ++i) {
+            m_nodes[i].next = static_cast<uint32_t>(i + 1);
+        }
+    }
+
+    size_t size(int list) const { return m_lists[list].size; }
+
+    // List holding block_number, or NONE
+    int find(uint64_t block_number) const {
+        uint32_t node = m_index.find(block_number);
+        return node == BlockIndex::NOT_FOUND ? NONE : m_nodes[node].list;
+    }
+
+    void push_front(int list, uint64_t block_number) {
+        remove(block_number);
+        if (m_free == NIL) {
+            int victim = list;
+            while (m_lists[victim].size == 0) {
+                victim = (victim + 1) % static_cast<int>(m_lists.size());
+            }
+            pop_back(victim);
+        }
+
+        uint32_t node = m_free;
+        m_free = m_nodes[node].next;
+        List& l = m_lists[list];
+        m_nodes[node] = Node{ block_number, NIL, l.head, static_cast<unsigned char>(list) };
+        if (l.head != NIL) {
+            m_nodes[l.head].prev = node;
+        }
+        else {
+            l.tail = node;
+        }
+        l.head = node;
+        l.size++;
+        m_index.insert(block_number, node);
+    }
+
+    void remove(uint64_t block_number) {
+        uint32_t node = m_index.find(block_number);
+        if (node != BlockIndex::NOT_FOUND) unlink(node);
+    }
+
+    void pop_back(int list) { unlink(m_lists[list].tail); }
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    struct Node {
+        uint64_t block_number = 0;
+        uint32_t prev = NIL;
+        uint32_t next = NIL;
+        unsigned char list = 0;
+    };
+    struct List {
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+        size_t size = 0;
+    };
+
+    std::unique_ptr<Node[]> m_nodes;
+    BlockIndex m_index;
+    std::vector<List> m_lists;
+    uint32_t m_free = 0;    // Unused nodes, linked through next
+
+    void unlink(uint32_t node) {
+        Node& n = m_nodes[node];
+        List& l = m_lists[n.list];
+        if (n.prev != NIL) {
+            m_nodes[n.prev].next = n.next;
+        }
+        else {
+            l.head = n.next;
+        }
+        if (n.next != NIL) {
+            m_nodes[n.next].prev = n.prev;
+        }
+        else {
+            l.tail = n.prev;
+        }
+        l.size--;
+        m_index.erase(n.block_number);
+        n.next = m_free;
+        m_free = node;
+    }
+};
+
+// ---------------------------------------------------------------------------
+// LRU: one list in recency order. As in the classic buffer cache a buffer
+// becomes most recently used when it is released; pinned buffers are skipped.
+
+class LruPolicy : public ReplacementPolicy {
+public:
+    const char* name() const override { return "LRU"; }
+
+    void on_insert(Buffer* buffer) override { m_list.push_front(buffer); }
+    void on_hit(Buffer*) override {}
+    void on_release(Buffer* buffer) override { m_list.move_to_front(buffer); }
+    void on_evict(Buffer* buffer) override { m_list.remove(buffer); }
+    void on_move(Buffer* from, Buffer* to) override { m_list.replace(from, to); }
+    void hottest_first(std::vector<Buffer*>& out) const override { m_list.append_by_recency(out); }
+
+    Buffer* choose_victim(uint64_t, bool prefer_clean) override {
+        Buffer* victim = m_list.pick_from_tail(prefer_clean, [this](Buffer* buf) {
+            m_list.move_to_front(buf);
+            return true;
+        });
+
+        // Everything unpinned was referenced and has been moved up; the
+        // tail is now the least recently used of them
+        return victim ? victim : m_list.pick_from_tail(prefer_clean, [](Buffer*) { return false; });
+    }
+
+private:
+    BufferList m_list;
+};
+
+// ---------------------------------------------------------------------------
+// CLOCK: buffers sit on a ring swept by a hand. A hit only sets the
+// reference bit, so hits never touch shared list pointers.
+
+class ClockPolicy : public ReplacementPolicy {
+public:
+    const char* name() const override { return "CLOCK"; }
+
+    void on_insert(Buffer* buffer) override {
+        buffer->referenced = false;
+
+        // Insert just behind the hand, i.e. the last position it will reach
+        if (!m_hand) {
+            buffer->policy_prev = buffer->policy_next = buffer;
+            m_hand = buffer;
+        }
+        else {
+            Buffer* prev = m_hand->policy_prev;
+            buffer->policy_prev = prev;
+            buffer->policy_next = m_hand;
+            prev->policy_next = buffer;
+            m_hand->policy_prev = buffer;
+        }
+        m_size++;
+    }
+
+    void on_hit(Buffer* buffer) override { buffer->referenced = true; }
+
+    void on_evict(Buffer* buffer) override {
+        if (buffer->policy_next == buffer) {
+            m_hand = nullptr;
+        }
+        else {
+            buffer->policy_prev->policy_next = buffer->policy_next;
+            buffer->policy_next->policy_prev = buffer->policy_prev;
+            if (m_hand == buffer) {
+                m_hand = buffer->policy_next;
+            }
+        }
+        buffer->policy_prev = buffer->policy_next = nullptr;
+        m_size--;
+    }
+
+    void on_move(Buffer* from, Buffer* to) override {
+        if (from->policy_next == from) {
+            to->policy_prev = to->policy_next = to;
+        }
+        else {
+            to->policy_prev = from->policy_prev;
+            to->policy_next = from->policy_next;
+            to->policy_prev->policy_next = to;
+            to->policy_next->policy_prev = to;
+        }
+        if (m_hand == from) {
+            m_hand = to;
+        }
+        from->policy_prev = from->policy_next = nullptr;
+    }
+
+    // Referenced buffers first, then the rest; each walking back from the
+    // newest insertion, just behind the hand, to the next victim
+    void hottest_first(std::vector<Buffer*>& out) const override {
+        if (!m_hand) return;
+        for (bool referenced : { true, false }) {
+            Buffer* buf = m_hand;
+            do {
+                buf = buf->policy_prev;
+                if (buf->referenced.load(std::memory_order_relaxed) == referenced) out.push_back(buf);
+            } while (buf != m_hand);
+        }
+    }
+
+    Buffer* choose_victim(uint64_t, bool prefer_clean) override {
+        Buffer* dirty_candidate = nullptr;
+        int clean_search = 0;
+
+        // Two full sweeps clear every reference bit, so this terminates
+        for (size_t step = 0; m_hand && step < 2 * m_size + 1; ++step) {
+            Buffer* buf = m_hand;
+            m_hand = m_hand->policy_next;
+
+            if (buf->pinned()) continue;
+            if (buf->referenced) {
+                buf->referenced = false;
+                continue;
+            }
+            if (!prefer_clean || !buf->dirty) {
+                return buf;
+            }
+            if (!dirty_candidate) {
+                dirty_candidate = buf;
+            }
+            if (++clean_search > MAX_CLEAN_SEARCH) break;
+        }
+        return dirty_candidate;
+    }
+
+private:
+    Buffer* m_hand = nullptr;
+    size_t m_size = 0;
+};
+
+// ---------------------------------------------------------------------------
+// 2Q (Johnson & Shasha). New blocks enter the A1in FIFO; only blocks that
+// are requested again after falling out of it (remembered in the A1out
+// ghost list) are admitted to the main LRU, Am. A one-off scan therefore
+// only cycles through A1in and leaves the hot set in Am alone.
+
+class TwoQueuePolicy : public ReplacementPolicy {
+public:
+    // A1out holds half the largest capacity, and one more while on_evict
+    // trims it
+    TwoQueuePolicy(size_t capacity, size_t max_capacity)
+        : m_a1out(1, std::max<size_t>(1, max_capacity / 2) + 1) {
+        set_capacity(capacity);
+    }
+
+    const char* name() const override { return "2Q"; }
+
+    void set_capacity(size_t capacity) override {
+        m_kin = std::max<size_t>(1, capacity / 4);
+        m_kout = std::max<size_t>(1, capacity / 2);
+        while (m_a1out.size(0) > m_kout) {
+            m_a1out.pop_back(0);
+        }
+    }
+
+    void on_insert(Buffer* buffer) override {
+        if (m_a1out.find(buffer->block_number) != GhostLists::NONE) {
+            m_a1out.remove(buffer->block_number);
+            buffer->policy_queue = AM;
+            m_am.push_front(buffer);
+        }
+        else {
+            buffer->policy_queue = A1IN;
+            m_a1in.push_front(buffer);
+        }
+    }
+
+    void on_hit(Buffer* buffer) override {
+        // A hit in A1in is treated as correlated with the first access
+        if (buffer->policy_queue == AM) {
+            m_am.move_to_front(buffer);
+        }
+    }
+
+    bool on_referenced(Buffer* buffer) {
+        on_hit(buffer);
+        return buffer->policy_queue == AM;
+    }
+
+    void on_evict(Buffer* buffer) override {
+        if (buffer->policy_queue == A1IN) {
+            m_a1in.remove(buffer);
+            m_a1out.push_front(0, buffer->block_number);
+            if (m_a1out.size(0) > m_kout) {
+                m_a1out.pop_back(0);
+            }
+        }
+        else {
+            m_am.remove(buffer);
+        }
+    }
+
+    void on_move(Buffer* from, Buffer* to) override {
+        to->policy_queue = from->policy_queue;
+        (from->policy_queue == A1IN ? m_a1in : m_am).replace(from, to);
+    }
+
+    // Am, the blocks that proved themselves, before the probationary A1in
+    void hottest_first(std::vector<Buffer*>& out) const override {
+        m_am.append_by_recency(out);
+        m_a1in.append_by_recency(out);
+    }
+
+    Buffer* choose_victim(uint64_t, bool prefer_clean) override {
+        BufferList& first = m_a1in.size() > m_kin ? m_a1in : m_am;
+        BufferList& second = &first == &m_a1in ? m_am : m_a1in;
+
+        auto referenced = [this](Buffer* buf) { return on_referenced(buf); };
+        Buffer* victim = first.pick_from_tail(prefer_clean, referenced);
+        if (!victim) victim = second.pick_from_tail(prefer_clean, referenced);
+
+        // Everything unpinned was referenced and is now at the head of Am
+        return victim ? victim : m_am.pick_from_tail(prefer_clean, [](Buffer*) { return false; });
+    }
+
+private:
+    enum Queue : unsigned char { A1IN, AM };
+
+    size_t m_kin = 1;    // Target size of A1in
+    size_t m_kout = 1;   // Capacity of the A1out ghost list
+    BufferList m_a1in;
+    BufferList m_am;
+    GhostLists m_a1out;
+};
+
+// ---------------------------------------------------------------------------
+// ARC (Megiddo & Modha). T1 holds blocks seen once recently, T2 blocks seen
+// at least twice; B1/B2 remember what was evicted from each. A hit in a
+// ghost list moves the target size p of T1 towards the list that would
+// have kept the block.
+
+class ArcPolicy : public ReplacementPolicy {
+public:
+    // The whole directory stays within 2c, so B1 and B2 together hold at
+    // most twice the largest capacity
+    ArcPolicy(size_t capacity, size_t max_capacity)
+        : m_capacity(capacity), m_ghosts(2, 2 * max_capacity + 1) {}
+
+    const char* name() const override { return "ARC"; }
+
+    void set_capacity(size_t capacity) override {
+        m_capacity = capacity;
+        m_p = std::min(m_p, capacity);
+        trim_ghosts();
+    }
+
+    void on_insert(Buffer* buffer) override {
+        uint64_t block = buffer->block_number;
+        int ghost = m_ghosts.find(block);
+
+        if (ghost == B1) {
+            // Recency list was too small
+            size_t delta = std::max<size_t>(1, b2_size() / std::max<size_t>(1, b1_size()));
+            m_p = std::min(m_capacity, m_p + delta);
+            m_ghosts.remove(block);
+            insert(buffer, T2);
+        }
+        else if (ghost == B2) {
+            // Frequency list was too small
+            size_t delta = std::max<size_t>(1, b1_size() / std::max<size_t>(1, b2_size()));
+            m_p = m_p > delta ? m_p - delta : 0;
+            m_ghosts.remove(block);
+            insert(buffer, T2);
+        }
+        else {
+            insert(buffer, T1);
+        }
+
+        trim_ghosts();
+    }
+
+    void on_hit(Buffer* buffer) override {
+        list_of(buffer).remove(buffer);
+        insert(buffer, T2);
+    }
+
+    void on_evict(Buffer* buffer) override {
+        list_of(buffer).remove(buffer);
+        m_ghosts.push_front(buffer->policy_queue == T1 ? B1 : B2, buffer->block_number);
+        trim_ghosts();
+    }
+
+    void on_move(Buffer* from, Buffer* to) override {
+        to->policy_queue = from->policy_queue;
+        list_of(from).replace(from, to);
+    }
+
+    // Blocks seen at least twice, then those seen once
+    void hottest_first(std::vector<Buffer*>& out) const override {
+        m_t2.append_by_recency(out);
+        m_t1.append_by_recency(out);
+    }
+
+    Buffer* choose_victim(uint64_t incoming_block, bool prefer_clean) override {
+        // REPLACE(x): take from T1 when it exceeds its target size p
+        bool in_b2 = m_ghosts.find(incoming_block) == B2;
+        bool from_t1 = m_t1.size() > 0 &&
+            ((in_b2 && m_t1.size() == m_p) || m_t1.size() > m_p);
+
+        BufferList& first = from_t1 ? m_t1 : m_t2;
+        BufferList& second = from_t1 ? m_t2 : m_t1;
+
+        auto referenced = [this](Buffer* buf) {
+            on_hit(buf);
+            return true;
+        };
+        Buffer* victim = first.pick_from_tail(prefer_clean, referenced);
+        if (!victim) victim = second.pick_from_tail(prefer_clean, referenced);
+
+        // Everything unpinned was referenced and is now at the head of T2
+        return victim ? victim : m_t2.pick_from_tail(prefer_clean, [](Buffer*) { return false; });
+    }
+
+private:
+    enum Queue : unsigned char { T1, T2 };
+    enum Ghost : int { B1, B2 };
+
+    size_t m_capacity;
+    size_t m_p = 0;    // Target size of T1
+    BufferList m_t1;
+    BufferList m_t2;
+    GhostLists m_ghosts;    // B1 and B2
+
+    size_t b1_size() const { return m_ghosts.size(B1); }
+    size_t b2_size() const { return m_ghosts.size(B2); }
+
+    BufferList& list_of(Buffer* buffer) { return buffer->policy_queue == T1 ? m_t1 : m_t2; }
+
+    void insert(Buffer* buffer, Queue queue) {
+        buffer->policy_queue = queue;
+        list_of(buffer).push_front(buffer);
+    }
+
+    // Keep |T1| + |B1| <= c and the whole directory within 2c
+    void trim_ghosts() {
+        while (b1_size() > 0 && m_t1.size() + b1_size() > m_capacity) {
+            m_ghosts.pop_back(B1);
+        }
+        while (m_t1.size() + m_t2.size() + b1_size() + b2_size() > 2 * m_capacity) {
+            if (b2_size() > 0) {
+                m_ghosts.pop_back(B2);
+            }
+            else if (b1_size() > 0) {
+                m_ghosts.pop_back(B1);
+            }
+            else {
+                break;
+            }
+        }
+    }
+};
+
+} // namespace
+
+std::unique_ptr<myBufferCache::ReplacementPolicy>
+myBufferCache::ReplacementPolicy::create(Policy policy, size_t capacity, size_t max_capacity) {
+    switch (policy) {
+    case Policy::LRU:
+        return std::make_unique<LruPolicy>();
+    case Policy::CLOCK:
+        return std::make_unique<ClockPolicy>();
+    case Policy::TwoQ:
+        return std::make_unique<TwoQueuePolicy>(capacity, max_capacity);
+    case Policy::ARC:
+        return std::make_unique<ArcPolicy>(capacity, max_capacity);
+    }
+    throw std::invalid_argument("Unknown replacement policy");
+}
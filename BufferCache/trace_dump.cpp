@@ -0,0 +1,73 @@
+// trace_dump.cpp : Decodes a trace written by myBufferCache::dump_trace.
+//
+// Usage: BufferCacheTraceDump <trace file> [--summary]
+//   Prints one line per event, oldest first, or with --summary the event
+//   counts per type and the mean device read/write time.
+
+#include "trace_ring.h"
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: BufferCacheTraceDump <trace file> [--summary]\n";
+        return 1;
+    }
+    bool summary = argc > 2 && std::string(argv[2]) == "--summary";
+
+    std::vector<TraceEvent> events;
+    try {
+        events = TraceRing::load(argv[1]);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (summary) {
+        const int NUM_TYPES = static_cast<int>(TraceEventType::Write) + 1;
+        uint64_t counts[NUM_TYPES] = {};
+        uint64_t io_ns[NUM_TYPES] = {};
+        for (const auto& event : events) {
+            int type = static_cast<int>(event.type);
+            if (type < NUM_TYPES) {
+                counts[type]++;
+                io_ns[type] += event.arg;
+            }
+        }
+
+        std::printf("%zu events", events.size());
+        if (!events.empty()) {
+            std::printf(" over %.3f ms", (events.back().timestamp_ns - events.front().timestamp_ns) / 1e6);
+        }
+        std::printf("\n");
+        for (int type = 0; type < NUM_TYPES; ++type) {
+            auto t = static_cast<TraceEventType>(type);
+            std::printf("  %-12s %10llu", TraceRing::type_name(t), static_cast<unsigned long long>(counts[type]));
+            if ((t == TraceEventType::Read || t == TraceEventType::Write) && counts[type] > 0) {
+                std::printf("   mean %.2f us", io_ns[type] / 1e3 / counts[type]);
+            }
+            std::printf("\n");
+        }
+        return 0;
+    }
+
+    for (const auto& event : events) {
+        std::printf("%14.3f us  thread %-3u %-12s block %-10llu", event.timestamp_ns / 1e3, event.thread,
+            TraceRing::type_name(event.type), static_cast<unsigned long long>(event.block_number));
+        if (event.flags & TRACE_EXCLUSIVE) {
+            std::printf(" exclusive");
+        }
+        if (event.flags & TRACE_DIRTY) {
+            std::printf(" dirty");
+        }
+        if (event.type == TraceEventType::Read || event.type == TraceEventType::Write) {
+            std::printf(" %.2f us", event.arg / 1e3);
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "trace_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+const char TRACE_MAGIC[8] = { 'B', 'C', 'T', 'R', 'A', 'C', 'E', '2' };
+const size_t RECORD_SIZE = 32;
+
+// Per-process thread number, also used to pick the thread's ring
+std::atomic<uint32_t> g_next_trace_thread{ 0 };
+thread_local uint32_t t_trace_thread = g_next_trace_thread.fetch_add(1, std::memory_order_relaxed);
+
+} // namespace
+
+TraceRing::TraceRing(size_t events_per_thread) : m_start(std::chrono::steady_clock::now()) {
+    size_t capacity = 16;
+    while (capacity < events_per_thread) {
+        capacity *= 2;
+    }
+    m_mask = capacity - 1;
+
+    m_rings = std::make_unique<Ring[]>(NUM_RINGS);
+    for (size_t i = 0; i < NUM_RINGS; ++i) {
+        m_rings[i].entries = std::make_unique<Entry[]>(capacity);
+    }
+}
+
+void TraceRing::record(TraceEventType type, uint64_t block_number, uint8_t flags, uint32_t arg) {
+    uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_start).count());
+
+    Ring& ring = m_rings[t_trace_thread % NUM_RINGS];
+    uint64_t position = ring.head.fetch_add(1, std::memory_order_relaxed);
+    Entry& entry = ring.entries[position & m_mask];
+
+    // Seqlock write: odd while the fields change, even when complete
+    entry.seq.store(2 * position + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry.timestamp.store(now, std::memory_order_relaxed);
+    entry.meta.store(t_trace_thread | static_cast<uint64_t>(type) << 32 | static_cast<uint64_t>(flags) << 40,
+        std::memory_order_relaxed);
+    entry.block.store(block_number, std::memory_order_relaxed);
+    entry.arg.store(arg, std::memory_order_relaxed);
+    entry.seq.store(2 * position + 2, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceRing::snapshot() const {
+    std::vector<TraceEvent> events;
+
+    for (size_t r = 0; r < NUM_RINGS; ++r) {
+        const Ring& ring = m_rings[r];
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+        uint64_t first = head > m_mask + 1 ? head - (m_mask + 1) : 0;
+
+        for (uint64_t position = first; position < head; ++position) {
+            const Entry& entry = ring.entries[position & m_mask];
+
+            // Skip entries still being written or already overwritten
+            uint64_t seq = entry.seq.load(std::memory_order_acquire);
+            if (seq != 2 * position + 2) continue;
+            uint64_t timestamp = entry.timestamp.load(std::memory_order_relaxed);
+            uint64_t meta = entry.meta.load(std::memory_order_relaxed);
+            uint64_t block = entry.block.load(std::memory_order_relaxed);
+            uint32_t arg = entry.arg.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (entry.seq.load(std::memory_order_relaxed) != seq) continue;
+
+            TraceEvent event;
+            event.timestamp_ns = timestamp;
+            event.thread = static_cast<uint32_t>(meta);
+            event.type = static_cast<TraceEventType>((meta >> 32) & 0xFF);
+            event.flags = static_cast<uint8_t>((meta >> 40) & 0xFF);
+            event.block_number = block;
+            event.arg = arg;
+            events.push_back(event);
+        }
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+        [](const TraceEvent& a, const TraceEvent& b) { return a.timestamp_ns < b.timestamp_ns; });
+    return events;
+}
+
+void TraceRing::dump(const std::string& path) const {
+    std::vector<TraceEvent> events = snapshot();
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Cannot create trace file " + path);
+    }
+
+    // Fixed-size records in native byte order
+    uint64_t count = events.size();
+    out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& event : events) {
+        char record[RECORD_SIZE] = {};
+        memcpy(record, &event.timestamp_ns, 8);
+        memcpy(record + 8, &event.thread, 4);
+        record[12] = static_cast<char>(event.type);
+        record[13] = static_cast<char>(event.flags);
+        memcpy(record + 16, &event.block_number, 8);
+        memcpy(record + 24, &event.arg, 4);
+        out.write(record, RECORD_SIZE);
+    }
+
+    if (!out) {
+        throw std::runtime_error("Failed to write trace file " + path);
+    }
+}
+
+std::vector<TraceEvent> TraceRing::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Cannot open trace file " + path);
+    }
+
+    char magic[sizeof(TRACE_MAGIC)];
+    uint64_t count = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    if (!in || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error(path + " is not a buffer cache trace");
+    }
+
+    std::vector<TraceEvent> events;
+    char record[RECORD_SIZE];
+    while (events.size() < count && in.read(record, RECORD_SIZE)) {
+        TraceEvent event;
+        memcpy(&event.timestamp_ns, record, 8);
+        memcpy(&event.thread, record + 8, 4);
+        event.type = static_cast<TraceEventType>(record[12]);
+        event.flags = static_cast<uint8_t>(record[13]);
+        memcpy(&event.block_number, record + 16, 8);
+        memcpy(&event.arg, record + 24, 4);
+        events.push_back(event);
+    }
+
+    if (events.size() != count) {
+        throw std::runtime_error(path + " is truncated");
+    }
+    return events;
+}
+
+const char* TraceRing::type_name(TraceEventType type) {
+    switch (type) {
+    case TraceEventType::GetblkHit: return "getblk-hit";
+    case TraceEventType::GetblkMiss: return "getblk-miss";
+    case TraceEventType::Brelse: return "brelse";
+    case TraceEventType::Evict: return "evict";
+    case TraceEventType::Read: return "read";
+    case TraceEventType::Write: return "write";
+    }
+    return "unknown";
+}
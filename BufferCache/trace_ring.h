@@ -0,0 +1,91 @@
+#pragma once
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class TraceEventType : uint8_t {
+    GetblkHit,
+    GetblkMiss,
+    Brelse,
+    Evict,
+    Read,
+    Write
+};
+
+// Flags of a TraceEvent
+constexpr uint8_t TRACE_EXCLUSIVE = 1;  // getblk: locked exclusively
+constexpr uint8_t TRACE_DIRTY = 2;      // brelse: marked dirty; evict: written back first
+
+// One decoded event. arg is event specific: the I/O time in nanoseconds
+// for Read/Write, 0 otherwise. A Read covering a run of blocks loaded by
+// getblk_many, or a Write of a run merged by a write-back, names the first
+// block of the run.
+struct TraceEvent {
+    uint64_t timestamp_ns;  // Since the TraceRing was created
+    uint32_t thread;        // Small per-process thread number
+    TraceEventType type;
+    uint8_t flags;
+    uint32_t arg;
+    uint64_t block_number;  // Cache block key (device and block)
+};
+
+// Flight recorder for cache events. Each thread appends to its own ring of
+// fixed size, overwriting the oldest events, so recording is a handful of
+// relaxed stores with no lock and no shared cache line. Threads beyond
+// NUM_RINGS share rings; slots are claimed with an atomic increment, so
+// they only collide if a ring wraps around during a single write.
+//
+// snapshot() may run while events are recorded; entries being overwritten
+// at that moment are skipped.
+class TraceRing {
+public:
+    static constexpr size_t NUM_RINGS = 64;
+
+    // events_per_thread is rounded up to a power of two
+    explicit TraceRing(size_t events_per_thread);
+
+    TraceRing(const TraceRing&) = delete;
+    TraceRing& operator=(const TraceRing&) = delete;
+
+    void record(TraceEventType type, uint64_t block_number, uint8_t flags = 0, uint32_t arg = 0);
+
+    // Every event still held by the rings, oldest first
+    std::vector<TraceEvent> snapshot() const;
+
+    // Binary trace file: 8-byte magic, event count, then the events.
+    // Throws std::runtime_error on I/O errors.
+    void dump(const std::string& path) const;
+    static std::vector<TraceEvent> load(const std::string& path);
+
+    static const char* type_name(TraceEventType type);
+
+private:
+    // Events are packed into words so entries can be written and read with
+    // plain atomics. seq is 2 * position + 1 while the entry is being
+    // written and 2 * position + 2 once it is complete.
+    struct Entry {
+        std::atomic<uint64_t> seq{ 0 };
+        std::atomic<uint64_t> timestamp{ 0 };
+        std::atomic<uint64_t> meta{ 0 };  // thread | type << 32 | flags << 40
+        std::atomic<uint64_t> block{ 0 };
+        std::atomic<uint32_t> arg{ 0 };
+    };
+
+    struct alignas(64) Ring {
+        std::atomic<uint64_t> head{ 0 };
+        std::unique_ptr<Entry[]> entries;
+    };
+
+    size_t m_mask;
+    std::chrono::steady_clock::time_point m_start;
+    std::unique_ptr<Ring[]> m_rings;
+};
+
+#endif // TRACE_RING_H
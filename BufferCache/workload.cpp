@@ -0,0 +1,194 @@
+#include "workload.h"
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+double zeta(int n, double theta) {
+    double sum = 0;
+    for (int i = 1; i <= n; ++i) {
+        sum += 1.0 / std::pow(static_cast<double>(i), theta);
+    }
+    return sum;
+}
+
+[[noreturn]] void bad_line(const std::string& path, size_t line_number) {
+    throw std::runtime_error(path + ":" + std::to_string(line_number) + ": unrecognized trace line");
+}
+
+// One MSR Cambridge record: Timestamp,Hostname,DiskNumber,Type,Offset,Size,ResponseTime
+bool parse_msr_line(const std::string& line, size_t block_size, std::vector<Access>& trace) {
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, ',')) {
+        fields.push_back(field);
+    }
+    if (fields.size() < 6) return false;
+
+    bool write;
+    if (fields[3] == "Write") {
+        write = true;
+    }
+    else if (fields[3] == "Read") {
+        write = false;
+    }
+    else {
+        return false;
+    }
+
+    unsigned long long offset, size;
+    try {
+        offset = std::stoull(fields[4]);
+        size = std::stoull(fields[5]);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    unsigned long long first = offset / block_size;
+    unsigned long long last = (offset + (size ? size : 1) - 1) / block_size;
+    if (last > static_cast<unsigned long long>(INT_MAX)) {
+        throw std::runtime_error("Trace offset is beyond the largest block number");
+    }
+    for (unsigned long long block = first; block <= last; ++block) {
+        trace.push_back({ static_cast<int>(block), write });
+    }
+    return true;
+}
+
+} // namespace
+
+ZipfGenerator::ZipfGenerator(int n, double theta, uint64_t seed)
+    : m_n(n), m_theta(theta), m_rng(seed), m_uniform(0.0, 1.0) {
+    if (n <= 0 || theta <= 0 || theta >= 1) {
+        throw std::invalid_argument("Zipf needs n > 0 and 0 < theta < 1");
+    }
+
+    m_zetan = zeta(n, theta);
+    m_alpha = 1.0 / (1.0 - theta);
+    m_eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / m_zetan);
+}
+
+int ZipfGenerator::next() {
+    double u = m_uniform(m_rng);
+    double uz = u * m_zetan;
+
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, m_theta)) return 1;
+
+    int value = static_cast<int>(m_n * std::pow(m_eta * u - m_eta + 1.0, m_alpha));
+    return value < m_n ? value : m_n - 1;
+}
+
+std::vector<Access> make_zipf_trace(int num_blocks, double theta, size_t length,
+    double write_ratio, uint64_t seed) {
+    ZipfGenerator zipf(num_blocks, theta, seed);
+    std::mt19937_64 rng(seed + 1);
+    std::bernoulli_distribution is_write(write_ratio);
+
+    std::vector<Access> trace(length);
+    for (auto& access : trace) {
+        access.block_number = zipf.next();
+        access.write = is_write(rng);
+    }
+    return trace;
+}
+
+std::vector<Access> make_uniform_trace(int num_blocks, size_t length,
+    double write_ratio, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> pick(0, num_blocks - 1);
+    std::bernoulli_distribution is_write(write_ratio);
+
+    std::vector<Access> trace(length);
+    for (auto& access : trace) {
+        access.block_number = pick(rng);
+        access.write = is_write(rng);
+    }
+    return trace;
+}
+
+std::vector<Access> make_scan_trace(int num_blocks, size_t length) {
+    std::vector<Access> trace(length);
+    for (size_t i = 0; i < length; ++i) {
+        trace[i] = { static_cast<int>(i % num_blocks), false };
+    }
+    return trace;
+}
+
+std::vector<Access> make_mixed_trace(int hot_blocks, double theta, int scan_length,
+    size_t scan_every, size_t length, uint64_t seed) {
+    ZipfGenerator zipf(hot_blocks, theta, seed);
+    int next_cold = hot_blocks;  // Scans walk through blocks above the hot set
+
+    std::vector<Access> trace;
+    trace.reserve(length);
+    while (trace.size() < length) {
+        for (size_t i = 0; i < scan_every && trace.size() < length; ++i) {
+            trace.push_back({ zipf.next(), false });
+        }
+        for (int i = 0; i < scan_length && trace.size() < length; ++i) {
+            trace.push_back({ next_cold++, false });
+        }
+    }
+    return trace;
+}
+
+std::vector<Access> load_trace(const std::string& path, size_t block_size) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open trace " + path);
+    }
+
+    std::vector<Access> trace;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') continue;
+
+        if (line.find(',') != std::string::npos) {
+            if (!parse_msr_line(line, block_size, trace)) {
+                bad_line(path, line_number);
+            }
+            continue;
+        }
+
+        std::istringstream fields(line);
+        char type = 0;
+        long long block = -1;
+        if (!(fields >> type >> block) || block < 0 || block > INT_MAX) {
+            bad_line(path, line_number);
+        }
+        if (type == 'R' || type == 'r') {
+            trace.push_back({ static_cast<int>(block), false });
+        }
+        else if (type == 'W' || type == 'w') {
+            trace.push_back({ static_cast<int>(block), true });
+        }
+        else {
+            bad_line(path, line_number);
+        }
+    }
+    return trace;
+}
+
+void save_trace(const std::string& path, const std::vector<Access>& trace) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot create trace " + path);
+    }
+    for (const auto& access : trace) {
+        out << (access.write ? 'W' : 'R') << ' ' << access.block_number << '\n';
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write trace " + path);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic block access patterns used by the benchmarks
+
+// One block request in a trace
+struct Access {
+    int block_number;
+    bool write;
+};
+
+// Zipfian block numbers in [0, n), where block 0 is the most popular.
+// Uses the rejection-free method of Gray et al. (as in YCSB); theta is the
+// skew and must be in (0, 1).
+class ZipfGenerator {
+public:
+    ZipfGenerator(int n, double theta, uint64_t seed);
+
+    int next();
+
+private:
+    int m_n;
+    double m_theta;
+    double m_alpha;
+    double m_zetan;
+    double m_eta;
+    std::mt19937_64 m_rng;
+    std::uniform_real_distribution<double> m_uniform;
+};
+
+// Zipfian accesses over num_blocks blocks
+std::vector<Access> make_zipf_trace(int num_blocks, double theta, size_t length,
+    double write_ratio = 0.0, uint64_t seed = 1);
+
+// Uniformly random accesses over num_blocks blocks
+std::vector<Access> make_uniform_trace(int num_blocks, size_t length,
+    double write_ratio = 0.0, uint64_t seed = 1);
+
+// Repeated sequential passes over blocks [0, num_blocks)
+std::vector<Access> make_scan_trace(int num_blocks, size_t length);
+
+// Zipfian accesses to a hot set of hot_blocks, interrupted every scan_every
+// accesses by a sequential scan of scan_length blocks that are never reused
+// (like a backup job reading the whole device)
+std::vector<Access> make_mixed_trace(int hot_blocks, double theta, int scan_length,
+    size_t scan_every, size_t length, uint64_t seed = 1);
+
+// Recorded block I/O traces. Two formats are recognized per line:
+//   "R 1234" / "W 1234"  - one block access (what save_trace writes)
+//   MSR Cambridge CSV    - Timestamp,Hostname,Disk,Type,Offset,Size,...
+//                          byte ranges, split into block_size blocks
+// Blank lines and lines starting with '#' are skipped. Throws
+// std::runtime_error if the file can't be read or a line can't be parsed.
+std::vector<Access> load_trace(const std::string& path, size_t block_size = 4096);
+void save_trace(const std::string& path, const std::vector<Access>& trace);
+
+#endif // WORKLOAD_H
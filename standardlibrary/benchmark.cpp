@@ -0,0 +1,471 @@
+// benchmark.cpp : Micro-benchmarks for the custom containers.
+//
+// Usage: StandardLibraryBench [scenario]
+//   vector - CustomVector against std::vector for int, std::string and a
+//            128-byte struct: push_back of copies and of moved values
+//            (growing from empty), resize and pop_back, in ns per element
+//            (default)
+//   dispatch - summing a vector through the VectorLike static interface
+//            (CustomVector, std::vector) and through IVector via
+//            VectorAdapter, plus list churn through ListLike and IList.
+//            The static loops inline and vectorize (MSVC /O2, GCC -O3);
+//            /Qvec-report:1 or -fopt-info-vec lists them.
+//   list   - CustomList<int> with std::allocator and with PoolAllocator:
+//            push_back and pop_front of 4M elements, push/pop churn on a
+//            short list, and traversal of a list built while the rest of
+//            the program allocates too, with the cache lines it touches
+//   chunked - ChunkedList against CustomList (std::allocator and
+//            PoolAllocator): traversal of 4M ints, churn at the front
+//            and at the back, and bytes of memory per element
+
+#include "chunkedList.h"
+#include "listInterface.h"
+#include "poolAllocator.h"
+#include "vectorIntface.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the compiler from dropping work whose result is otherwise unused
+volatile unsigned g_sink = 0;
+
+// Large enough that relocating it is a real copy, still trivially copyable
+struct Large {
+    uint64_t values[16];
+};
+
+// Source values, and a cheap digest read back so the stores stay live
+int make_value(int*, size_t i) { return static_cast<int>(i); }
+std::string make_value(std::string*, size_t i) {
+    return "value with a heap buffer #" + std::to_string(i);
+}
+Large make_value(Large*, size_t i) {
+    Large large;
+    for (uint64_t& value : large.values) {
+        value = i;
+    }
+    return large;
+}
+
+unsigned digest(int value) { return static_cast<unsigned>(value); }
+unsigned digest(const std::string& value) { return static_cast<unsigned>(value.size()); }
+unsigned digest(const Large& value) { return static_cast<unsigned>(value.values[15]); }
+
+struct VectorTimes {
+    double copy = 1e300;    // ns per element, best of the rounds
+    double move = 1e300;
+    double resize = 1e300;
+    double pop = 1e300;
+};
+
+double ns_per(Clock::time_point start, size_t count) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+}
+
+template <typename Vector, typename T>
+VectorTimes time_vector(const std::vector<T>& source) {
+    const int ROUNDS = 5;
+    size_t count = source.size();
+    VectorTimes best;
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        {
+            Vector v;
+            auto start = Clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                v.push_back(source[i]);
+            }
+            best.copy = std::min(best.copy, ns_per(start, count));
+            g_sink = g_sink + digest(v[count - 1]);
+
+            start = Clock::now();
+            while (!v.empty()) {
+                v.pop_back();
+            }
+            best.pop = std::min(best.pop, ns_per(start, count));
+        }
+        {
+            std::vector<T> moved_from = source;
+            Vector v;
+            auto start = Clock::now();
+            for (size_t i = 0; i < count; ++i) {
+                v.push_back(std::move(moved_from[i]));
+            }
+            best.move = std::min(best.move, ns_per(start, count));
+            g_sink = g_sink + digest(v[count - 1]);
+        }
+        {
+            Vector v;
+            auto start = Clock::now();
+            v.resize(count);
+            best.resize = std::min(best.resize, ns_per(start, count));
+            g_sink = g_sink + digest(v[count - 1]);
+        }
+    }
+    return best;
+}
+
+template <typename T>
+void compare_vectors(const char* type, size_t count) {
+    std::vector<T> source;
+    source.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        source.push_back(make_value(static_cast<T*>(nullptr), i));
+    }
+
+    VectorTimes custom = time_vector<CustomVector<T>>(source);
+    VectorTimes standard = time_vector<std::vector<T>>(source);
+
+    auto row = [&](const char* op, double VectorTimes::* field) {
+        std::cout << std::setw(12) << type << std::setw(12) << op
+            << std::fixed << std::setprecision(2)
+            << std::setw(14) << custom.*field << std::setw(14) << standard.*field << "\n";
+    };
+    row("push_back", &VectorTimes::copy);
+    row("push(move)", &VectorTimes::move);
+    row("resize", &VectorTimes::resize);
+    row("pop_back", &VectorTimes::pop);
+}
+
+// CustomVector and std::vector doing the same work, element types covering
+// the memcpy relocation path (int, Large) and the move path (std::string).
+// Both start empty, so push_back includes every reallocation.
+void bench_vector() {
+    std::cout << "ns per element, best of 5\n";
+    std::cout << std::setw(12) << "type" << std::setw(12) << "op"
+        << std::setw(14) << "CustomVector" << std::setw(14) << "std::vector" << "\n";
+    compare_vectors<int>("int", 4000000);
+    compare_vectors<std::string>("std::string", 1000000);
+    compare_vectors<Large>("Large(128B)", 500000);
+}
+
+// Index of the adapter bench_dispatch calls through, read at run time so the
+// compiler can't prove the dynamic type and devirtualize
+volatile size_t g_adapter = 0;
+
+// The loop from standardlibrary.cpp, statically dispatched: size() and
+// operator[] inline, and the loop vectorizes
+template <VectorLike Vector>
+long long sum_static(const Vector& v) {
+    long long sum = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        sum += v[i];
+    }
+    return sum;
+}
+
+// The same loop through the virtual interface: two calls per element
+long long sum_virtual(const IVector<int>& v) {
+    long long sum = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        sum += v[i];
+    }
+    return sum;
+}
+
+// Push at the back, pop at the front, keeping the list at its length
+template <typename List>
+void churn(List& list, size_t ops) {
+    for (size_t i = 0; i < ops; ++i) {
+        list.push_back(static_cast<int>(i));
+        list.pop_front();
+    }
+}
+
+template <typename Fn>
+double best_ns_per(size_t per_round, Fn fn) {
+    const int ROUNDS = 20;
+    double best = 1e300;
+    for (int round = 0; round < ROUNDS; ++round) {
+        auto start = Clock::now();
+        fn();
+        best = std::min(best, ns_per(start, per_round));
+    }
+    return best;
+}
+
+// Static against virtual dispatch over the same containers. The sum
+// through IVector costs a call per size() and operator[]; the static sums
+// run at SIMD speed, several elements per nanosecond.
+void bench_dispatch() {
+    const size_t COUNT = 1 << 20;
+    const size_t LIST_LENGTH = 1024;
+    const size_t CHURN_OPS = 1 << 20;
+
+    CustomVector<int> custom;
+    for (size_t i = 0; i < COUNT; ++i) {
+        custom.push_back(static_cast<int>(i % 1000));
+    }
+    std::vector<int> standard(COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+        standard[i] = custom[i];
+    }
+    VectorAdapter<CustomVector<int>> custom_adapter(custom);
+    VectorAdapter<std::vector<int>> standard_adapter(standard);
+    IVector<int>* adapters[] = { &custom_adapter, &standard_adapter };
+
+    std::cout << "sum of " << COUNT << " ints, best of 20\n";
+    std::cout << std::setw(34) << "" << std::setw(14) << "ns/element" << "\n";
+    auto row = [](const char* name, double ns) {
+        std::cout << std::setw(34) << name << std::setw(14) << std::fixed << std::setprecision(3) << ns << "\n";
+    };
+    row("CustomVector (VectorLike)", best_ns_per(COUNT, [&] { g_sink = g_sink + static_cast<unsigned>(sum_static(custom)); }));
+    row("std::vector (VectorLike)", best_ns_per(COUNT, [&] { g_sink = g_sink + static_cast<unsigned>(sum_static(standard)); }));
+    row("IVector& -> VectorAdapter", best_ns_per(COUNT, [&] {
+        g_sink = g_sink + static_cast<unsigned>(sum_virtual(*adapters[g_adapter]));
+    }));
+
+    CustomList<int> list;
+    std::list<int> standard_list;
+    for (size_t i = 0; i < LIST_LENGTH; ++i) {
+        list.push_back(static_cast<int>(i));
+        standard_list.push_back(static_cast<int>(i));
+    }
+    ListAdapter<CustomList<int>> list_adapter(list);
+    ListAdapter<std::list<int>> standard_list_adapter(standard_list);
+    IList<int>* list_adapters[] = { &list_adapter, &standard_list_adapter };
+
+    std::cout << "\npush_back + pop_front on a " << LIST_LENGTH << "-element list\n";
+    std::cout << std::setw(34) << "" << std::setw(14) << "ns/op" << "\n";
+    row("CustomList (ListLike)", best_ns_per(CHURN_OPS, [&] { churn(list, CHURN_OPS); }));
+    row("IList& -> ListAdapter", best_ns_per(CHURN_OPS, [&] { churn(*list_adapters[g_adapter], CHURN_OPS); }));
+    g_sink = g_sink + static_cast<unsigned>(list.front() + list_adapters[g_adapter]->back());
+}
+
+// Distinct cache lines a traversal enters per element. An element on the
+// line of the previous one is (almost) free; each new line is a potential
+// miss.
+template <typename List>
+double lines_per_element(const List& list) {
+    size_t lines = 0;
+    uintptr_t last_line = 0;
+    for (const auto& value : list) {
+        uintptr_t line = reinterpret_cast<uintptr_t>(&value) / 64;
+        lines += line != last_line;
+        last_line = line;
+    }
+    return static_cast<double>(lines) / list.size();
+}
+
+struct ListTimes {
+    double push = 1e300;     // ns per element, best of the rounds
+    double pop = 1e300;
+    double churn = 1e300;
+    double iterate = 1e300;
+    double lines = 0;        // Distinct cache lines entered per element traversed
+};
+
+template <typename List>
+ListTimes time_list() {
+    const int ROUNDS = 3;
+    const size_t COUNT = 4000000;
+    const size_t CHURN_LENGTH = 1024;
+    const size_t CHURN_OPS = 4000000;
+    ListTimes best;
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        {
+            List list;
+            auto start = Clock::now();
+            for (size_t i = 0; i < COUNT; ++i) {
+                list.push_back(static_cast<int>(i));
+            }
+            best.push = std::min(best.push, ns_per(start, COUNT));
+
+            start = Clock::now();
+            while (!list.empty()) {
+                list.pop_front();
+            }
+            best.pop = std::min(best.pop, ns_per(start, COUNT));
+        }
+        {
+            List list;
+            for (size_t i = 0; i < CHURN_LENGTH; ++i) {
+                list.push_back(static_cast<int>(i));
+            }
+            best.churn = std::min(best.churn, best_ns_per(CHURN_OPS, [&] { churn(list, CHURN_OPS); }));
+        }
+        {
+            // Each element comes with an unrelated allocation, as in a
+            // program doing other work while the list grows
+            List list;
+            std::vector<std::unique_ptr<char[]>> other;
+            other.reserve(COUNT);
+            for (size_t i = 0; i < COUNT; ++i) {
+                list.push_back(static_cast<int>(i));
+                other.push_back(std::make_unique<char[]>(40));
+            }
+
+            auto start = Clock::now();
+            long long sum = 0;
+            for (int value : list) {
+                sum += value;
+            }
+            best.iterate = std::min(best.iterate, ns_per(start, COUNT));
+            g_sink = g_sink + static_cast<unsigned>(sum);
+
+            best.lines = lines_per_element(list);
+        }
+    }
+    return best;
+}
+
+// CustomList's per-node new/delete against the slab pool. The pool wins on
+// push and pop by skipping the general-purpose allocator, and on traversal
+// by keeping a list's nodes in its own chunks, in allocation order.
+void bench_list() {
+    ListTimes heap = time_list<CustomList<int>>();
+    ListTimes pool = time_list<CustomList<int, PoolAllocator<int>>>();
+
+    std::cout << "CustomList<int>, ns per element, best of 3\n";
+    std::cout << std::setw(24) << "" << std::setw(16) << "std::allocator" << std::setw(16) << "PoolAllocator" << "\n";
+    auto row = [&](const char* name, double ListTimes::* field) {
+        std::cout << std::setw(24) << name << std::fixed << std::setprecision(2)
+            << std::setw(16) << heap.*field << std::setw(16) << pool.*field << "\n";
+    };
+    row("push_back", &ListTimes::push);
+    row("pop_front", &ListTimes::pop);
+    row("churn (push+pop)", &ListTimes::churn);
+    row("iterate", &ListTimes::iterate);
+    row("cache lines/element", &ListTimes::lines);
+}
+
+// Push at the front, pop at the back: churn in the other direction
+template <typename List>
+void churn_front(List& list, size_t ops) {
+    for (size_t i = 0; i < ops; ++i) {
+        list.push_front(static_cast<int>(i));
+        list.pop_back();
+    }
+}
+
+// Memory held per element: the chunks, the pool's chunks, or for plain
+// CustomList the nodes alone (the heap's own headers come on top)
+size_t footprint(const ChunkedList<int>& list) { return list.memory_bytes(); }
+size_t footprint(const CustomList<int, PoolAllocator<int>>& list) {
+    return list.get_allocator().resource().reserved_bytes();
+}
+size_t footprint(const CustomList<int>& list) { return list.size() * sizeof(ListNode<int>); }
+
+struct ChunkedTimes {
+    double alone = 1e300;     // ns per element traversing a list built alone
+    double traverse = 1e300;  // ... and one built among other allocations
+    double lines = 0;         // Cache lines entered per element traversed
+    double back = 1e300;      // push_back + pop_front, ns per pair
+    double front = 1e300;     // push_front + pop_back
+    double bytes = 0;         // Memory per element
+};
+
+template <typename List>
+ChunkedTimes time_chunked() {
+    const int ROUNDS = 3;
+    const size_t COUNT = 4000000;
+    const size_t CHURN_LENGTH = 1024;
+    const size_t CHURN_OPS = 4000000;
+    ChunkedTimes best;
+
+    // Sum every element, keeping the best time
+    auto traverse = [](const List& list, double& best_ns) {
+        auto start = Clock::now();
+        long long sum = 0;
+        for (int value : list) {
+            sum += value;
+        }
+        best_ns = std::min(best_ns, ns_per(start, list.size()));
+        g_sink = g_sink + static_cast<unsigned>(sum);
+    };
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        {
+            List list;
+            for (size_t i = 0; i < COUNT; ++i) {
+                list.push_back(static_cast<int>(i));
+            }
+            traverse(list, best.alone);
+        }
+        {
+            // Built alongside unrelated allocations, as in time_list
+            List list;
+            std::vector<std::unique_ptr<char[]>> other;
+            other.reserve(COUNT);
+            for (size_t i = 0; i < COUNT; ++i) {
+                list.push_back(static_cast<int>(i));
+                other.push_back(std::make_unique<char[]>(40));
+            }
+            traverse(list, best.traverse);
+            best.lines = lines_per_element(list);
+            best.bytes = static_cast<double>(footprint(list)) / COUNT;
+        }
+        {
+            List list;
+            for (size_t i = 0; i < CHURN_LENGTH; ++i) {
+                list.push_back(static_cast<int>(i));
+            }
+            best.back = std::min(best.back, best_ns_per(CHURN_OPS, [&] { churn(list, CHURN_OPS); }));
+            best.front = std::min(best.front, best_ns_per(CHURN_OPS, [&] { churn_front(list, CHURN_OPS); }));
+        }
+    }
+    return best;
+}
+
+// The unrolled list against CustomList. Traversal reads a chunk's ints
+// sequentially, so it enters a new cache line every 16 elements instead
+// of every node; churn stays within the end chunks and the spare. Built
+// among other allocations, each chunk lands on a page of its own, and
+// the page and first-line misses per chunk dominate the traversal.
+void bench_chunked() {
+    ChunkedTimes heap = time_chunked<CustomList<int>>();
+    ChunkedTimes pool = time_chunked<CustomList<int, PoolAllocator<int>>>();
+    ChunkedTimes chunked = time_chunked<ChunkedList<int>>();
+
+    std::cout << "int elements, best of 3\n";
+    std::cout << std::setw(28) << "" << std::setw(14) << "CustomList" << std::setw(14) << "+PoolAlloc"
+        << std::setw(14) << "ChunkedList" << "\n";
+    auto row = [&](const char* name, double ChunkedTimes::* field) {
+        std::cout << std::setw(28) << name << std::fixed << std::setprecision(2)
+            << std::setw(14) << heap.*field << std::setw(14) << pool.*field
+            << std::setw(14) << chunked.*field << "\n";
+    };
+    row("traverse ns/element", &ChunkedTimes::alone);
+    row("... built interleaved", &ChunkedTimes::traverse);
+    row("cache lines/element", &ChunkedTimes::lines);
+    row("push_back+pop_front ns", &ChunkedTimes::back);
+    row("push_front+pop_back ns", &ChunkedTimes::front);
+    row("bytes/element", &ChunkedTimes::bytes);
+    std::cout << "(CustomList bytes count the nodes only, not the heap's headers)\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string scenario = argc > 1 ? argv[1] : "vector";
+
+    if (scenario == "vector") {
+        bench_vector();
+    }
+    else if (scenario == "dispatch") {
+        bench_dispatch();
+    }
+    else if (scenario == "list") {
+        bench_list();
+    }
+    else if (scenario == "chunked") {
+        bench_chunked();
+    }
+    else {
+        std::cerr << "Unknown scenario: " << scenario << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,357 @@
+#pragma once
+#define CHUNKED_LIST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "listInterface.h"
+
+// Unrolled doubly-linked list (a chunked deque): elements are stored many
+// to a cache-line-aligned chunk of about CHUNK_BYTES, and only the chunks
+// are linked. A traversal reads elements sequentially and takes one
+// pointer hop per chunk instead of one per element, and the per-element
+// overhead is a share of a chunk header instead of two pointers and an
+// allocation.
+//
+// push/pop at either end are O(1): a chunk holds its live elements in
+// slots [first, last), growing down from the front and up from the back,
+// and a new chunk is linked when the end chunk is full. A chunk that
+// empties is kept as a spare for the next one needed, so churn across a
+// chunk boundary doesn't allocate. Pushes and pops invalidate iterators.
+template <typename T>
+class ChunkedList {
+public:
+    using value_type = T;
+
+    static constexpr size_t CHUNK_BYTES = 512;
+
+private:
+    // The fields ahead of a chunk's storage, to size CHUNK_CAPACITY
+    struct ChunkHeader {
+        void* prev;
+        void* next;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    static constexpr size_t CHUNK_ALIGNMENT = alignof(T) > 64 ? alignof(T) : 64;
+
+public:
+    // Elements per chunk: what fits after the header, at least 4
+    static constexpr size_t CHUNK_CAPACITY =
+        (CHUNK_BYTES - sizeof(ChunkHeader)) / sizeof(T) > 4 ? (CHUNK_BYTES - sizeof(ChunkHeader)) / sizeof(T) : 4;
+
+private:
+    struct alignas(CHUNK_ALIGNMENT) Chunk {
+        Chunk* prev = nullptr;
+        Chunk* next = nullptr;
+        uint32_t first = 0;   // First live slot
+        uint32_t last = 0;    // One past the last live slot
+        alignas(T) unsigned char storage[CHUNK_CAPACITY * sizeof(T)];
+
+        // A live element; std::launder requires one to be there
+        T* slot(size_t index) { return std::launder(reinterpret_cast<T*>(storage) + index); }
+        const T* slot(size_t index) const { return std::launder(reinterpret_cast<const T*>(storage) + index); }
+        // Where a new element is constructed
+        void* raw_slot(size_t index) { return reinterpret_cast<T*>(storage) + index; }
+    };
+
+    Chunk* head = nullptr;    // First chunk; never empty while linked
+    Chunk* tail = nullptr;    // Last chunk
+    Chunk* spare = nullptr;   // An emptied chunk kept for reuse
+    size_t list_size = 0;     // Current number of elements
+    size_t chunk_count = 0;   // Chunks allocated, including the spare
+
+    // A chunk with no live slots, from the spare if there is one
+    Chunk* take_chunk() {
+        Chunk* chunk = spare;
+        if (chunk != nullptr) {
+            spare = nullptr;
+        }
+        else {
+            chunk = ::new (::operator new(sizeof(Chunk), std::align_val_t(alignof(Chunk)))) Chunk;
+            ++chunk_count;
+        }
+        chunk->prev = nullptr;
+        chunk->next = nullptr;
+        return chunk;
+    }
+
+    // Give back an empty, unlinked chunk; one is kept as the spare
+    void release_chunk(Chunk* chunk) {
+        if (spare == nullptr) {
+            spare = chunk;
+            return;
+        }
+        free_chunk(chunk);
+    }
+
+    void free_chunk(Chunk* chunk) {
+        chunk->~Chunk();
+        ::operator delete(chunk, std::align_val_t(alignof(Chunk)));
+        --chunk_count;
+    }
+
+    // Append copies of other's elements
+    void append_copies(const ChunkedList& other) {
+        for (const T& value : other) {
+            push_back(value);
+        }
+    }
+
+    // Take other's chunks; this list must be empty
+    void steal(ChunkedList& other) {
+        head = other.head;
+        tail = other.tail;
+        list_size = other.list_size;
+        // Only the linked chunks move; each list keeps its own spare
+        size_t moved = other.chunk_count - (other.spare != nullptr ? 1 : 0);
+        chunk_count += moved;
+        other.chunk_count -= moved;
+        other.head = nullptr;
+        other.tail = nullptr;
+        other.list_size = 0;
+    }
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const T*, T*>;
+        using reference = std::conditional_t<Const, const T&, T&>;
+
+        Iterator() = default;
+        // Mutable iterators convert to const ones
+        template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        Iterator(const Iterator<OtherConst>& other) : chunk(other.chunk), index(other.index) {}
+
+        reference operator*() const { return *chunk->slot(index); }
+        pointer operator->() const { return chunk->slot(index); }
+
+        // Past the last element of a chunk, move to the next one's first;
+        // the end position is one past the tail chunk's last element
+        Iterator& operator++() {
+            if (++index == chunk->last && chunk->next != nullptr) {
+                chunk = chunk->next;
+                index = chunk->first;
+            }
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        Iterator& operator--() {
+            if (index == chunk->first) {
+                chunk = chunk->prev;
+                index = chunk->last;
+            }
+            --index;
+            return *this;
+        }
+        Iterator operator--(int) {
+            Iterator previous = *this;
+            --*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const { return chunk == other.chunk && index == other.index; }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class ChunkedList;
+        template <bool>
+        friend class Iterator;
+
+        Iterator(Chunk* chunk, size_t index) : chunk(chunk), index(index) {}
+
+        Chunk* chunk = nullptr;  // nullptr for the empty list's begin and end
+        size_t index = 0;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    // Default constructor - initializes empty list
+    ChunkedList() = default;
+
+    // Destructor - destroys the elements and frees every chunk
+    ~ChunkedList() {
+        clear();
+        if (spare != nullptr) {
+            free_chunk(spare);
+        }
+    }
+
+    // Copy constructor - creates deep copy of another list
+    ChunkedList(const ChunkedList& other) : ChunkedList() {
+        append_copies(other);
+    }
+
+    // Move constructor - transfers ownership of the chunks
+    ChunkedList(ChunkedList&& other) noexcept {
+        steal(other);
+    }
+
+    // Copy assignment operator - makes deep copy of another list
+    ChunkedList& operator=(const ChunkedList& other) {
+        if (this != &other) {  // Protect against self-assignment
+            clear();
+            append_copies(other);
+        }
+        return *this;
+    }
+
+    // Move assignment operator - transfers ownership of the chunks
+    ChunkedList& operator=(ChunkedList&& other) noexcept {
+        if (this != &other) {  // Protect against self-assignment
+            clear();
+            steal(other);
+        }
+        return *this;
+    }
+
+    // Bidirectional iteration from front to back
+    iterator begin() { return head ? iterator(head, head->first) : iterator(); }
+    iterator end() { return tail ? iterator(tail, tail->last) : iterator(); }
+    const_iterator begin() const { return head ? const_iterator(head, head->first) : const_iterator(); }
+    const_iterator end() const { return tail ? const_iterator(tail, tail->last) : const_iterator(); }
+
+    // ListLike operations
+
+    size_t size() const { return list_size; }
+    bool empty() const { return list_size == 0; }
+
+    // Bytes of chunks held (including the spare), for footprint comparisons
+    size_t memory_bytes() const { return chunk_count * sizeof(Chunk); }
+
+    // Access first and last elements (the list must not be empty)
+    T& front() { return *head->slot(head->first); }
+    const T& front() const { return *head->slot(head->first); }
+    T& back() { return *tail->slot(tail->last - 1); }
+    const T& back() const { return *tail->slot(tail->last - 1); }
+
+    // Add element at the beginning; a new chunk fills from its end down
+    void push_front(const T& value) {
+        if (head != nullptr && head->first > 0) {
+            ::new (head->raw_slot(head->first - 1)) T(value);
+            --head->first;
+        }
+        else {
+            Chunk* chunk = take_chunk();
+            try {
+                ::new (chunk->raw_slot(CHUNK_CAPACITY - 1)) T(value);
+            }
+            catch (...) {
+                release_chunk(chunk);
+                throw;
+            }
+            chunk->first = CHUNK_CAPACITY - 1;
+            chunk->last = CHUNK_CAPACITY;
+            chunk->next = head;
+            if (head != nullptr) {
+                head->prev = chunk;
+            }
+            else {
+                tail = chunk;
+            }
+            head = chunk;
+        }
+        ++list_size;
+    }
+
+    // Add element at the end; a new chunk fills from its start up
+    void push_back(const T& value) {
+        if (tail != nullptr && tail->last < CHUNK_CAPACITY) {
+            ::new (tail->raw_slot(tail->last)) T(value);
+            ++tail->last;
+        }
+        else {
+            Chunk* chunk = take_chunk();
+            try {
+                ::new (chunk->raw_slot(0)) T(value);
+            }
+            catch (...) {
+                release_chunk(chunk);
+                throw;
+            }
+            chunk->first = 0;
+            chunk->last = 1;
+            chunk->prev = tail;
+            if (tail != nullptr) {
+                tail->next = chunk;
+            }
+            else {
+                head = chunk;
+            }
+            tail = chunk;
+        }
+        ++list_size;
+    }
+
+    // Remove first element
+    void pop_front() {
+        if (head == nullptr) return;  // Nothing to do for empty list
+
+        head->slot(head->first)->~T();
+        ++head->first;
+        --list_size;
+        if (head->first == head->last) {
+            Chunk* emptied = head;
+            head = head->next;
+            if (head != nullptr) {
+                head->prev = nullptr;
+            }
+            else {
+                tail = nullptr;
+            }
+            release_chunk(emptied);
+        }
+    }
+
+    // Remove last element
+    void pop_back() {
+        if (tail == nullptr) return;  // Nothing to do for empty list
+
+        tail->slot(tail->last - 1)->~T();
+        --tail->last;
+        --list_size;
+        if (tail->first == tail->last) {
+            Chunk* emptied = tail;
+            tail = tail->prev;
+            if (tail != nullptr) {
+                tail->next = nullptr;
+            }
+            else {
+                head = nullptr;
+            }
+            release_chunk(emptied);
+        }
+    }
+
+    // Remove all elements; chunks other than the spare are freed
+    void clear() {
+        while (head != nullptr) {
+            Chunk* chunk = head;
+            head = head->next;
+            if constexpr (!std::is_trivially_destructible_v<T>) {
+                for (size_t i = chunk->first; i < chunk->last; ++i) {
+                    chunk->slot(i)->~T();
+                }
+            }
+            release_chunk(chunk);
+        }
+        tail = nullptr;
+        list_size = 0;
+    }
+};
+
+static_assert(ListLike<ChunkedList<int>>, "ChunkedList must model ListLike");
@@ -3,8 +3,17 @@
 // Macro to prevent multiple inclusions of this header
 #define LIST_INTERFACE_H
 
+#include <concepts>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
 // Interface (Abstract Base Class) for List operations
-// This defines the standard operations any list implementation should provide
+// This defines the standard operations any list implementation should provide.
+// CustomList doesn't derive from it; code that needs runtime polymorphism
+// wraps a list in a ListAdapter (below).
 template <typename T>
 class IList {
 public:
@@ -28,6 +37,29 @@ public:
     virtual void clear() = 0;                     // Remove all elements
 };
 
+// Compile-time counterpart of IList: the same operations, checked when a
+// template is instantiated instead of dispatched through a vtable, so calls
+// can be inlined. std::list models it too.
+template <typename L>
+concept ListLike = requires(L& l, const L& cl, const typename L::value_type& value) {
+    // Capacity operations
+    { cl.size() } -> std::convertible_to<size_t>;
+    { cl.empty() } -> std::convertible_to<bool>;
+
+    // Element access operations
+    { l.front() } -> std::same_as<typename L::value_type&>;
+    { cl.front() } -> std::same_as<const typename L::value_type&>;
+    { l.back() } -> std::same_as<typename L::value_type&>;
+    { cl.back() } -> std::same_as<const typename L::value_type&>;
+
+    // Modifier operations
+    l.push_front(value);
+    l.push_back(value);
+    l.pop_front();
+    l.pop_back();
+    l.clear();
+};
+
 // Node class for doubly-linked list implementation
 template <typename T>
 class ListNode {
@@ -40,17 +72,111 @@ public:
     ListNode(const T& val) : data(val), next(nullptr), prev(nullptr) {}
 };
 
-// Custom doubly-linked list implementation of IList interface
-template <typename T>
-class CustomList : public IList<T> {
+// Forward iterator over a CustomList (const or mutable)
+template <typename T, bool Const>
+class ListIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const T*, T*>;
+    using reference = std::conditional_t<Const, const T&, T&>;
+
+    ListIterator() = default;
+    explicit ListIterator(ListNode<T>* node) : node(node) {}
+    // Mutable iterators convert to const ones
+    template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+    ListIterator(const ListIterator<T, OtherConst>& other) : node(other.node) {}
+
+    reference operator*() const { return node->data; }
+    pointer operator->() const { return &node->data; }
+
+    ListIterator& operator++() {
+        node = node->next;
+        return *this;
+    }
+    ListIterator operator++(int) {
+        ListIterator previous = *this;
+        node = node->next;
+        return previous;
+    }
+
+    bool operator==(const ListIterator& other) const { return node == other.node; }
+    bool operator!=(const ListIterator& other) const { return node != other.node; }
+
 private:
+    template <typename, bool>
+    friend class ListIterator;
+
+    ListNode<T>* node = nullptr;  // Current node; nullptr past the end
+};
+
+// Custom doubly-linked list; models ListLike with non-virtual members.
+// Nodes come from Allocator (rebound to ListNode<T>): std::allocator by
+// default, or a PoolAllocator (poolAllocator.h) to pack them into slabs
+// and recycle them without calling new and delete per element.
+template <typename T, typename Allocator = std::allocator<T>>
+class CustomList {
+public:
+    using value_type = T;
+    using allocator_type = Allocator;
+    using iterator = ListIterator<T, false>;
+    using const_iterator = ListIterator<T, true>;
+
+private:
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ListNode<T>>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
     ListNode<T>* head;   // Pointer to first node in the list
     ListNode<T>* tail;   // Pointer to last node in the list
     size_t list_size;    // Current number of elements in the list
+    NodeAllocator node_allocator;  // Where nodes are allocated
+
+    // Allocate and construct a node holding a copy of value
+    ListNode<T>* create_node(const T& value) {
+        ListNode<T>* node = NodeTraits::allocate(node_allocator, 1);
+        try {
+            NodeTraits::construct(node_allocator, node, value);
+        }
+        catch (...) {
+            NodeTraits::deallocate(node_allocator, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    // Destroy a node and give its memory back to the allocator
+    void destroy_node(ListNode<T>* node) {
+        NodeTraits::destroy(node_allocator, node);
+        NodeTraits::deallocate(node_allocator, node, 1);
+    }
+
+    // Append copies of other's elements
+    void append_copies(const CustomList& other) {
+        for (ListNode<T>* current = other.head; current != nullptr; current = current->next) {
+            push_back(current->data);
+        }
+    }
+
+    // Take other's nodes; this list must be empty and share its allocator
+    void steal(CustomList& other) {
+        head = other.head;
+        tail = other.tail;
+        list_size = other.list_size;
+
+        // Reset the source list to avoid double deletion
+        other.head = nullptr;
+        other.tail = nullptr;
+        other.list_size = 0;
+    }
 
 public:
     // Default constructor - initializes empty list
-    CustomList() : head(nullptr), tail(nullptr), list_size(0) {}
+    CustomList() : CustomList(Allocator()) {}
+
+    // Empty list allocating its nodes from allocator
+    explicit CustomList(const Allocator& allocator)
+        : head(nullptr), tail(nullptr), list_size(0), node_allocator(allocator) {}
 
     // Destructor - deallocates all nodes when list is destroyed
     ~CustomList() {
@@ -58,86 +184,87 @@ public:
     }
 
     // Copy constructor - creates deep copy of another list
-    CustomList(const CustomList& other) : head(nullptr), tail(nullptr), list_size(0) {
-        // Iterate through other list and copy each element
-        ListNode<T>* current = other.head;
-        while (current != nullptr) {
-            push_back(current->data);
-            current = current->next;
-        }
+    CustomList(const CustomList& other)
+        : head(nullptr), tail(nullptr), list_size(0),
+          node_allocator(NodeTraits::select_on_container_copy_construction(other.node_allocator)) {
+        append_copies(other);
     }
 
     // Move constructor - transfers ownership of resources from another list
     CustomList(CustomList&& other) noexcept
-        : head(other.head), tail(other.tail), list_size(other.list_size) {
-        // Reset the source list to avoid double deletion
-        other.head = nullptr;
-        other.tail = nullptr;
-        other.list_size = 0;
+        : head(nullptr), tail(nullptr), list_size(0), node_allocator(other.node_allocator) {
+        steal(other);
     }
 
     // Copy assignment operator - makes deep copy of another list
     CustomList& operator=(const CustomList& other) {
         if (this != &other) {  // Protect against self-assignment
             clear();           // Clear current contents
-
-            // Copy each element from the other list
-            ListNode<T>* current = other.head;
-            while (current != nullptr) {
-                push_back(current->data);
-                current = current->next;
+            if constexpr (NodeTraits::propagate_on_container_copy_assignment::value) {
+                node_allocator = other.node_allocator;
             }
+            append_copies(other);
         }
         return *this;
     }
 
-    // Move assignment operator - transfers ownership of resources
-    CustomList& operator=(CustomList&& other) noexcept {
+    // Move assignment operator - transfers ownership of resources; copies
+    // the elements only if the allocators differ and don't propagate
+    CustomList& operator=(CustomList&& other) noexcept(NodeTraits::propagate_on_container_move_assignment::value) {
         if (this != &other) {  // Protect against self-assignment
             clear();           // Clear current contents
-
-            // Take ownership of other list's resources
-            head = other.head;
-            tail = other.tail;
-            list_size = other.list_size;
-
-            // Reset the source list
-            other.head = nullptr;
-            other.tail = nullptr;
-            other.list_size = 0;
+            if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+                node_allocator = other.node_allocator;
+                steal(other);
+            }
+            else if (node_allocator == other.node_allocator) {
+                steal(other);
+            }
+            else {
+                append_copies(other);
+                other.clear();
+            }
         }
         return *this;
     }
 
+    allocator_type get_allocator() const { return allocator_type(node_allocator); }
+
+    // Iteration from front to back
+    iterator begin() { return iterator(head); }
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(head); }
+    const_iterator end() const { return const_iterator(); }
+
     // Returns the number of elements in the list
-    size_t size() const override { return list_size; }
+    size_t size() const { return list_size; }
 
     // Checks if the list is empty
-    bool empty() const override { return list_size == 0; }
+    bool empty() const { return list_size == 0; }
 
     // Access the first element (mutable version)
-    T& front() override {
+    T& front() {
         return head->data;  // Note: Should check for empty list in production code
     }
 
     // Access the first element (const version)
-    const T& front() const override {
+    const T& front() const {
         return head->data;  // Note: Should check for empty list in production code
     }
 
     // Access the last element (mutable version)
-    T& back() override {
+    T& back() {
         return tail->data;  // Note: Should check for empty list in production code
     }
 
     // Access the last element (const version)
-    const T& back() const override {
+    const T& back() const {
         return tail->data;  // Note: Should check for empty list in production code
     }
 
     // Add element to the front of the list
-    void push_front(const T& value) override {
-        ListNode<T>* new_node = new ListNode<T>(value);  // Create new node
+    void push_front(const T& value) {
+        ListNode<T>* new_node = create_node(value);  // Create new node
 
         if (head == nullptr) {
             // List is empty - new node becomes both head and tail
@@ -153,8 +280,8 @@ public:
     }
 
     // Add element to the back of the list
-    void push_back(const T& value) override {
-        ListNode<T>* new_node = new ListNode<T>(value);  // Create new node
+    void push_back(const T& value) {
+        ListNode<T>* new_node = create_node(value);  // Create new node
 
         if (tail == nullptr) {
             // List is empty - new node becomes both head and tail
@@ -170,7 +297,7 @@ public:
     }
 
     // Remove element from the front of the list
-    void pop_front() override {
+    void pop_front() {
         if (head == nullptr) return;  // Nothing to do for empty list
 
         ListNode<T>* temp = head;  // Save current head
@@ -184,12 +311,12 @@ public:
             tail = nullptr;
         }
 
-        delete temp;    // Delete old head
-        list_size--;    // Decrement size
+        destroy_node(temp);  // Release old head
+        list_size--;         // Decrement size
     }
 
     // Remove element from the back of the list
-    void pop_back() override {
+    void pop_back() {
         if (tail == nullptr) return;  // Nothing to do for empty list
 
         ListNode<T>* temp = tail;  // Save current tail
@@ -203,18 +330,53 @@ public:
             head = nullptr;
         }
 
-        delete temp;    // Delete old tail
-        list_size--;    // Decrement size
+        destroy_node(temp);  // Release old tail
+        list_size--;         // Decrement size
     }
 
     // Remove all elements from the list
-    void clear() override {
+    void clear() {
         while (head != nullptr) {
             ListNode<T>* temp = head;  // Save current node
             head = head->next;         // Move to next node
-            delete temp;               // Delete saved node
+            destroy_node(temp);        // Release saved node
         }
         tail = nullptr;    // Reset tail
         list_size = 0;     // Reset size
     }
-};
\ No newline at end of file
+};
+
+static_assert(ListLike<CustomList<int>>, "CustomList must model ListLike");
+
+// IList over any ListLike container, for code that needs runtime
+// polymorphism. The adapter owns the list; every call through it is a
+// virtual one.
+template <ListLike List>
+class ListAdapter final : public IList<typename List::value_type> {
+private:
+    using T = typename List::value_type;
+    List list;  // The wrapped container
+
+public:
+    ListAdapter() = default;
+    explicit ListAdapter(List container) : list(std::move(container)) {}
+
+    // Direct, statically dispatched access to the list
+    List& container() { return list; }
+    const List& container() const { return list; }
+
+    // IList interface implementation, forwarding to the list
+    size_t size() const override { return list.size(); }
+    bool empty() const override { return list.empty(); }
+
+    T& front() override { return list.front(); }
+    const T& front() const override { return list.front(); }
+    T& back() override { return list.back(); }
+    const T& back() const override { return list.back(); }
+
+    void push_front(const T& value) override { list.push_front(value); }
+    void push_back(const T& value) override { list.push_back(value); }
+    void pop_front() override { list.pop_front(); }
+    void pop_back() override { list.pop_back(); }
+    void clear() override { list.clear(); }
+};
@@ -0,0 +1,150 @@
+#pragma once
+#define POOL_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+// Slab allocator for small fixed-size objects such as list nodes. Memory
+// comes from the system in chunks (16 KB, doubling up to 1 MB) carved by a
+// bump pointer, so nodes allocated together sit next to each other. Each
+// size class (multiples of 8 bytes up to MAX_SIZE) keeps a free list of
+// the slots given back, and reuses them before touching the chunk again;
+// nothing returns to the system until the pool is destroyed.
+//
+// Larger or over-aligned requests are passed to operator new. A pool is
+// not thread-safe: share one only among containers used by one thread.
+class NodePool {
+public:
+    static constexpr size_t GRANULE = 8;      // Size class step and slot alignment
+    static constexpr size_t MAX_SIZE = 256;   // Largest slot served from chunks
+
+    NodePool() = default;
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    // Frees every chunk; all slots must have been given back by then
+    ~NodePool() {
+        while (chunks != nullptr) {
+            Chunk* chunk = chunks;
+            chunks = chunk->next;
+            ::operator delete(chunk, std::align_val_t(CHUNK_ALIGNMENT));
+        }
+    }
+
+    void* allocate(size_t size, size_t alignment) {
+        if (size > MAX_SIZE || alignment > GRANULE) {
+            return ::operator new(size, std::align_val_t(alignment));
+        }
+        size_t index = class_index(size);
+        FreeSlot* slot = free_lists[index];
+        if (slot != nullptr) {
+            free_lists[index] = slot->next;
+            return slot;
+        }
+        size_t slot_size = (index + 1) * GRANULE;
+        if (static_cast<size_t>(bump_end - bump) < slot_size) {
+            add_chunk();
+        }
+        void* result = bump;
+        bump += slot_size;
+        return result;
+    }
+
+    void deallocate(void* pointer, size_t size, size_t alignment) noexcept {
+        if (size > MAX_SIZE || alignment > GRANULE) {
+            ::operator delete(pointer, std::align_val_t(alignment));
+            return;
+        }
+        size_t index = class_index(size);
+        FreeSlot* slot = static_cast<FreeSlot*>(pointer);
+        slot->next = free_lists[index];
+        free_lists[index] = slot;
+    }
+
+    // Bytes taken from the system so far
+    size_t reserved_bytes() const { return reserved; }
+
+private:
+    static constexpr size_t CHUNK_ALIGNMENT = 64;   // Chunks start on a cache line
+    static constexpr size_t FIRST_CHUNK = 16 * 1024;
+    static constexpr size_t MAX_CHUNK = 1024 * 1024;
+
+    struct FreeSlot {
+        FreeSlot* next;
+    };
+
+    // Header at the start of each chunk, linking them for the destructor
+    struct alignas(16) Chunk {
+        Chunk* next;
+    };
+
+    FreeSlot* free_lists[MAX_SIZE / GRANULE] = {};  // One per size class
+    char* bump = nullptr;       // Next free byte of the newest chunk
+    char* bump_end = nullptr;   // ... and its end
+    Chunk* chunks = nullptr;
+    size_t next_chunk_size = FIRST_CHUNK;
+    size_t reserved = 0;
+
+    static size_t class_index(size_t size) {
+        return size == 0 ? 0 : (size - 1) / GRANULE;
+    }
+
+    // Start a new chunk; the tail of the old one (less than a slot) is dropped
+    void add_chunk() {
+        size_t size = next_chunk_size;
+        Chunk* chunk = static_cast<Chunk*>(::operator new(size, std::align_val_t(CHUNK_ALIGNMENT)));
+        chunk->next = chunks;
+        chunks = chunk;
+        bump = reinterpret_cast<char*>(chunk) + sizeof(Chunk);
+        bump_end = reinterpret_cast<char*>(chunk) + size;
+        reserved += size;
+        if (next_chunk_size < MAX_CHUNK) {
+            next_chunk_size *= 2;
+        }
+    }
+};
+
+// Standard allocator over a shared NodePool, for node-based containers
+// such as CustomList<T, PoolAllocator<T>>. A default-constructed allocator
+// creates a pool of its own; copies and rebound copies share it, and the
+// pool lives as long as any of them. Copying (not moving) an allocator
+// never leaves one without a pool.
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PoolAllocator() : pool(std::make_shared<NodePool>()) {}
+    explicit PoolAllocator(std::shared_ptr<NodePool> shared_pool) : pool(std::move(shared_pool)) {}
+    PoolAllocator(const PoolAllocator&) = default;
+    PoolAllocator& operator=(const PoolAllocator&) = default;
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : pool(other.pool) {}
+
+    T* allocate(size_t count) {
+        if (count > SIZE_MAX / sizeof(T)) throw std::bad_array_new_length();
+        return static_cast<T*>(pool->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* pointer, size_t count) noexcept {
+        pool->deallocate(pointer, count * sizeof(T), alignof(T));
+    }
+
+    NodePool& resource() const { return *pool; }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>& other) const noexcept { return pool == other.pool; }
+
+private:
+    template <typename U>
+    friend class PoolAllocator;
+
+    std::shared_ptr<NodePool> pool;
+};
@@ -2,6 +2,7 @@
 //
 
 #include <iostream>
+#include <string>
 #include "vectorIntface.h"
 #include "listInterface.h"
 
@@ -19,6 +20,12 @@ int main()
     }
     std::cout << "\n";
 
+    // Runtime polymorphism is opt-in: wrap the vector in an adapter
+    VectorAdapter<CustomVector<int>> adapter(vec);
+    IVector<int>& dynamic = adapter;
+    dynamic.push_back(40);
+    std::cout << "Through IVector: " << dynamic.size() << " elements, last " << dynamic.back() << "\n";
+
     // List usage
     CustomList<std::string> lst;
     lst.push_back("world");
@@ -1,7 +1,17 @@
 #pragma once
 #define VECTOR_INTERFACE_H
 
-// Interface (Abstract Base Class) for Vector operations
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Interface (Abstract Base Class) for Vector operations.
+// CustomVector doesn't derive from it; code that needs runtime polymorphism
+// wraps a vector in a VectorAdapter (below).
 template <typename T>
 class IVector {
 public:
@@ -29,50 +39,211 @@ public:
     virtual void reserve(size_t new_capacity) = 0; // Reserve storage capacity
 };
 
+// Compile-time counterpart of IVector: the same operations, checked when a
+// template is instantiated instead of dispatched through a vtable, so calls
+// inline and loops over operator[] can be vectorized. std::vector models it
+// too.
+template <typename V>
+concept VectorLike = requires(V& v, const V& cv, size_t index, const typename V::value_type& value) {
+    // Capacity operations
+    { cv.size() } -> std::convertible_to<size_t>;
+    { cv.empty() } -> std::convertible_to<bool>;
+    { cv.capacity() } -> std::convertible_to<size_t>;
+
+    // Element access operations
+    { v[index] } -> std::same_as<typename V::value_type&>;
+    { cv[index] } -> std::same_as<const typename V::value_type&>;
+    { v.at(index) } -> std::same_as<typename V::value_type&>;
+    { cv.at(index) } -> std::same_as<const typename V::value_type&>;
+    { v.front() } -> std::same_as<typename V::value_type&>;
+    { cv.front() } -> std::same_as<const typename V::value_type&>;
+    { v.back() } -> std::same_as<typename V::value_type&>;
+    { cv.back() } -> std::same_as<const typename V::value_type&>;
+
+    // Modifier operations
+    v.push_back(value);
+    v.pop_back();
+    v.clear();
+    v.reserve(index);
+};
+
+// Vector over raw storage: only the first vec_size slots hold constructed
+// elements, so reserve() and growth construct nothing, and pop_back() and
+// clear() run the elements' destructors. Elements are relocated with
+// memcpy when T is trivially copyable, otherwise moved (copied if the move
+// may throw, keeping the old elements intact on failure).
+// Member functions are not virtual: CustomVector models VectorLike.
 template <typename T>
-class CustomVector : public IVector<T> {
+class CustomVector {
+public:
+    using value_type = T;
+
 private:
-    T* data = nullptr;         // Pointer to dynamically allocated array
+    T* data = nullptr;         // Uninitialised storage for vec_capacity elements
     size_t vec_size = 0;       // Current number of elements
     size_t vec_capacity = 0;   // Current allocated capacity
 
-    // Internal function to resize the underlying storage
-    void reallocate(size_t new_capacity) {
-        T* new_data = new T[new_capacity];  // Allocate new storage
+    // Allocate uninitialised storage for count elements, aligned for T
+    static T* allocate(size_t count) {
+        if (count > SIZE_MAX / sizeof(T)) throw std::bad_alloc();
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+        }
+        else {
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+    }
 
-        // Move existing elements to new storage
-        for (size_t i = 0; i < vec_size; ++i) {
-            new_data[i] = std::move(data[i]);  // Use move semantics for efficiency
+    static void deallocate(T* storage) {
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(storage, std::align_val_t(alignof(T)));
+        }
+        else {
+            ::operator delete(storage);
         }
+    }
 
-        delete[] data;           // Free old storage
+    // Run the destructors of count elements (nothing to do for trivial types)
+    static void destroy(T* first, size_t count) {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_t i = 0; i < count; ++i) {
+                first[i].~T();
+            }
+        }
+    }
+
+    // Move count elements into uninitialised storage at to, ending their
+    // lifetime at from. If a copy throws, from is left as it was.
+    static void relocate(T* from, size_t count, T* to) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (count > 0) {
+                std::memcpy(static_cast<void*>(to), from, count * sizeof(T));
+            }
+        }
+        else {
+            size_t built = 0;
+            try {
+                for (; built < count; ++built) {
+                    ::new (static_cast<void*>(to + built)) T(std::move_if_noexcept(from[built]));
+                }
+            }
+            catch (...) {
+                destroy(to, built);
+                throw;
+            }
+            destroy(from, count);
+        }
+    }
+
+    // Internal function to resize the underlying storage
+    void reallocate(size_t new_capacity) {
+        T* new_data = allocate(new_capacity);
+        try {
+            relocate(data, vec_size, new_data);
+        }
+        catch (...) {
+            deallocate(new_data);
+            throw;
+        }
+        deallocate(data);        // Free old storage
         data = new_data;         // Update data pointer
         vec_capacity = new_capacity; // Update capacity
     }
 
+    // Capacity after growing: double (or start with 1 if empty)
+    size_t grown_capacity() const {
+        return vec_capacity == 0 ? 1 : vec_capacity * 2;
+    }
+
+    // Make room for at least min_capacity elements, growing geometrically
+    // so repeated small resizes stay amortised O(1)
+    void grow_to(size_t min_capacity) {
+        if (min_capacity > vec_capacity) {
+            size_t grown = grown_capacity();
+            reallocate(min_capacity > grown ? min_capacity : grown);
+        }
+    }
+
+    // Copy count elements to the end (the capacity must be there)
+    void append_copies(const T* source, size_t count) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (count > 0) {
+                std::memcpy(static_cast<void*>(data + vec_size), source, count * sizeof(T));
+            }
+            vec_size += count;
+        }
+        else {
+            for (size_t i = 0; i < count; ++i, ++vec_size) {
+                ::new (static_cast<void*>(data + vec_size)) T(source[i]);
+            }
+        }
+    }
+
+    // Append copies of value up to new_size elements (the capacity must be there)
+    void fill_to(size_t new_size, const T& value) {
+        for (; vec_size < new_size; ++vec_size) {
+            ::new (static_cast<void*>(data + vec_size)) T(value);
+        }
+    }
+
+    // emplace_back when full: the new element is built in the new storage
+    // before the old ones move, so arguments referring into this vector
+    // (v.push_back(v[0])) are still alive when it is read
+    template <typename... Args>
+    T& emplace_back_grow(Args&&... args) {
+        size_t new_capacity = grown_capacity();
+        T* new_data = allocate(new_capacity);
+        T* element;
+        try {
+            element = ::new (static_cast<void*>(new_data + vec_size)) T(std::forward<Args>(args)...);
+        }
+        catch (...) {
+            deallocate(new_data);
+            throw;
+        }
+        try {
+            relocate(data, vec_size, new_data);
+        }
+        catch (...) {
+            element->~T();
+            deallocate(new_data);
+            throw;
+        }
+        deallocate(data);
+        data = new_data;
+        vec_capacity = new_capacity;
+        ++vec_size;
+        return *element;
+    }
+
+    // Destroy every element and free the storage
+    void release() {
+        destroy(data, vec_size);
+        deallocate(data);
+        data = nullptr;
+        vec_size = 0;
+        vec_capacity = 0;
+    }
+
 public:
     // Default constructor - creates empty vector
     CustomVector() = default;
 
-    // Constructor with initial size
-    CustomVector(size_t initial_size)
-        : vec_size(initial_size), vec_capacity(initial_size) {
-        data = new T[vec_capacity];  // Allocate storage
+    // Constructor with initial size - value-initialised elements
+    // (delegating, so the destructor cleans up if one of them throws)
+    CustomVector(size_t initial_size) : CustomVector() {
+        resize(initial_size);
     }
 
-    // Destructor - releases allocated memory
+    // Destructor - destroys the elements and releases the storage
     ~CustomVector() {
-        delete[] data;
+        release();
     }
 
     // Copy constructor - creates deep copy
-    CustomVector(const CustomVector& other)
-        : vec_size(other.vec_size), vec_capacity(other.vec_capacity) {
-        data = new T[vec_capacity];
-        // Copy elements from source
-        for (size_t i = 0; i < vec_size; ++i) {
-            data[i] = other.data[i];  // Uses T's copy assignment
-        }
+    CustomVector(const CustomVector& other) : CustomVector() {
+        reserve(other.vec_size);
+        append_copies(other.data, other.vec_size);
     }
 
     // Move constructor - transfers ownership
@@ -84,19 +255,12 @@ public:
         other.vec_capacity = 0;
     }
 
-    // Copy assignment operator
+    // Copy assignment operator - reuses the storage when it is large enough
     CustomVector& operator=(const CustomVector& other) {
         if (this != &other) {  // Protect against self-assignment
-            delete[] data;      // Free existing storage
-
-            vec_size = other.vec_size;
-            vec_capacity = other.vec_capacity;
-            data = new T[vec_capacity];
-
-            // Copy elements
-            for (size_t i = 0; i < vec_size; ++i) {
-                data[i] = other.data[i];
-            }
+            clear();
+            reserve(other.vec_size);
+            append_copies(other.data, other.vec_size);
         }
         return *this;
     }
@@ -104,7 +268,7 @@ public:
     // Move assignment operator
     CustomVector& operator=(CustomVector&& other) noexcept {
         if (this != &other) {  // Protect against self-assignment
-            delete[] data;      // Free existing storage
+            release();          // Free existing elements and storage
 
             // Take ownership of other's resources
             data = other.data;
@@ -119,57 +283,138 @@ public:
         return *this;
     }
 
-    // IVector interface implementation
+    // VectorLike operations
 
-    size_t size() const override { return vec_size; }
-    bool empty() const override { return vec_size == 0; }
-    size_t capacity() const override { return vec_capacity; }
+    size_t size() const { return vec_size; }
+    bool empty() const { return vec_size == 0; }
+    size_t capacity() const { return vec_capacity; }
 
     // Unchecked element access
-    T& operator[](size_t index) override { return data[index]; }
-    const T& operator[](size_t index) const override { return data[index]; }
+    T& operator[](size_t index) { return data[index]; }
+    const T& operator[](size_t index) const { return data[index]; }
 
     // Checked element access with bounds checking
-    T& at(size_t index) override {
+    T& at(size_t index) {
         if (index >= vec_size) throw "Index out of bounds";
         return data[index];
     }
-    const T& at(size_t index) const override {
+    const T& at(size_t index) const {
         if (index >= vec_size) throw "Index out of bounds";
         return data[index];
     }
 
     // Access first and last elements
-    T& front() override { return data[0]; }
-    const T& front() const override { return data[0]; }
-    T& back() override { return data[vec_size - 1]; }
-    const T& back() const override { return data[vec_size - 1]; }
+    T& front() { return data[0]; }
+    const T& front() const { return data[0]; }
+    T& back() { return data[vec_size - 1]; }
+    const T& back() const { return data[vec_size - 1]; }
 
-    // Add element to the end
-    void push_back(const T& value) override {
-        if (vec_size >= vec_capacity) {
-            // If we're out of space, grow by doubling (or start with 1 if empty)
-            reserve(vec_capacity == 0 ? 1 : vec_capacity * 2);
+    // Construct an element at the end from args, growing by doubling
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (vec_size == vec_capacity) {
+            return emplace_back_grow(std::forward<Args>(args)...);
         }
-        data[vec_size++] = value;  // Copy the value and increment size
+        T* element = ::new (static_cast<void*>(data + vec_size)) T(std::forward<Args>(args)...);
+        ++vec_size;
+        return *element;
+    }
+
+    // Add element to the end (copied)
+    void push_back(const T& value) {
+        emplace_back(value);
+    }
+
+    // Add element to the end (moved)
+    void push_back(T&& value) {
+        emplace_back(std::move(value));
     }
 
     // Remove last element
-    void pop_back() override {
+    void pop_back() {
         if (vec_size > 0) {
-            --vec_size;  // Simply decrement size - doesn't destruct the element
+            --vec_size;
+            destroy(data + vec_size, 1);
         }
     }
 
     // Clear all elements (doesn't deallocate memory)
-    void clear() override {
+    void clear() {
+        destroy(data, vec_size);
         vec_size = 0;
     }
 
     // Reserve storage capacity
-    void reserve(size_t new_capacity) override {
+    void reserve(size_t new_capacity) {
         if (new_capacity > vec_capacity) {
             reallocate(new_capacity);  // Only grow, never shrink
         }
     }
-};
\ No newline at end of file
+
+    // Shrink to new_size elements, or grow with value-initialised ones
+    void resize(size_t new_size) {
+        if (new_size <= vec_size) {
+            destroy(data + new_size, vec_size - new_size);
+            vec_size = new_size;
+            return;
+        }
+        grow_to(new_size);
+        for (; vec_size < new_size; ++vec_size) {
+            ::new (static_cast<void*>(data + vec_size)) T();
+        }
+    }
+
+    // Shrink to new_size elements, or grow with copies of value
+    void resize(size_t new_size, const T& value) {
+        if (new_size <= vec_size) {
+            resize(new_size);
+        }
+        else if (new_size > vec_capacity) {
+            T copy(value);  // value may be an element about to be relocated
+            grow_to(new_size);
+            fill_to(new_size, copy);
+        }
+        else {
+            fill_to(new_size, value);
+        }
+    }
+};
+
+static_assert(VectorLike<CustomVector<int>>, "CustomVector must model VectorLike");
+
+// IVector over any VectorLike container, for code that needs runtime
+// polymorphism. The adapter owns the container; every call through it is a
+// virtual one, so hot loops should use the container itself.
+template <VectorLike Vector>
+class VectorAdapter final : public IVector<typename Vector::value_type> {
+private:
+    using T = typename Vector::value_type;
+    Vector vec;  // The wrapped container
+
+public:
+    VectorAdapter() = default;
+    explicit VectorAdapter(Vector container) : vec(std::move(container)) {}
+
+    // Direct, statically dispatched access to the container
+    Vector& container() { return vec; }
+    const Vector& container() const { return vec; }
+
+    // IVector interface implementation, forwarding to the container
+    size_t size() const override { return vec.size(); }
+    bool empty() const override { return vec.empty(); }
+    size_t capacity() const override { return vec.capacity(); }
+
+    T& operator[](size_t index) override { return vec[index]; }
+    const T& operator[](size_t index) const override { return vec[index]; }
+    T& at(size_t index) override { return vec.at(index); }
+    const T& at(size_t index) const override { return vec.at(index); }
+    T& front() override { return vec.front(); }
+    const T& front() const override { return vec.front(); }
+    T& back() override { return vec.back(); }
+    const T& back() const override { return vec.back(); }
+
+    void push_back(const T& value) override { vec.push_back(value); }
+    void pop_back() override { vec.pop_back(); }
+    void clear() override { vec.clear(); }
+    void reserve(size_t new_capacity) override { vec.reserve(new_capacity); }
+};